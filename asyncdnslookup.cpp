@@ -0,0 +1,234 @@
+/*======================================================================
+FILE:
+asyncdnslookup.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Host name lookups that don't block.  WiFi.hostByName() waits inside
+the call for the DNS answer; this starts the lookup and lets the 
+caller check back on later loop passes.
+
+PUBLIC CLASSES AND FUNCTIONS:
+AsyncDnsLookup
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+The WLAN must be up for lookups to succeed.
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "asyncdnslookup.h"
+
+#include <strings.h>
+
+extern "C" {
+#include "lwip/init.h"
+#include "lwip/dns.h"
+}
+
+// The DNS callback's address argument lost a const in lwIP 1.4
+#if LWIP_VERSION_MAJOR == 1
+#define DNS_CALLBACK_CONST
+#else
+#define DNS_CALLBACK_CONST const
+#endif
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// Gives the lwIP callback a way in to the private found()
+struct AsyncDnsLookupCallback
+{
+    static void found( const char *name, DNS_CALLBACK_CONST ip_addr_t *ipaddr, void *arg )
+    {
+        static_cast<AsyncDnsLookup *>( arg )->found( name, ( ipaddr != nullptr ) ? ipaddr->addr : 0 );
+    }
+};
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+AsyncDnsLookup()
+
+DESCRIPTION:
+C-tor
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+AsyncDnsLookup::AsyncDnsLookup() : _done( true ), _address( 0 )
+{
+}
+
+/*======================================================================
+FUNCTION:
+Start()
+
+DESCRIPTION:
+Starts looking the host name up.  If lwIP already knows the answer
+(or the name is an IP address) the lookup is done on return.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void AsyncDnsLookup::Start( const char *hostname )
+{
+    ip_addr_t addr;
+
+    _hostname = hostname;
+    _done     = false;
+    _address  = 0;
+
+    err_t err = dns_gethostbyname( hostname, &addr, AsyncDnsLookupCallback::found, this );
+
+    if ( err == ERR_OK )
+    {
+        found( nullptr, addr.addr );
+    }
+    else if ( err != ERR_INPROGRESS )
+    {
+        // Bad name, or DNS isn't up
+        found( nullptr, 0 );
+    }
+}
+
+/*======================================================================
+FUNCTION:
+Poll()
+
+DESCRIPTION:
+Checks on the lookup
+
+RETURN VALUE:
+DNS_PENDING until the answer is in, then DNS_DONE (address filled in)
+or DNS_FAILED.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+AsyncDnsLookup::Result AsyncDnsLookup::Poll( IPAddress &address ) const
+{
+    if ( _done == false )
+    {
+        return DNS_PENDING;
+    }
+
+    if ( _address == 0 )
+    {
+        return DNS_FAILED;
+    }
+
+    address = IPAddress( _address );
+
+    return DNS_DONE;
+}
+
+/*======================================================================
+FUNCTION:
+found()
+
+DESCRIPTION:
+Records the answer.  0 means the lookup failed.  A late answer for a
+name we are no longer waiting on is dropped, so it can't pass for the
+address of the current one.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void AsyncDnsLookup::found( const char *name, uint32_t address )
+{
+    if ( name != nullptr && ( _done == true || strcasecmp( _hostname.c_str(), name ) != 0 ) )
+    {
+        return;
+    }
+
+    _address = address;
+    _done    = true;
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
@@ -0,0 +1,195 @@
+#ifndef _GARAGEOMATIC_ASYNCDNSLOOKUP_H_
+#define _GARAGEOMATIC_ASYNCDNSLOOKUP_H_
+
+/*======================================================================
+FILE:
+asyncdnslookup.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Host name lookups that don't block.  WiFi.hostByName() waits inside
+the call for the DNS answer; this starts the lookup and lets the 
+caller check back on later loop passes.
+
+PUBLIC CLASSES AND FUNCTIONS:
+AsyncDnsLookup
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <IPAddress.h>
+#include <WString.h>
+
+#include <stdint.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// lwIP holds on to the object's address until the lookup finishes, so
+// don't destroy one with a lookup in flight.  There is no timeout in
+// here; callers give up on their own schedule.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+AsyncDnsLookup
+
+DESCRIPTION:
+Wraps lwIP's dns_gethostbyname().  lwIP answers right away if the name
+is an IP address or is in its cache, otherwise its callback fills in
+the answer later from the network stack.
+
+HOW TO USE:
+1. Call Start() with the host name.
+2. Call Poll() on later passes until it stops returning DNS_PENDING.
+
+======================================================================*/
+class AsyncDnsLookup
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    enum Result
+    {
+        DNS_PENDING = 0,
+        DNS_DONE,
+        DNS_FAILED
+    };
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    AsyncDnsLookup();
+
+    void Start( const char *hostname );
+
+    // address is filled in on DNS_DONE
+    Result Poll( IPAddress &address ) const;
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    // Called by the lwIP callback.  name is the host name the answer
+    // is for, nullptr for answers we work out ourselves.
+    void found( const char *name, uint32_t address );
+
+    friend struct AsyncDnsLookupCallback;
+
+    // No copying. Leaving the implementation undefined to cause a link
+    // error
+    AsyncDnsLookup( const AsyncDnsLookup &rhs );
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    // What we are waiting on.  lwIP can still answer a lookup the 
+    // caller gave up on after Start() has moved on to another name.
+    String            _hostname;
+
+    // Written from the network stack
+    volatile bool     _done;
+    volatile uint32_t _address;
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+// None.
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+None.
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_ASYNCDNSLOOKUP_H_
@@ -0,0 +1,557 @@
+/*======================================================================
+FILE:
+calibrationmanager.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Runs garage door calibration as a background job.  A job closes a
+fully open door and times how long it takes the sensor to see it
+closed.  Jobs are stepped from the scheduler, so the web server keeps
+serving (and the doors keep publishing) while one runs.
+
+PUBLIC CLASSES AND FUNCTIONS:
+CalibrationManager
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+Begin() must be called before any jobs are started.
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "calibrationmanager.h"
+
+#include "Arduino.h"
+
+// Flash file system support
+#include <FS.h>
+
+#include <TimeLib.h>
+
+#include "relayactuator.h"
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// Where the calibration history lives on the flash file system
+static const char *CALIBRATION_FILENAME = "/calibration.txt";
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+GarageDoor::GarageDoorCollection *CalibrationManager::_doors = nullptr;
+
+CalibrationManager::Job CalibrationManager::_jobs[CalibrationManager::MAX_DOORS];
+
+CalibrationManager::Job CalibrationManager::_history[CalibrationManager::MAX_DOORS][CalibrationManager::HISTORY_DEPTH];
+
+int CalibrationManager::_historyCount[CalibrationManager::MAX_DOORS] = { 0 };
+
+uint32_t CalibrationManager::_nextJobId = 1;
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+Begin()
+
+DESCRIPTION:
+Remembers the doors, loads the stored calibration history and sets
+each door's travel time from its last good run.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+Changes the door travel times.
+
+======================================================================*/
+void CalibrationManager::Begin( GarageDoor::GarageDoorCollection &doors )
+{
+    _doors = &doors;
+
+    for ( int i = 0; i < MAX_DOORS; i++ )
+    {
+        memset( &_jobs[i], 0, sizeof( Job ) );
+        _jobs[i].state = JOB_NONE;
+        _historyCount[i] = 0;
+    }
+
+    loadHistory();
+
+    for ( int door = 0; door < doors.size() && door < MAX_DOORS; door++ )
+    {
+        for ( int i = 0; i < _historyCount[door]; i++ )
+        {
+            if ( _history[door][i].state == JOB_DONE )
+            {
+                doors[door].SetTravelTimeMS( _history[door][i].elapsedMS );
+                break;
+            }
+        }
+    }
+}
+
+/*======================================================================
+FUNCTION:
+Start()
+
+DESCRIPTION:
+Starts a calibration job.  The door has to be sitting fully open, and
+only one job per door can run at a time.  Other doors can calibrate
+at the same time.
+
+RETURN VALUE:
+CalibrationManager::StartResult
+
+SIDE EFFECTS:
+Presses the garage door opener.
+
+======================================================================*/
+CalibrationManager::StartResult CalibrationManager::Start( int door, uint32_t &jobId )
+{
+    if ( _doors == nullptr || door < 0 || door >= _doors->size() || door >= MAX_DOORS )
+    {
+        return START_FAILED;
+    }
+
+    Job &job = _jobs[door];
+
+    if ( job.state == JOB_PENDING || job.state == JOB_RUNNING )
+    {
+        return START_ALREADY_RUNNING;
+    }
+
+    GarageDoor &garageDoor = ( *_doors )[door];
+
+    if ( garageDoor.Status() != GarageDoor::OPEN ||
+         garageDoor.State() != GarageDoor::DOOR_OPEN )
+    {
+        return START_NOT_OPEN;
+    }
+
+    uint32_t pulsesBefore = RelayActuator::GetPulseCount( garageDoor.GetRelayPin() );
+
+    if ( garageDoor.Command( GarageDoor::COMMAND_CLOSE ) != GarageDoor::COMMAND_QUEUED )
+    {
+        return START_FAILED;
+    }
+
+    job.id           = _nextJobId++;
+    job.state        = JOB_PENDING;
+    job.startMS      = millis();
+    job.elapsedMS    = 0;
+    job.startedUTC   = ( timeStatus() != timeNotSet ) ? now() : 0;
+    job.pulsesBefore = pulsesBefore;
+
+    jobId = job.id;
+
+    Serial.printf( "Calibration job %u started for garage door %d\n", job.id, door );
+
+    return START_OK;
+}
+
+/*======================================================================
+FUNCTION:
+Process()
+
+DESCRIPTION:
+Steps every running job.  The clock starts when the relay pulse
+actually starts, and stops at the timestamp of the sensor edge that
+closed the door (the door state machine keeps it), so how often this
+runs doesn't affect the measurement.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+Sets the door travel time when a job finishes.
+
+======================================================================*/
+void CalibrationManager::Process()
+{
+    if ( _doors == nullptr )
+    {
+        return;
+    }
+
+    unsigned long nowMS = millis();
+
+    for ( int door = 0; door < _doors->size() && door < MAX_DOORS; door++ )
+    {
+        Job &job = _jobs[door];
+
+        if ( job.state != JOB_PENDING && job.state != JOB_RUNNING )
+        {
+            continue;
+        }
+
+        GarageDoor &garageDoor = ( *_doors )[door];
+
+        if ( job.state == JOB_PENDING )
+        {
+            int relayPin = garageDoor.GetRelayPin();
+
+            if ( RelayActuator::GetPulseCount( relayPin ) != job.pulsesBefore )
+            {
+                job.startMS = RelayActuator::GetLastPulseMS( relayPin );
+                job.state   = JOB_RUNNING;
+            }
+        }
+
+        if ( job.state == JOB_RUNNING &&
+             garageDoor.State() == GarageDoor::DOOR_CLOSED &&
+             (long) ( garageDoor.GetStateSinceMS() - job.startMS ) >= 0 )
+        {
+            unsigned long elapsed = garageDoor.GetStateSinceMS() - job.startMS;
+
+            // The state machine uses this to tell when a moving door
+            // should be done
+            garageDoor.SetTravelTimeMS( elapsed );
+
+            Serial.printf( "Garage door %d takes %lu ms to close\n", door, elapsed );
+
+            finish( door, JOB_DONE, elapsed );
+            continue;
+        }
+
+        job.elapsedMS = nowMS - job.startMS;
+
+        if ( job.elapsedMS >= TIMEOUT_MS )
+        {
+            Serial.printf( "Calibration job %u for garage door %d timed out\n", job.id, door );
+
+            finish( door, JOB_TIMED_OUT, job.elapsedMS );
+        }
+    }
+}
+
+/*======================================================================
+FUNCTION:
+GetJob()
+
+DESCRIPTION:
+Returns the current, or last, job for the door
+
+RETURN VALUE:
+The job.  state is JOB_NONE if there hasn't been one.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+const CalibrationManager::Job &CalibrationManager::GetJob( int door )
+{
+    static Job none = { 0 };
+
+    if ( door < 0 || door >= MAX_DOORS )
+    {
+        return none;
+    }
+
+    return _jobs[door];
+}
+
+/*======================================================================
+FUNCTION:
+GetHistoryCount()
+
+DESCRIPTION:
+Number of finished runs remembered for the door
+
+RETURN VALUE:
+Count.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+int CalibrationManager::GetHistoryCount( int door )
+{
+    if ( door < 0 || door >= MAX_DOORS )
+    {
+        return 0;
+    }
+
+    return _historyCount[door];
+}
+
+/*======================================================================
+FUNCTION:
+GetHistory()
+
+DESCRIPTION:
+Returns one finished run, index 0 is the newest
+
+RETURN VALUE:
+The job.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+const CalibrationManager::Job &CalibrationManager::GetHistory( int door, int index )
+{
+    if ( index < 0 || index >= GetHistoryCount( door ) )
+    {
+        return GetJob( -1 );
+    }
+
+    return _history[door][index];
+}
+
+/*======================================================================
+FUNCTION:
+JobStateToString()
+
+DESCRIPTION:
+Text version of a job state for the status resource
+
+RETURN VALUE:
+Static string.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+const char *CalibrationManager::JobStateToString( JobState state )
+{
+    switch ( state )
+    {
+        case JOB_PENDING:   return "pending";
+        case JOB_RUNNING:   return "running";
+        case JOB_DONE:      return "done";
+        case JOB_TIMED_OUT: return "timedout";
+        default:            return "none";
+    }
+}
+
+/*======================================================================
+FUNCTION:
+finish()
+
+DESCRIPTION:
+Closes out the door's job and records it in the history
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+Writes the history file.
+
+======================================================================*/
+void CalibrationManager::finish( int door, JobState state, unsigned long elapsedMS )
+{
+    Job &job = _jobs[door];
+
+    job.state     = state;
+    job.elapsedMS = elapsedMS;
+
+    remember( door, job );
+
+    saveHistory();
+}
+
+/*======================================================================
+FUNCTION:
+remember()
+
+DESCRIPTION:
+Pushes a finished job onto the front of the door's history, dropping
+the oldest one when it is full.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void CalibrationManager::remember( int door, const Job &job )
+{
+    int count = _historyCount[door];
+
+    if ( count == HISTORY_DEPTH )
+    {
+        count--;
+    }
+
+    for ( int i = count; i > 0; i-- )
+    {
+        _history[door][i] = _history[door][i - 1];
+    }
+
+    _history[door][0] = job;
+    _historyCount[door] = count + 1;
+
+    if ( job.id >= _nextJobId )
+    {
+        _nextJobId = job.id + 1;
+    }
+}
+
+/*======================================================================
+FUNCTION:
+loadHistory()
+
+DESCRIPTION:
+Reads the history file.  Lines we can't make sense of are skipped.
+
+RETURN VALUE:
+true if the file was read.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool CalibrationManager::loadHistory()
+{
+    // Harmless if the file system is already up
+    SPIFFS.begin();
+
+    File historyFile = SPIFFS.open( CALIBRATION_FILENAME, "r" );
+    if ( !historyFile )
+    {
+        // No calibration has ever been run
+        return false;
+    }
+
+    while ( historyFile.available() > 0 )
+    {
+        String line = historyFile.readStringUntil( '\n' );
+
+        int door = 0;
+        int state = 0;
+        Job job = { 0 };
+        long startedUTC = 0;
+
+        if ( sscanf( line.c_str(), "%d,%u,%d,%lu,%ld",
+                     &door, &job.id, &state, &job.elapsedMS, &startedUTC ) != 5 )
+        {
+            continue;
+        }
+
+        if ( door < 0 || door >= MAX_DOORS )
+        {
+            continue;
+        }
+
+        job.state      = (JobState) state;
+        job.startedUTC = startedUTC;
+
+        remember( door, job );
+    }
+
+    historyFile.close();
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+saveHistory()
+
+DESCRIPTION:
+Rewrites the history file, oldest run first so loadHistory() ends up
+with the newest at the front.  It's only a few lines so we don't
+bother appending.
+
+RETURN VALUE:
+true if successful.
+
+SIDE EFFECTS:
+data in the flash file system is modified
+
+======================================================================*/
+bool CalibrationManager::saveHistory()
+{
+    File historyFile = SPIFFS.open( CALIBRATION_FILENAME, "w" );
+    if ( !historyFile )
+    {
+        Serial.printf( "Failed to open %s for writing\n", CALIBRATION_FILENAME );
+
+        return false;
+    }
+
+    for ( int door = 0; door < MAX_DOORS; door++ )
+    {
+        for ( int i = _historyCount[door] - 1; i >= 0; i-- )
+        {
+            const Job &job = _history[door][i];
+
+            historyFile.printf( "%d,%u,%d,%lu,%ld\n",
+                                door, job.id, (int) job.state, job.elapsedMS, (long) job.startedUTC );
+        }
+    }
+
+    historyFile.close();
+
+    return true;
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
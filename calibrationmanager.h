@@ -0,0 +1,262 @@
+#ifndef _GARAGEOMATIC_CALIBRATIONMANAGER_H_
+#define _GARAGEOMATIC_CALIBRATIONMANAGER_H_
+
+/*======================================================================
+FILE:
+calibrationmanager.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Runs garage door calibration as a background job.  A job closes a
+fully open door and times how long it takes the sensor to see it
+closed.  Jobs are stepped from the scheduler, so the web server keeps
+serving (and the doors keep publishing) while one runs.
+
+PUBLIC CLASSES AND FUNCTIONS:
+CalibrationManager
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <stdint.h>
+
+#include <time.h>
+
+#include "garagedoor.h"
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// The finish time comes from the door state machine, which is fed by
+// publish().  Jobs only finish while publish() is being scheduled.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+CalibrationManager
+
+DESCRIPTION:
+Static utility class that owns one calibration job slot per door plus
+a short history of finished runs per door.  The history is kept on the
+flash file system and the last good run sets the door's travel time
+again after a reboot.
+
+HOW TO USE:
+1. Call Begin() with the door collection (after the file system is up).
+2. Call Process() regularly (it is a scheduler task).
+3. Start() kicks off a job, GetJob()/GetHistory() report on it.
+
+======================================================================*/
+class CalibrationManager
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    static const int MAX_DOORS = 4;
+
+    // Finished runs we remember per door
+    static const int HISTORY_DEPTH = 5;
+
+    // Give up if the door hasn't closed by now
+    static const unsigned long TIMEOUT_MS = 60000;
+
+    enum JobState
+    {
+        JOB_NONE = 0,
+
+        // Waiting for the relay to press the opener
+        JOB_PENDING,
+
+        // Door is closing, clock is running
+        JOB_RUNNING,
+
+        JOB_DONE,
+        JOB_TIMED_OUT
+    };
+
+    enum StartResult
+    {
+        START_OK = 0,
+        START_NOT_OPEN,
+        START_ALREADY_RUNNING,
+        START_FAILED
+    };
+
+    struct Job
+    {
+        uint32_t      id;
+        JobState      state;
+
+        // millis() when the relay pulse started
+        unsigned long startMS;
+
+        // How long the door took (or has taken so far)
+        unsigned long elapsedMS;
+
+        // Wall clock time the job was started, 0 if the clock isn't
+        // set yet
+        time_t        startedUTC;
+
+        // Relay pulse count before our press, so we can tell when it
+        // starts
+        uint32_t      pulsesBefore;
+    };
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    // Loads the stored history and applies the last good travel time
+    // to each door
+    static void Begin( GarageDoor::GarageDoorCollection &doors );
+
+    // Starts a calibration job on the door.  jobId is filled in on
+    // START_OK.
+    static StartResult Start( int door, uint32_t &jobId );
+
+    // Steps the running jobs
+    static void Process();
+
+    // The current (or last) job for the door.  state is JOB_NONE if
+    // there hasn't been one since boot.
+    static const Job &GetJob( int door );
+
+    // Finished runs, newest first
+    static int GetHistoryCount( int door );
+    static const Job &GetHistory( int door, int index );
+
+    static const char *JobStateToString( JobState state );
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    // No direct construction by callers. We won't define an
+    // implementation to throw a link error in case someone magically
+    // finds a way to try to directly instantiate this object
+    CalibrationManager();
+
+    static void finish( int door, JobState state, unsigned long elapsedMS );
+
+    // Adds a finished job to the front of the door's history
+    static void remember( int door, const Job &job );
+
+    static bool loadHistory();
+    static bool saveHistory();
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    static GarageDoor::GarageDoorCollection *_doors;
+
+    static Job _jobs[MAX_DOORS];
+
+    static Job _history[MAX_DOORS][HISTORY_DEPTH];
+    static int _historyCount[MAX_DOORS];
+
+    static uint32_t _nextJobId;
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+// None.
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+History file format (/calibration.txt), one finished run per line,
+oldest first:
+
+    door,jobid,state,elapsedms,startedutc
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_CALIBRATIONMANAGER_H_
@@ -0,0 +1,299 @@
+/*======================================================================
+FILE:
+cborwriter.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Minimal CBOR (RFC 7049) encoder that writes into a caller supplied
+buffer.  Just the types our payloads use: unsigned integers, text, 
+arrays, maps and tags.
+
+PUBLIC CLASSES AND FUNCTIONS:
+CborWriter
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+None.
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "cborwriter.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// Major types (top 3 bits of the initial byte)
+static const uint8_t CBOR_UNSIGNED = 0;
+static const uint8_t CBOR_TEXT     = 3;
+static const uint8_t CBOR_ARRAY    = 4;
+static const uint8_t CBOR_MAP      = 5;
+static const uint8_t CBOR_TAG      = 6;
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+CborWriter()
+
+DESCRIPTION:
+C-tor
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+CborWriter::CborWriter( uint8_t *buffer, size_t size )
+    : _buffer( buffer ), _size( size ), _length( 0 ), _overflowed( false )
+{
+}
+
+/*======================================================================
+FUNCTION:
+WriteUnsigned()
+
+DESCRIPTION:
+Writes an unsigned integer
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void CborWriter::WriteUnsigned( uint32_t value )
+{
+    writeHead( CBOR_UNSIGNED, value );
+}
+
+/*======================================================================
+FUNCTION:
+WriteText()
+
+DESCRIPTION:
+Writes a UTF-8 text string
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void CborWriter::WriteText( const char *value )
+{
+    size_t length = strlen( value );
+
+    writeHead( CBOR_TEXT, length );
+    write( (const uint8_t *) value, length );
+}
+
+/*======================================================================
+FUNCTION:
+WriteArray()
+
+DESCRIPTION:
+Starts an array of count items
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void CborWriter::WriteArray( uint32_t count )
+{
+    writeHead( CBOR_ARRAY, count );
+}
+
+/*======================================================================
+FUNCTION:
+WriteMap()
+
+DESCRIPTION:
+Starts a map of count key/value pairs
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void CborWriter::WriteMap( uint32_t count )
+{
+    writeHead( CBOR_MAP, count );
+}
+
+/*======================================================================
+FUNCTION:
+WriteTag()
+
+DESCRIPTION:
+Tags the item written next
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void CborWriter::WriteTag( uint32_t tag )
+{
+    writeHead( CBOR_TAG, tag );
+}
+
+/*======================================================================
+FUNCTION:
+writeHead()
+
+DESCRIPTION:
+Values under 24 fit in the initial byte.  Bigger ones follow it in 1,
+2 or 4 bytes, big endian.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void CborWriter::writeHead( uint8_t majorType, uint32_t value )
+{
+    uint8_t head[5];
+    size_t  length = 0;
+
+    majorType <<= 5;
+
+    if ( value < 24 )
+    {
+        head[length++] = majorType | value;
+    }
+    else if ( value <= 0xFF )
+    {
+        head[length++] = majorType | 24;
+        head[length++] = value;
+    }
+    else if ( value <= 0xFFFF )
+    {
+        head[length++] = majorType | 25;
+        head[length++] = value >> 8;
+        head[length++] = value & 0xFF;
+    }
+    else
+    {
+        head[length++] = majorType | 26;
+        head[length++] = value >> 24;
+        head[length++] = ( value >> 16 ) & 0xFF;
+        head[length++] = ( value >> 8 ) & 0xFF;
+        head[length++] = value & 0xFF;
+    }
+
+    write( head, length );
+}
+
+/*======================================================================
+FUNCTION:
+write()
+
+DESCRIPTION:
+Appends raw bytes, or flags the overflow if they don't fit
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void CborWriter::write( const uint8_t *data, size_t length )
+{
+    if ( true == _overflowed || _length + length > _size )
+    {
+        _overflowed = true;
+        return;
+    }
+
+    memcpy( &_buffer[_length], data, length );
+    _length += length;
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
@@ -0,0 +1,198 @@
+#ifndef _GARAGEOMATIC_CBORWRITER_H_
+#define _GARAGEOMATIC_CBORWRITER_H_
+
+/*======================================================================
+FILE:
+cborwriter.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Minimal CBOR (RFC 7049) encoder that writes into a caller supplied
+buffer.  Just the types our payloads use: unsigned integers, text, 
+arrays, maps and tags.
+
+PUBLIC CLASSES AND FUNCTIONS:
+CborWriter
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <stddef.h>
+#include <stdint.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// Arrays and maps are written with their item count up front, so the
+// caller has to know it before writing the items.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+CborWriter
+
+DESCRIPTION:
+Appends CBOR items to a fixed buffer.  Nothing is allocated.  If an
+item doesn't fit the writer stops writing and Overflowed() says so, 
+so the caller can check once at the end.
+
+HOW TO USE:
+1. Construct over a buffer.
+2. Write the items.
+3. If Overflowed() is false, the first Length() bytes are the document.
+
+======================================================================*/
+class CborWriter
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    // Tag 55799 in front of a document says "this is CBOR"
+    static const uint32_t TAG_SELF_DESCRIBE = 55799;
+
+    // Tag 1: the item is a time in seconds since the epoch
+    static const uint32_t TAG_EPOCH_TIME = 1;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    CborWriter( uint8_t *buffer, size_t size );
+
+    void WriteUnsigned( uint32_t value );
+
+    void WriteText( const char *value );
+
+    void WriteArray( uint32_t count );
+
+    void WriteMap( uint32_t count );
+
+    void WriteTag( uint32_t tag );
+
+    size_t Length() const { return _length; }
+
+    bool Overflowed() const { return _overflowed; }
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    // Writes an item's initial byte plus its argument in the fewest
+    // bytes that hold it
+    void writeHead( uint8_t majorType, uint32_t value );
+
+    void write( const uint8_t *data, size_t length );
+
+    // No copying. Leaving the implementation undefined to cause a link
+    // error
+    CborWriter( const CborWriter &rhs );
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    uint8_t *_buffer;
+    size_t   _size;
+    size_t   _length;
+    bool     _overflowed;
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+// None.
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+None.
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_CBORWRITER_H_
@@ -70,6 +70,12 @@ const char* KEY_MQTT_PUBFEED = "mqttpubfeed";
 const char* KEY_NTP_SERVER   = "ntpserver";
 const char* KEY_DEVICE_USERNAME = "deviceusername";
 const char* KEY_DEVICE_PASSWORD = "devicepassword";
+const char* KEY_MQTT_DOORTOPICS = "mqttdoortopics";
+const char* KEY_MQTT_COMMANDS   = "mqttcommands";
+const char* KEY_MQTT_CBOR       = "mqttcbor";
+const char* KEY_CLOSING_STOPS   = "closingstops";
+const char* KEY_MQTT_USERNAME   = "mqttusername";
+const char* KEY_MQTT_PASSWORD   = "mqttpassword";
 const char* KEY_UNKNOWN = NULL;
 
 // The token that corresponds to the key above. We use the tokens
@@ -82,6 +88,12 @@ const int TOKEN_MQTT_PUBFEED = 4;
 const int TOKEN_NTP_SERVER   = 5;
 const int TOKEN_DEVICE_USERNAME = 6;
 const int TOKEN_DEVICE_PASSWORD = 7;
+const int TOKEN_MQTT_DOORTOPICS = 8;
+const int TOKEN_MQTT_COMMANDS   = 9;
+const int TOKEN_MQTT_CBOR       = 10;
+const int TOKEN_CLOSING_STOPS   = 11;
+const int TOKEN_MQTT_USERNAME   = 12;
+const int TOKEN_MQTT_PASSWORD   = 13;
 const int TOKEN_UNKNOWN      = 99;
 
 const char* DELIMITER  = ":";
@@ -107,6 +119,12 @@ static const char* KEYS[] = {
     KEY_NTP_SERVER,
     KEY_DEVICE_USERNAME,
     KEY_DEVICE_PASSWORD,
+    KEY_MQTT_DOORTOPICS,
+    KEY_MQTT_COMMANDS,
+    KEY_MQTT_CBOR,
+    KEY_CLOSING_STOPS,
+    KEY_MQTT_USERNAME,
+    KEY_MQTT_PASSWORD,
     KEY_UNKNOWN
 };
 
@@ -121,6 +139,12 @@ static const int TOKENS[] = {
     TOKEN_NTP_SERVER,
     TOKEN_DEVICE_USERNAME,
     TOKEN_DEVICE_PASSWORD,
+    TOKEN_MQTT_DOORTOPICS,
+    TOKEN_MQTT_COMMANDS,
+    TOKEN_MQTT_CBOR,
+    TOKEN_CLOSING_STOPS,
+    TOKEN_MQTT_USERNAME,
+    TOKEN_MQTT_PASSWORD,
     TOKEN_UNKNOWN
 };
 
@@ -170,6 +194,12 @@ String Configuration::Serialize() const
     content += makeKeyValue( KEY_NTP_SERVER, _ntpServer );
     content += makeKeyValue( KEY_DEVICE_USERNAME, _deviceUsername );
     content += makeKeyValue( KEY_DEVICE_PASSWORD, _devicePassword );
+    content += makeKeyValue( KEY_MQTT_DOORTOPICS, _mqttDoorTopics ? "1" : "0" );
+    content += makeKeyValue( KEY_MQTT_COMMANDS, _mqttCommands ? "1" : "0" );
+    content += makeKeyValue( KEY_MQTT_CBOR, _mqttCbor ? "1" : "0" );
+    content += makeKeyValue( KEY_CLOSING_STOPS, _closingPressStops ? "1" : "0" );
+    content += makeKeyValue( KEY_MQTT_USERNAME, _mqttUsername );
+    content += makeKeyValue( KEY_MQTT_PASSWORD, _mqttPassword );
 
     Serial.printf( "Config serialization content len: %d\n", content.length() );
 
@@ -266,6 +296,30 @@ Configuration Configuration::Deserialize( const String &content ) const
                 config.SetDevicePassword( pair.value );
                 break;
 
+            case TOKEN_MQTT_DOORTOPICS:
+                config.SetMqttDoorTopics( pair.value );
+                break;
+
+            case TOKEN_MQTT_COMMANDS:
+                config.SetMqttCommands( pair.value );
+                break;
+
+            case TOKEN_MQTT_CBOR:
+                config.SetMqttCbor( pair.value );
+                break;
+
+            case TOKEN_CLOSING_STOPS:
+                config.SetClosingPressStops( pair.value );
+                break;
+
+            case TOKEN_MQTT_USERNAME:
+                config.SetMqttUsername( pair.value );
+                break;
+
+            case TOKEN_MQTT_PASSWORD:
+                config.SetMqttPassword( pair.value );
+                break;
+
             case TOKEN_UNKNOWN:
 
                 // Might be at the end
@@ -142,6 +142,37 @@ class Configuration
     void SetMqttPubFeed( const String &value ) { _mqttPubFeed = value; }
     String GetMqttPubFeed() const { return _mqttPubFeed; }
 
+    // Broker login.  Empty username means the broker doesn't need one.
+    void SetMqttUsername( const String &value ) { _mqttUsername = value; }
+    String GetMqttUsername() const { return _mqttUsername; }
+
+    void SetMqttPassword( const String &value ) { _mqttPassword = value; }
+    String GetMqttPassword() const { return _mqttPassword; }
+
+    // Also publish each door's state to its own retained topics
+    // under the feed
+    void SetMqttDoorTopics( const String &value ) { _mqttDoorTopics = ( atoi( value.c_str() ) != 0 ); }
+    void SetMqttDoorTopics( bool value ) { _mqttDoorTopics = value; }
+    bool GetMqttDoorTopics() const { return _mqttDoorTopics; }
+
+    // Take door commands from the broker.  Off unless asked for, 
+    // since anyone who can publish to the broker can then open the
+    // doors.  Only honored with a broker login (SetMqttUsername()).
+    void SetMqttCommands( const String &value ) { _mqttCommands = ( atoi( value.c_str() ) != 0 ); }
+    void SetMqttCommands( bool value ) { _mqttCommands = value; }
+    bool GetMqttCommands() const { return _mqttCommands; }
+
+    // Publish the all doors document as CBOR instead of JSON
+    void SetMqttCbor( const String &value ) { _mqttCbor = ( atoi( value.c_str() ) != 0 ); }
+    void SetMqttCbor( bool value ) { _mqttCbor = value; }
+    bool GetMqttCbor() const { return _mqttCbor; }
+
+    // Set if the opener stops a closing door when pressed instead of
+    // reversing it
+    void SetClosingPressStops( const String &value ) { _closingPressStops = ( atoi( value.c_str() ) != 0 ); }
+    void SetClosingPressStops( bool value ) { _closingPressStops = value; }
+    bool GetClosingPressStops() const { return _closingPressStops; }
+
     void SetNtpServer( const String &value ) { _ntpServer = value; }
     String GetNtpServer() const { return _ntpServer; }
 
@@ -188,6 +219,12 @@ class Configuration
     String _mqttServer;
     int    _mqttPort;
     String _mqttPubFeed;
+    String _mqttUsername;
+    String _mqttPassword;
+    bool   _mqttDoorTopics = false;
+    bool   _mqttCommands = false;
+    bool   _mqttCbor = false;
+    bool   _closingPressStops = false;
     String _ntpServer;
 
     String _deviceUsername;
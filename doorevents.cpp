@@ -0,0 +1,586 @@
+/*======================================================================
+FILE:
+doorevents.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Pushes door state changes to web clients as they happen, either as a
+Server-Sent Events stream or by answering a long poll.
+
+PUBLIC CLASSES AND FUNCTIONS:
+DoorEventStream
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+Begin() before handing over any connections.
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "doorevents.h"
+
+#include "Arduino.h"
+
+#include "jsonwriter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// The response headers, plus how long a browser should wait before it
+// reconnects a dropped stream
+static const char STREAM_PREAMBLE[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "retry: 5000\n\n";
+
+static const char HEARTBEAT[] = ": heartbeat\n\n";
+
+// id, event and data lines for one door
+static const size_t EVENT_SIZE = 160;
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+DoorEventStream()
+
+DESCRIPTION:
+C-tor
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+DoorEventStream::DoorEventStream( GarageDoor::GarageDoorCollection &doors, HttpResponse &response )
+    : _doors( doors ), _response( response ), _sentVersion( 0 ), _lastHeartbeatMS( 0 )
+{
+    for ( int i = 0; i < MAX_WAITERS; i++ )
+    {
+        _waiters[i].inUse = false;
+    }
+}
+
+/*======================================================================
+FUNCTION:
+Begin()
+
+DESCRIPTION:
+Sets the function that builds the doors document response for the 
+long polls
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void DoorEventStream::Begin( RenderFunction render )
+{
+    _render = render;
+
+    _sentVersion     = GarageDoor::GetLatestStateVersion();
+    _lastHeartbeatMS = millis();
+}
+
+/*======================================================================
+FUNCTION:
+Subscribe()
+
+DESCRIPTION:
+Sends the stream headers and every door's current state, then keeps
+the connection for the events that follow.
+
+RETURN VALUE:
+false if there was no free stream.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool DoorEventStream::Subscribe( WiFiClient client )
+{
+    int slot = -1;
+
+    for ( int i = 0; i < MAX_STREAMS && slot < 0; i++ )
+    {
+        if ( _streams[i].connected() == false )
+        {
+            slot = i;
+        }
+    }
+
+    if ( slot < 0 )
+    {
+        refuse( client );
+        return false;
+    }
+
+    _streams[slot] = client;
+
+    // Events go out as soon as they are written
+    _streams[slot].setNoDelay( true );
+
+    setWriteTimeout( _streams[slot] );
+
+    sendToStream( slot, STREAM_PREAMBLE, sizeof( STREAM_PREAMBLE ) - 1 );
+
+    char event[EVENT_SIZE];
+
+    for ( int i = 0; i < _doors.size() && _streams[slot].connected() == true; i++ )
+    {
+        size_t length = formatDoorEvent( _doors[i], i, event, sizeof( event ) );
+
+        if ( length > 0 )
+        {
+            sendToStream( slot, event, length );
+        }
+    }
+
+    Serial.printf( "DoorEventStream: stream %d started\n", slot );
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+Wait()
+
+DESCRIPTION:
+Parks a long poll until the state version moves or it times out.  
+Process() answers it.
+
+RETURN VALUE:
+false if there was no free slot.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool DoorEventStream::Wait( WiFiClient client, uint32_t since, unsigned long timeoutS )
+{
+    if ( timeoutS > MAX_WAIT_S )
+    {
+        timeoutS = MAX_WAIT_S;
+    }
+
+    for ( int i = 0; i < MAX_WAITERS; i++ )
+    {
+        Waiter &waiter = _waiters[i];
+
+        if ( waiter.inUse == false )
+        {
+            waiter.client    = client;
+            waiter.since     = since;
+            waiter.startMS   = millis();
+            waiter.timeoutMS = timeoutS * 1000;
+            waiter.inUse     = true;
+
+            setWriteTimeout( waiter.client );
+
+            return true;
+        }
+    }
+
+    refuse( client );
+
+    return false;
+}
+
+/*======================================================================
+FUNCTION:
+Process()
+
+DESCRIPTION:
+Answers the waiters whose version moved (or whose time ran out), 
+sends any door that changed since the last pass to the streams, and
+sends the heartbeat when it is due.  The version checks are cheap, so
+this is fine to call on every web server pass.
+
+A waiter's version that is ahead of ours means we rebooted and the 
+versions started over, so that counts as a change too.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void DoorEventStream::Process()
+{
+    uint32_t latest = GarageDoor::GetLatestStateVersion();
+
+    unsigned long nowMS = millis();
+
+    for ( int i = 0; i < MAX_WAITERS; i++ )
+    {
+        Waiter &waiter = _waiters[i];
+
+        if ( waiter.inUse == false )
+        {
+            continue;
+        }
+
+        if ( waiter.client.connected() == false )
+        {
+            waiter.client = WiFiClient();
+            waiter.inUse  = false;
+        }
+        else if ( latest != waiter.since )
+        {
+            answer( waiter, true );
+        }
+        else if ( nowMS - waiter.startMS >= waiter.timeoutMS )
+        {
+            answer( waiter, false );
+        }
+    }
+
+    if ( latest != _sentVersion )
+    {
+        for ( int i = 0; i < _doors.size(); i++ )
+        {
+            if ( _doors[i].GetStateVersion() > _sentVersion )
+            {
+                sendDoorEvent( i );
+            }
+        }
+
+        _sentVersion = latest;
+    }
+
+    if ( nowMS - _lastHeartbeatMS >= HEARTBEAT_MS )
+    {
+        _lastHeartbeatMS = nowMS;
+
+        for ( int i = 0; i < MAX_STREAMS; i++ )
+        {
+            if ( _streams[i].connected() == true )
+            {
+                sendToStream( i, HEARTBEAT, sizeof( HEARTBEAT ) - 1 );
+            }
+            else
+            {
+                // Let go of connections the client closed
+                _streams[i] = WiFiClient();
+            }
+        }
+    }
+}
+
+/*======================================================================
+FUNCTION:
+GetStreamCount()
+
+DESCRIPTION:
+Number of open event streams
+
+RETURN VALUE:
+Count.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+int DoorEventStream::GetStreamCount()
+{
+    int count = 0;
+
+    for ( int i = 0; i < MAX_STREAMS; i++ )
+    {
+        if ( _streams[i].connected() == true )
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/*======================================================================
+FUNCTION:
+sendDoorEvent()
+
+DESCRIPTION:
+Formats the door's event once and writes it to every open stream
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void DoorEventStream::sendDoorEvent( int door )
+{
+    char event[EVENT_SIZE];
+
+    size_t length = 0;
+
+    for ( int i = 0; i < MAX_STREAMS; i++ )
+    {
+        if ( _streams[i].connected() == false )
+        {
+            continue;
+        }
+
+        if ( length == 0 )
+        {
+            length = formatDoorEvent( _doors[door], door, event, sizeof( event ) );
+
+            if ( length == 0 )
+            {
+                return;
+            }
+        }
+
+        sendToStream( i, event, length );
+    }
+}
+
+/*======================================================================
+FUNCTION:
+sendToStream()
+
+DESCRIPTION:
+Writes to one stream.  A stream that doesn't have room in its send
+buffer for the whole write (it has stopped reading), or that still 
+comes up short, is closed; the browser reconnects and gets the 
+current state again.  Half an event would garble the stream anyway.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void DoorEventStream::sendToStream( int slot, const char *text, size_t length )
+{
+    WiFiClient &client = _streams[slot];
+
+    if ( (size_t) client.availableForWrite() < length ||
+         client.write( (const uint8_t *) text, length ) != length )
+    {
+        Serial.printf( "DoorEventStream: stream %d dropped\n", slot );
+
+        client.stop();
+        client = WiFiClient();
+    }
+}
+
+/*======================================================================
+FUNCTION:
+answer()
+
+DESCRIPTION:
+Sends a waiter the doors document (changed) or a 304 (timed out) and
+closes the connection.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+Overwrites the shared response buffer.
+
+======================================================================*/
+void DoorEventStream::answer( Waiter &waiter, bool changed )
+{
+    if ( true == changed && _render )
+    {
+        _render( _response );
+    }
+    else
+    {
+        _response.Begin( 304, "application/json" );
+    }
+
+    if ( _response.Send( waiter.client ) == false )
+    {
+        Serial.println( "DoorEventStream: long poll answer dropped" );
+    }
+
+    waiter.client.stop();
+    waiter.client = WiFiClient();
+    waiter.inUse  = false;
+}
+
+/*======================================================================
+FUNCTION:
+refuse()
+
+DESCRIPTION:
+Turns a connection away when all the slots are taken
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+Overwrites the shared response buffer.
+
+======================================================================*/
+void DoorEventStream::refuse( WiFiClient &client )
+{
+    setWriteTimeout( client );
+
+    _response.Begin( 503, "text/plain" );
+    _response.print( "too many event clients, try again" );
+    _response.Send( client );
+
+    client.stop();
+}
+
+/*======================================================================
+FUNCTION:
+setWriteTimeout()
+
+DESCRIPTION:
+Keeps a stalled client from holding up the main loop.  A write that 
+can't finish in WRITE_TIMEOUT_MS comes back short and the caller 
+drops the connection.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void DoorEventStream::setWriteTimeout( WiFiClient &client )
+{
+    client.setTimeout( WRITE_TIMEOUT_MS );
+}
+
+/*======================================================================
+FUNCTION:
+formatDoorEvent()
+
+DESCRIPTION:
+Formats one door's state as an event, with the door's state version
+as the event id
+
+RETURN VALUE:
+Length, 0 if it didn't fit.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+size_t DoorEventStream::formatDoorEvent( const GarageDoor &door, int doornum, char *buffer, size_t size )
+{
+    int header = snprintf( buffer, size, "id: %lu\nevent: door\ndata: ", (unsigned long) door.GetStateVersion() );
+
+    if ( header < 0 || (size_t) header >= size )
+    {
+        return 0;
+    }
+
+    JsonWriter writer( buffer + header, size - header );
+
+    writer.BeginObject();
+    writer.Key( "door" );
+    writer.Value( doornum );
+    writer.Key( "state" );
+    writer.Value( GarageDoor::StateToString( door.State() ) );
+    writer.Key( "stateAgeMS" );
+    writer.Value( door.GetTimeInStateMS() );
+    writer.Key( "stateVersion" );
+    writer.Value( door.GetStateVersion() );
+    writer.EndObject();
+
+    size_t length = header + writer.Length();
+
+    // Room for the blank line and the NUL
+    if ( writer.Overflowed() == true || length + 3 > size )
+    {
+        return 0;
+    }
+
+    buffer[length++] = '\n';
+    buffer[length++] = '\n';
+    buffer[length]   = '\0';
+
+    return length;
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
@@ -0,0 +1,269 @@
+#ifndef _GARAGEOMATIC_DOOREVENTS_H_
+#define _GARAGEOMATIC_DOOREVENTS_H_
+
+/*======================================================================
+FILE:
+doorevents.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Pushes door state changes to web clients as they happen, either as a
+Server-Sent Events stream or by answering a long poll.
+
+PUBLIC CLASSES AND FUNCTIONS:
+DoorEventStream
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <WiFiClient.h>
+#include <Print.h>
+
+#include <stdint.h>
+
+#include <functional>
+
+#include "garagedoor.h"
+
+#include "httpresponse.h"
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// The connections handed to Subscribe() and Wait() must already be 
+// detached from the web server.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+DoorEventStream
+
+DESCRIPTION:
+Holds on to web connections that are waiting for door changes, 
+outside the web server (which only serves one connection at a time).
+
+Streams get every door's state when they connect, then an event each
+time a door changes and a comment line every so often so proxies and
+dead connections come to light.  Waiters (long polls) get the full 
+doors document as soon as the latest state version passes the one 
+they already have, or a 304 once their timeout runs out.
+
+Changes are found by comparing door state versions, so nothing has to
+tell us about them.
+
+HOW TO USE:
+1. Call Begin() with the function that writes the doors document.
+2. Subscribe() or Wait() the connections from the web handler.
+3. Call Process() often (it runs with the web server).
+
+======================================================================*/
+class DoorEventStream
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    // Builds the doors document response (status line, headers and
+    // body) in the response it is given
+    typedef std::function<void( HttpResponse &response )> RenderFunction;
+
+    static const int MAX_STREAMS = 4;
+    static const int MAX_WAITERS = 4;
+
+    static const unsigned long HEARTBEAT_MS = 15000;
+
+    // How long a write to a detached connection may block.  These are
+    // written from the main loop, so a stalled client can't be 
+    // allowed the usual second.
+    static const unsigned long WRITE_TIMEOUT_MS = 200;
+
+    // Long poll timeouts, in seconds
+    static const unsigned long DEFAULT_WAIT_S = 30;
+    static const unsigned long MAX_WAIT_S = 120;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    // Long poll responses are built in the web server's response
+    // buffer
+    DoorEventStream( GarageDoor::GarageDoorCollection &doors, HttpResponse &response );
+
+    void Begin( RenderFunction render );
+
+    // Starts an event stream on the connection.  false (after sending
+    // a 503) if all the streams are taken.
+    bool Subscribe( WiFiClient client );
+
+    // Answers the connection once the latest state version is past
+    // since, or after timeoutS seconds.  false (after sending a 503)
+    // if all the waiter slots are taken.
+    bool Wait( WiFiClient client, uint32_t since, unsigned long timeoutS );
+
+    // Sends changes and heartbeats, answers waiters and drops closed
+    // connections
+    void Process();
+
+    // connected() isn't const, so neither is this
+    int GetStreamCount();
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    struct Waiter
+    {
+        WiFiClient    client;
+        uint32_t      since;
+        unsigned long startMS;
+        unsigned long timeoutMS;
+        bool          inUse;
+    };
+
+    // Writes one door's event to every stream
+    void sendDoorEvent( int door );
+
+    // Writes to one stream, closes it if it can't take the whole write
+    void sendToStream( int slot, const char *text, size_t length );
+
+    // Sends the waiter its response and closes the connection
+    void answer( Waiter &waiter, bool changed );
+
+    void refuse( WiFiClient &client );
+
+    static void setWriteTimeout( WiFiClient &client );
+
+    static size_t formatDoorEvent( const GarageDoor &door, int doornum, char *buffer, size_t size );
+
+    // No copying. Leaving the implementation undefined to cause a link
+    // error
+    DoorEventStream( const DoorEventStream &rhs );
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    GarageDoor::GarageDoorCollection &_doors;
+
+    HttpResponse &_response;
+
+    RenderFunction _render;
+
+    WiFiClient _streams[MAX_STREAMS];
+
+    Waiter _waiters[MAX_WAITERS];
+
+    // The latest state version the streams have been sent
+    uint32_t _sentVersion;
+
+    unsigned long _lastHeartbeatMS;
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+// None.
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+A stream looks like this on the wire (after the response headers):
+
+    retry: 5000
+
+    id: 12
+    event: door
+    data: {"door":0,"state":"opening","stateAgeMS":0,"stateVersion":12}
+
+    : heartbeat
+
+The id is the door's state version.
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_DOOREVENTS_H_
@@ -0,0 +1,197 @@
+/*======================================================================
+FILE:
+doorinputsnapshot.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Captures the level of every door sensor at one instant.  The GPIO
+input register is read once and each door's bit is pulled out with a
+precomputed mask, so checking any number of doors costs the same as
+checking one, and everything that looks at the doors during a loop
+pass sees the same values.
+
+PUBLIC CLASSES AND FUNCTIONS:
+DoorInputSnapshot
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+SetLayout() must be called before the masks are used.
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "doorinputsnapshot.h"
+
+#include "doorsensormonitor.h"
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+uint32_t DoorInputSnapshot::_doorMasks[DoorInputSnapshot::MAX_DOORS] = { 0 };
+
+bool DoorInputSnapshot::_readGpio16 = false;
+
+DoorInputSnapshot DoorInputSnapshot::_current;
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+SetLayout()
+
+DESCRIPTION:
+Precomputes the register mask for each door's sensor pin.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void DoorInputSnapshot::SetLayout( const GarageDoor::GarageDoorCollection &doors )
+{
+    const int GPIO16 = 16;
+
+    _readGpio16 = false;
+
+    for ( int i = 0; i < MAX_DOORS; i++ )
+    {
+        _doorMasks[i] = 0;
+
+        if ( i >= doors.size() )
+        {
+            continue;
+        }
+
+        int pin = doors[i].GetSensorPin();
+
+        _doorMasks[i] = ( 1UL << pin );
+
+        if ( pin == GPIO16 )
+        {
+            _readGpio16 = true;
+        }
+    }
+}
+
+/*======================================================================
+FUNCTION:
+CaptureRaw()
+
+DESCRIPTION:
+Reads the GPIO input register (GPIO0-15) and, only if a door needs
+it, the GPIO16 register.  This is kept in IRAM because the sensor
+sampling timer calls it from interrupt context.
+
+RETURN VALUE:
+Snapshot of the raw pin levels
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+DoorInputSnapshot ICACHE_RAM_ATTR DoorInputSnapshot::CaptureRaw()
+{
+    uint32_t levels = GPI;
+
+    if ( _readGpio16 == true )
+    {
+        levels |= ( GP16I & 0x01 ) << 16;
+    }
+
+    return DoorInputSnapshot( levels );
+}
+
+/*======================================================================
+FUNCTION:
+Refresh()
+
+DESCRIPTION:
+Takes the shared snapshot for this loop pass.  The levels come from
+the debounced sensor filter, which keeps them in the same register
+layout, so this is a single word copy.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void DoorInputSnapshot::Refresh()
+{
+    _current = DoorInputSnapshot( DoorSensorMonitor::GetDebouncedLevels() );
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
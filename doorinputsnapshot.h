@@ -0,0 +1,231 @@
+#ifndef _GARAGEOMATIC_DOORINPUTSNAPSHOT_H_
+#define _GARAGEOMATIC_DOORINPUTSNAPSHOT_H_
+
+/*======================================================================
+FILE:
+doorinputsnapshot.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Captures the level of every door sensor at one instant.  The GPIO
+input register is read once and each door's bit is pulled out with a
+precomputed mask, so checking any number of doors costs the same as
+checking one, and everything that looks at the doors during a loop
+pass sees the same values.
+
+PUBLIC CLASSES AND FUNCTIONS:
+DoorInputSnapshot
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <stdint.h>
+
+#include <Arduino.h>
+
+#include "garagedoor.h"
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// None.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+DoorInputSnapshot
+
+DESCRIPTION:
+Captures the level of every door sensor at one instant.  The GPIO
+input register is read once and each door's bit is pulled out with a
+precomputed mask, so checking any number of doors costs the same as
+checking one, and everything that looks at the doors during a loop
+pass sees the same values.
+
+HOW TO USE:
+1. Call SetLayout() once with the door collection to build the masks.
+2. Call Refresh() at the top of each loop pass.
+3. Anything that needs door state reads Current() (GarageDoor::Status()
+does this for you).
+4. CaptureRaw() reads the register directly, undebounced.
+
+======================================================================*/
+class DoorInputSnapshot
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    static const int MAX_DOORS = 4;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    // Levels are laid out like the GPIO input register: bit N is pin N
+    explicit DoorInputSnapshot( uint32_t levels = 0 ) : _levels( levels ) {}
+
+    // Builds the per-door masks from the doors' sensor pins
+    static void SetLayout( const GarageDoor::GarageDoorCollection &doors );
+
+    // One read of the GPIO input register(s).  Safe to call from an
+    // interrupt.
+    static DoorInputSnapshot CaptureRaw();
+
+    // Takes the shared snapshot for this loop pass from the debounced
+    // sensor levels
+    static void Refresh();
+
+    static const DoorInputSnapshot &Current() { return _current; }
+
+    static uint32_t GetDoorMask( int door );
+
+    int Level( int door ) const;
+    int LevelForPin( int pin ) const;
+
+    GarageDoor::DoorStatus Status( int door ) const;
+    GarageDoor::DoorStatus StatusForPin( int pin ) const;
+
+    uint32_t GetLevels() const { return _levels; }
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    uint32_t _levels;
+
+    static uint32_t _doorMasks[MAX_DOORS];
+
+    // GPIO16 lives in its own register, so only read it if we need to
+    static bool _readGpio16;
+
+    static DoorInputSnapshot _current;
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+inline uint32_t DoorInputSnapshot::GetDoorMask( int door )
+{
+    return ( door >= 0 && door < MAX_DOORS ) ? _doorMasks[door] : 0;
+}
+
+inline int DoorInputSnapshot::Level( int door ) const
+{
+    return ( _levels & GetDoorMask( door ) ) ? HIGH : LOW;
+}
+
+inline int DoorInputSnapshot::LevelForPin( int pin ) const
+{
+    return ( _levels & ( 1UL << pin ) ) ? HIGH : LOW;
+}
+
+inline GarageDoor::DoorStatus DoorInputSnapshot::Status( int door ) const
+{
+    return GarageDoor::StatusFromLevel( Level( door ) );
+}
+
+inline GarageDoor::DoorStatus DoorInputSnapshot::StatusForPin( int pin ) const
+{
+    return GarageDoor::StatusFromLevel( LevelForPin( pin ) );
+}
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+None.
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_DOORINPUTSNAPSHOT_H_
@@ -0,0 +1,415 @@
+/*======================================================================
+FILE:
+doorsensormonitor.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Watches the garage door sensor pins.  A hardware timer samples the
+sensors at a fixed rate and runs each one through an integrator to
+filter out reed switch bounce and motor EMI.  Each debounced change is
+timestamped and pushed into a small lock-free queue that the main loop
+drains, so the loop only does work when a door actually changes.
+
+PUBLIC CLASSES AND FUNCTIONS:
+DoorEventQueue
+DoorSensorMonitor
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+The GarageDoor objects must be constructed before Begin() is called.
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "doorsensormonitor.h"
+
+#include "doorinputsnapshot.h"
+
+#include "Arduino.h"
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+uint32_t DoorSensorMonitor::_masks[DoorSensorMonitor::MAX_DOORS] = { 0 };
+
+int DoorSensorMonitor::_doorCount = 0;
+
+DoorEventQueue DoorSensorMonitor::_queue;
+
+volatile uint8_t DoorSensorMonitor::_integrators[DoorSensorMonitor::MAX_DOORS] = { 0 };
+
+volatile uint32_t DoorSensorMonitor::_debouncedLevels = 0;
+
+volatile uint32_t DoorSensorMonitor::_rawTransitions[DoorSensorMonitor::MAX_DOORS] = { 0 };
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+DoorEventQueue()
+
+DESCRIPTION:
+C-tor
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+DoorEventQueue::DoorEventQueue() : _head( 0 ), _tail( 0 ), _overflows( 0 )
+{
+}
+
+/*======================================================================
+FUNCTION:
+Push()
+
+DESCRIPTION:
+Adds an event to the queue.  This runs in interrupt context, so it is
+kept in IRAM and only touches the producer index.
+
+RETURN VALUE:
+true if the event was queued, false if the queue was full.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool ICACHE_RAM_ATTR DoorEventQueue::Push( const DoorEvent &event )
+{
+    uint8_t head = _head;
+    uint8_t next = ( head + 1 ) & ( CAPACITY - 1 );
+
+    if ( next == _tail )
+    {
+        _overflows++;
+        return false;
+    }
+
+    _events[head] = event;
+
+    // Make sure the event is written before the consumer can see it
+    __sync_synchronize();
+
+    _head = next;
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+Pop()
+
+DESCRIPTION:
+Removes the oldest event from the queue.  Only called from the
+main loop.
+
+RETURN VALUE:
+true if an event was returned, false if the queue was empty.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool DoorEventQueue::Pop( DoorEvent &event )
+{
+    uint8_t tail = _tail;
+
+    if ( tail == _head )
+    {
+        return false;
+    }
+
+    event = _events[tail];
+
+    __sync_synchronize();
+
+    _tail = ( tail + 1 ) & ( CAPACITY - 1 );
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+Begin()
+
+DESCRIPTION:
+Sets up the snapshot masks, then seeds each door's integrator from the
+current level so we don't report a change at startup.  Then attaches
+a CHANGE interrupt to each pin (to count raw edges) and starts the
+timer1 sampling.  The pins were already configured as inputs when the
+GarageDoor objects were constructed.
+
+RETURN VALUE:
+true if every door is being monitored.
+
+SIDE EFFECTS:
+Takes over hardware timer1.
+
+======================================================================*/
+bool DoorSensorMonitor::Begin( const GarageDoor::GarageDoorCollection &doors )
+{
+    typedef void ( *IsrHandler )();
+
+    static const IsrHandler HANDLERS[MAX_DOORS] = {
+        &DoorSensorMonitor::isrDoor0,
+        &DoorSensorMonitor::isrDoor1,
+        &DoorSensorMonitor::isrDoor2,
+        &DoorSensorMonitor::isrDoor3
+    };
+
+    // timer1 at 80MHz / 16 runs 5 ticks per microsecond
+    const uint32_t TICKS_PER_US = 5;
+
+    bool result = true;
+
+    DoorInputSnapshot::SetLayout( doors );
+
+    uint32_t raw = DoorInputSnapshot::CaptureRaw().GetLevels();
+
+    uint32_t debounced = 0;
+
+    _doorCount = 0;
+
+    for ( int i = 0; i < doors.size(); i++ )
+    {
+        if ( i >= MAX_DOORS )
+        {
+            Serial.printf( "DoorSensorMonitor: door %d cannot be monitored\n", i );
+            result = false;
+            break;
+        }
+
+        _masks[i] = DoorInputSnapshot::GetDoorMask( i );
+        _rawTransitions[i] = 0;
+
+        if ( ( raw & _masks[i] ) != 0 )
+        {
+            _integrators[i] = INTEGRATOR_MAX;
+            debounced |= _masks[i];
+        }
+        else
+        {
+            _integrators[i] = 0;
+        }
+
+        _doorCount++;
+
+        int pin = doors[i].GetSensorPin();
+
+        attachInterrupt( digitalPinToInterrupt( pin ), HANDLERS[i], CHANGE );
+    }
+
+    _debouncedLevels = debounced;
+
+    timer1_isr_init();
+    timer1_attachInterrupt( &DoorSensorMonitor::sample );
+    timer1_enable( TIM_DIV16, TIM_EDGE, TIM_LOOP );
+    timer1_write( SAMPLE_PERIOD_US * TICKS_PER_US );
+
+    return result;
+}
+
+/*======================================================================
+FUNCTION:
+Poll()
+
+DESCRIPTION:
+Pops the next debounced change off the queue.
+
+RETURN VALUE:
+true if an event was returned.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool DoorSensorMonitor::Poll( DoorEvent &event )
+{
+    return _queue.Pop( event );
+}
+
+/*======================================================================
+FUNCTION:
+GetRawTransitionCount()
+
+DESCRIPTION:
+Returns how many raw edges the door's sensor has produced.  Comparing
+this against the debounced changes shows how noisy a switch is.
+
+RETURN VALUE:
+Raw edge count, 0 for an unknown door.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+uint32_t DoorSensorMonitor::GetRawTransitionCount( int door )
+{
+    if ( door < 0 || door >= _doorCount )
+    {
+        return 0;
+    }
+
+    return _rawTransitions[door];
+}
+
+/*======================================================================
+FUNCTION:
+isrDoor0() .. isrDoor3()
+
+DESCRIPTION:
+Per-door edge interrupt handlers.  These only count raw transitions;
+the filtering happens in sample().
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void ICACHE_RAM_ATTR DoorSensorMonitor::isrDoor0() { _rawTransitions[0]++; }
+void ICACHE_RAM_ATTR DoorSensorMonitor::isrDoor1() { _rawTransitions[1]++; }
+void ICACHE_RAM_ATTR DoorSensorMonitor::isrDoor2() { _rawTransitions[2]++; }
+void ICACHE_RAM_ATTR DoorSensorMonitor::isrDoor3() { _rawTransitions[3]++; }
+
+/*======================================================================
+FUNCTION:
+sample()
+
+DESCRIPTION:
+Timer interrupt.  Reads every sensor with one register read and steps
+each door's integrator one count toward its raw level.  When an
+integrator hits an end stop that differs from the debounced level, the
+debounced level flips and a timestamped event is queued for the main
+loop.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void ICACHE_RAM_ATTR DoorSensorMonitor::sample()
+{
+    uint32_t raw = DoorInputSnapshot::CaptureRaw().GetLevels();
+
+    for ( int i = 0; i < _doorCount; i++ )
+    {
+        uint32_t mask = _masks[i];
+
+        if ( ( raw & mask ) != 0 )
+        {
+            if ( _integrators[i] < INTEGRATOR_MAX )
+            {
+                _integrators[i]++;
+            }
+        }
+        else if ( _integrators[i] > 0 )
+        {
+            _integrators[i]--;
+        }
+
+        uint8_t level;
+
+        if ( _integrators[i] == INTEGRATOR_MAX && ( _debouncedLevels & mask ) == 0 )
+        {
+            _debouncedLevels |= mask;
+            level = HIGH;
+        }
+        else if ( _integrators[i] == 0 && ( _debouncedLevels & mask ) != 0 )
+        {
+            _debouncedLevels &= ~mask;
+            level = LOW;
+        }
+        else
+        {
+            // No change
+            continue;
+        }
+
+        DoorEvent event;
+
+        event.door        = i;
+        event.level       = level;
+        event.timestampMS = millis();
+
+        _queue.Push( event );
+    }
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
@@ -0,0 +1,321 @@
+#ifndef _GARAGEOMATIC_DOORSENSORMONITOR_H_
+#define _GARAGEOMATIC_DOORSENSORMONITOR_H_
+
+/*======================================================================
+FILE:
+doorsensormonitor.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Watches the garage door sensor pins.  A hardware timer samples the
+sensors at a fixed rate and runs each one through an integrator to
+filter out reed switch bounce and motor EMI.  Each debounced change is
+timestamped and pushed into a small lock-free queue that the main loop
+drains, so the loop only does work when a door actually changes.
+
+PUBLIC CLASSES AND FUNCTIONS:
+DoorEvent
+DoorEventQueue
+DoorSensorMonitor
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <stdint.h>
+
+#include "garagedoor.h"
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// A single sensor edge
+struct DoorEvent
+{
+    // Index of the door in the garage door collection
+    uint8_t door;
+
+    // The debounced sensor GPIO level after the change
+    uint8_t level;
+
+    // millis() when the change was accepted
+    uint32_t timestampMS;
+};
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// The interrupt handlers run in IRAM with interrupts disabled.  Don't
+// add anything to them that touches flash, the heap or Serial.
+
+// Sampling uses hardware timer1, so analogWrite()/tone() can't be used
+// alongside this.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+DoorEventQueue
+
+DESCRIPTION:
+Fixed-size single-producer/single-consumer ring of door events.  The
+producer is the sampling timer interrupt and the consumer is the main
+loop.  Each side only ever writes its own index, so no locking is
+needed.
+
+HOW TO USE:
+Push() from the interrupt handler, Pop() from the main loop.
+
+======================================================================*/
+class DoorEventQueue
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    // Must be a power of 2 so the index wraps with a mask
+    static const uint8_t CAPACITY = 16;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    DoorEventQueue();
+
+    // Called from interrupt context.  Returns false (and counts an
+    // overflow) if the queue is full.
+    bool Push( const DoorEvent &event );
+
+    // Called from the main loop. Returns false if the queue is empty.
+    bool Pop( DoorEvent &event );
+
+    // Number of events dropped because the queue was full
+    uint32_t GetOverflowCount() const { return _overflows; }
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    // No copying. Leaving the implementation undefined to cause a link
+    // error
+    DoorEventQueue( const DoorEventQueue &rhs );
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    DoorEvent _events[CAPACITY];
+
+    // _head is only written by the producer, _tail only by the consumer
+    volatile uint8_t _head;
+    volatile uint8_t _tail;
+
+    volatile uint32_t _overflows;
+};
+
+/*======================================================================
+CLASS:
+DoorSensorMonitor
+
+DESCRIPTION:
+Samples the garage door sensor pins from a hardware timer and filters
+each one with an integrator.  The integrator steps one count toward
+the raw level on every sample and the debounced level only flips when
+it reaches an end stop, so a burst of bounces collapses into a single
+change.  Pin change interrupts count the raw edges so a noisy switch
+can be spotted.
+
+HOW TO USE:
+1. Construct the garage doors (this sets up the GPIO pins).
+2. Call Begin() with the door collection to start sampling.
+3. Call Poll() from the main loop until it returns false.
+4. GetDebouncedLevels() returns the filtered sensor levels at any time.
+
+======================================================================*/
+class DoorSensorMonitor
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    // One edge interrupt handler per door, so this is a hard limit
+    static const int MAX_DOORS = 4;
+
+    // How often the timer samples the sensors
+    static const uint32_t SAMPLE_PERIOD_US = 5000;
+
+    // A change has to hold for INTEGRATOR_MAX samples (40ms) before
+    // the debounced level follows it
+    static const uint8_t INTEGRATOR_MAX = 8;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    // Seeds the filter from the current sensor levels, then starts
+    // the sampling timer and the edge counters
+    static bool Begin( const GarageDoor::GarageDoorCollection &doors );
+
+    // Pops the next debounced change.  Returns false if there are none.
+    static bool Poll( DoorEvent &event );
+
+    // The debounced sensor levels, laid out like the GPIO input
+    // register (bit N is pin N) so DoorInputSnapshot can use them
+    static uint32_t GetDebouncedLevels() { return _debouncedLevels; }
+
+    // Number of raw edges seen on the door's sensor, bounces included
+    static uint32_t GetRawTransitionCount( int door );
+
+    // If this changes then edges were lost and the caller should
+    // re-read the sensors
+    static uint32_t GetOverflowCount() { return _queue.GetOverflowCount(); }
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    // No direct construction by callers. We won't define an
+    // implementation to throw a link error in case someone magically
+    // finds a way to try to directly instantiate this object
+    DoorSensorMonitor();
+
+    // Edge interrupt handlers that count raw transitions.
+    // attachInterrupt() doesn't pass an argument so each door gets
+    // its own.
+    static void isrDoor0();
+    static void isrDoor1();
+    static void isrDoor2();
+    static void isrDoor3();
+
+    // Timer interrupt that samples and filters every sensor
+    static void sample();
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    // Register mask for each door's sensor pin
+    static uint32_t _masks[MAX_DOORS];
+
+    static int _doorCount;
+
+    static DoorEventQueue _queue;
+
+    // Integrator per door, 0 (low) .. INTEGRATOR_MAX (high)
+    static volatile uint8_t _integrators[MAX_DOORS];
+
+    // Debounced levels in GPIO register layout
+    static volatile uint32_t _debouncedLevels;
+
+    static volatile uint32_t _rawTransitions[MAX_DOORS];
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+// None.
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+None.
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_DOORSENSORMONITOR_H_
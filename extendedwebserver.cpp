@@ -90,6 +90,211 @@ None
 // FUNCTION IMPLEMENTATIONS
 //======================================================================
 
+/*======================================================================
+FUNCTION:
+ExtendedWebServer()
+
+DESCRIPTION:
+C-tor
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+ExtendedWebServer::ExtendedWebServer( IPAddress addr, int port )
+    : ESP8266WebServer( addr, port )
+{
+    initKeepAlive();
+}
+
+ExtendedWebServer::ExtendedWebServer( int port ) 
+    : ESP8266WebServer( port )
+{
+    initKeepAlive();
+}
+
+/*======================================================================
+FUNCTION:
+initKeepAlive()
+
+DESCRIPTION:
+Sets the keep-alive defaults and has the core hang on to the 
+Connection request header so we can see what the client asked for.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void ExtendedWebServer::initKeepAlive()
+{
+    _idleTimeoutMS = DEFAULT_IDLE_TIMEOUT_MS;
+    _maxRequests   = DEFAULT_MAX_REQUESTS;
+    _requestCount  = 0;
+    _idleSinceMS   = 0;
+
+    // The core adds the Authorization header itself
+    const char *HEADERS[] = { "Connection" };
+
+    collectHeaders( HEADERS, 1 );
+}
+
+/*======================================================================
+FUNCTION:
+SetKeepAlive()
+
+DESCRIPTION:
+Sets how long an open connection can sit idle and how many requests
+it serves before we close it.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void ExtendedWebServer::SetKeepAlive( unsigned long idleTimeoutMS, uint16_t maxRequests )
+{
+    _idleTimeoutMS = idleTimeoutMS;
+    _maxRequests   = maxRequests;
+}
+
+/*======================================================================
+FUNCTION:
+handleClient()
+
+DESCRIPTION:
+Lets the core read and dispatch requests, then keeps the connection
+open for the next one when the response said keep-alive.
+
+The core parses one request per call and, once it has answered,
+waits for the client to close.  When the connection is being kept 
+alive we put it back to waiting for a request instead, so the next 
+call picks up whatever the client sends (or has already pipelined).
+The core gives up on a connection that sends nothing for 
+HTTP_MAX_DATA_WAIT, so while one is idle we hold that timer off and 
+enforce our own idle timeout.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void ExtendedWebServer::handleClient()
+{
+    if ( _currentStatus == HC_NONE )
+    {
+        _requestCount = 0;
+    }
+    else if ( _currentStatus == HC_WAIT_READ && _requestCount > 0 && _currentClient.available() == 0 )
+    {
+        bool idle = ( millis() - _idleSinceMS ) >= _idleTimeoutMS;
+
+        // Only one connection is served at a time, so don't make a
+        // new client wait on one that isn't doing anything
+        if ( true == idle || _server.hasClient() == true )
+        {
+            _currentClient.stop();
+            _currentClient = WiFiClient();
+            _currentStatus = HC_NONE;
+            _requestCount  = 0;
+
+            return;
+        }
+
+        _statusChange = millis();
+    }
+
+    HTTPClientStatus before = _currentStatus;
+
+    ESP8266WebServer::handleClient();
+
+    if ( before != HC_WAIT_CLOSE && _currentStatus == HC_WAIT_CLOSE )
+    {
+        // A request was just answered.  The request headers are still
+        // there, so this is the same answer the handler got.
+        bool keepAlive = IsKeepAlive();
+
+        _requestCount++;
+
+        if ( true == keepAlive )
+        {
+            _currentStatus = HC_WAIT_READ;
+            _statusChange  = millis();
+            _idleSinceMS   = _statusChange;
+        }
+    }
+}
+
+/*======================================================================
+FUNCTION:
+DetachClient()
+
+DESCRIPTION:
+Takes the connection away from the server during a handler, for 
+responses that outlive the handler (event streams, long polls).  Once
+the handler returns the core finds no connection and goes back to 
+accepting new ones.  The WiFiClient we return keeps the connection 
+alive.
+
+RETURN VALUE:
+The connection.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+WiFiClient ExtendedWebServer::DetachClient()
+{
+    WiFiClient client = _currentClient;
+
+    _currentClient = WiFiClient();
+
+    return client;
+}
+
+/*======================================================================
+FUNCTION:
+IsKeepAlive()
+
+DESCRIPTION:
+Decides if the connection stays open after the current request.  
+HTTP/1.1 clients get it unless they ask to close, HTTP/1.0 clients 
+only if they ask for it, and nobody gets it past the request cap.
+
+RETURN VALUE:
+true to keep the connection open.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool ExtendedWebServer::IsKeepAlive()
+{
+    if ( _requestCount + 1 >= _maxRequests )
+    {
+        return false;
+    }
+
+    String connection = header( "Connection" );
+    connection.toLowerCase();
+
+    if ( _currentVersion == 0 )
+    {
+        return connection.indexOf( "keep-alive" ) >= 0;
+    }
+
+    return connection.indexOf( "close" ) < 0;
+}
+
 String ExtendedWebServer::_getRandomHexString()
 {
     char buffer[33];  // buffer to hold 32 Hex Digit + /0
@@ -110,6 +315,8 @@ String ExtendedWebServer::_exractParam( String& authReq, const String& param, co
 
 void ExtendedWebServer::requestAuthentication( HTTPAuthMethod mode, const char* realm, const String& authFailMsg )
 {
+    String challenge;
+
     if ( realm == NULL )
     {
         _srealm = "Login Required";
@@ -120,15 +327,25 @@ void ExtendedWebServer::requestAuthentication( HTTPAuthMethod mode, const char*
     }
     if ( mode == BASIC_AUTH )
     {
-        sendHeader( "WWW-Authenticate", "Basic realm=\"" + _srealm + "\"" );
+        challenge = "Basic realm=\"" + _srealm + "\"";
     }
     else
     {
         _snonce = _getRandomHexString();
         _sopaque = _getRandomHexString();
-        sendHeader( "WWW-Authenticate", "Digest realm=\"" + _srealm + "\", qop=\"auth\", nonce=\"" + _snonce + "\", opaque=\"" + _sopaque + "\"" );
+        challenge = "Digest realm=\"" + _srealm + "\", qop=\"auth\", nonce=\"" + _snonce + "\", opaque=\"" + _sopaque + "\"";
     }
-    send( 401, "text/html", authFailMsg );
+
+    // Written directly instead of with send(), which always closes the
+    // connection.  A client can answer the challenge on the same one.
+    String response = "HTTP/1.1 401 Unauthorized\r\nContent-Type: text/html\r\nWWW-Authenticate: ";
+    response += challenge;
+    response += "\r\nContent-Length: ";
+    response += authFailMsg.length();
+    response += ( IsKeepAlive() == true ) ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+    response += authFailMsg;
+
+    _currentClient.write( (const uint8_t *) response.c_str(), response.length() );
 }
 
 bool ExtendedWebServer::authenticate( const char * username, const char * password )
@@ -25,6 +25,9 @@ https://github.com/esp8266/Arduino/commit/eebc5ec593a8c739f8da2612a0e25ff4dab982
 Implements the constant time string compare from WString
 https://github.com/esp8266/Arduino/commit/03f1a540caa5af96a686db81fc3a21b9936dd4a7#diff-3d1eaec7ee8f9cdadc75a401477867a0
 
+It also keeps HTTP/1.1 connections open between requests, which the
+core server doesn't do.
+
 
 PUBLIC CLASSES AND FUNCTIONS:
 ExtendedWebServer
@@ -70,7 +73,9 @@ ExtendedWebServer
 // WARNINGS!!!
 //======================================================================
 
-// None.
+// The Connection request header is collected in the c-tor.  Calling
+// collectHeaders() again replaces the list, so include "Connection" 
+// or every connection closes after one request.
 
 //======================================================================
 // FUNCTION DECLARATIONS
@@ -97,6 +102,13 @@ Subclasses the ESP8266WebServer to implement digest authentication.
 Digest authentication, while not strong (MD5), at least doesn't
 pass the credentials in the clear.
 
+Connections are kept alive between requests when the client allows 
+it, up to a number of requests, and closed once they have been idle 
+for a while.  The server only serves one connection at a time, so an
+idle one also gives way as soon as another client is waiting.  
+Pipelined requests already in the connection's buffer are served one 
+per handleClient() call, in order.
+
 HOW TO USE:
 This class is a drop-in replacement for the ESP8266WebServer, so 
 follow its usage pattern.  When you want to authenticate:
@@ -104,6 +116,10 @@ follow its usage pattern.  When you want to authenticate:
 2. if that fails, call requestAuthentication() with the auth method you
 want to use.
 
+Handlers that write their own responses should send "Connection: 
+keep-alive" when IsKeepAlive() says so, otherwise "Connection: close".
+Responses sent with send() always say close.
+
 ======================================================================*/
 class ExtendedWebServer : public ESP8266WebServer
 {
@@ -115,14 +131,33 @@ class ExtendedWebServer : public ESP8266WebServer
 
     enum HTTPAuthMethod { BASIC_AUTH, DIGEST_AUTH };
 
+    // How long a kept alive connection can sit idle between requests
+    static const unsigned long DEFAULT_IDLE_TIMEOUT_MS = 5000;
+
+    // Requests served on one connection before we close it
+    static const uint16_t DEFAULT_MAX_REQUESTS = 16;
+
     //=================================================================
     // CLIENT INTERFACE
     //=================================================================
 
-    ExtendedWebServer( IPAddress addr, int port ) 
-        : ESP8266WebServer( addr, port ) {}
+    ExtendedWebServer( IPAddress addr, int port );
+
+    ExtendedWebServer( int port );
 
-    ExtendedWebServer( int port) : ESP8266WebServer( port ){ }
+    // maxRequests of 1 turns keep-alive off
+    void SetKeepAlive( unsigned long idleTimeoutMS, uint16_t maxRequests );
+
+    virtual void handleClient();
+
+    // true if the connection stays open after the response to the
+    // current request
+    bool IsKeepAlive();
+
+    // Hands the current request's connection over to the caller.  The
+    // server forgets it without closing it, and the caller owns the
+    // response from here on.
+    WiFiClient DetachClient();
 
     void requestAuthentication( HTTPAuthMethod mode = BASIC_AUTH, 
                                 const char* realm = NULL, 
@@ -156,12 +191,21 @@ class ExtendedWebServer : public ESP8266WebServer
     // IMPLEMENTATION INTERFACE    
     //=================================================================
 
-    // None.
+    void initKeepAlive();
 
     //=================================================================
     // DATA MEMBERS    
     //=================================================================
 
+    unsigned long _idleTimeoutMS;
+    uint16_t      _maxRequests;
+
+    // Requests served on the current connection
+    uint16_t      _requestCount;
+
+    // millis() when the last response on the connection went out
+    unsigned long _idleSinceMS;
+
     String _snonce;  // Store noance and opaque for future comparison
     String _sopaque;
     String _srealm;  // Store the Auth realm between Calls
@@ -63,6 +63,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "mqttproxy.h"
 
+// Store and forward for messages the broker couldn't take
+#include "mqttoutbox.h"
+
+// Compact binary payloads
+#include "cborwriter.h"
+
+#include "jsonwriter.h"
+
+// The all doors document, rendered once per change
+#include "statusdocumentcache.h"
+
 #include "timeproxy.h"
 
 #include "discoveryproxy.h"
@@ -77,8 +88,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "ledhelper.h"
 
+// Debounced, interrupt driven door sensor changes
+#include "doorsensormonitor.h"
+#include "doorinputsnapshot.h"
+
+// Background door calibration jobs
+#include "calibrationmanager.h"
+
 #include "extendedwebserver.h"
 
+// Cooperative scheduling for everything that runs
+// once we are up and on the network
+#include "taskscheduler.h"
+
+// Non-blocking WLAN connect/reconnect
+#include "wificonnectionmanager.h"
+
 //----------------------------------------------------------------------
 // Type Declarations
 //----------------------------------------------------------------------
@@ -96,9 +121,21 @@ const int STATE_WIFI_AP_CONFIG_MODE = 3;
 const int STATE_WIFI_STA_DISCONNECTED = 4;
 const int STATE_WIFI_STA_CONNECTED = 5;
 const int STATE_READY = 6;
+const int STATE_FACTORY_RESET = 7;
 
 const String PROJECT_NAME = "garage-o-matic";
 
+// How often the scheduled tasks run.  These are small since each
+// task returns right away; the scheduler idles between deadlines.
+const unsigned long TASK_INTERVAL_WEBSERVER_MS = 2;
+const unsigned long TASK_INTERVAL_FIRMWARE_MS  = 10;
+const unsigned long TASK_INTERVAL_PUBLISH_MS   = 10;
+const unsigned long TASK_INTERVAL_MQTT_MS      = 10;
+const unsigned long TASK_INTERVAL_OUTBOX_MS    = 50;
+const unsigned long TASK_INTERVAL_LED_MS       = 10;
+const unsigned long TASK_INTERVAL_CALIBRATE_MS = 50;
+const unsigned long TASK_INTERVAL_NTP_MS       = 50;
+
 //----------------------------------------------------------------------
 // Global Data Definitions
 //----------------------------------------------------------------------
@@ -110,13 +147,22 @@ std::unique_ptr<WebserverProxy> webserverProxy;
 
 std::unique_ptr<MqttProxy> mqttProxy;
 
+MqttOutbox mqttOutbox;
+
+// The all doors document being published (or drained from the
+// outbox).  Only used from the loop, so one is enough.
+uint8_t payloadBuffer[MqttOutbox::MAX_MESSAGE_BYTES];
+
+// The JSON all doors document everyone sends
+StatusDocumentCache statusDocument;
+
 std::unique_ptr<FirmwareUpdater> firmwareUpdater;
 
 WiFiClient wifiClient;
 
 GarageDoor::GarageDoorCollection garagedoors;
 
-GarageDoor::DoorStatusCollection doorStatusCollection;
+GarageDoor::DoorStateCollection doorStateCollection;
 
 volatile bool saveConfigFlag = false;
 
@@ -126,12 +172,23 @@ std::unique_ptr<DiscoveryProxy> discoveryProxy;
 
 Configuration config;
 
+TaskScheduler scheduler;
+
+WifiConnectionManager wifiConnection;
+
 //----------------------------------------------------------------------
 // Static Variable Definitions 
 //----------------------------------------------------------------------
 
 volatile int activeState = STATE_INITIALIZED;
 
+// Set once the network services have been added to the scheduler
+bool networkTasksScheduled = false;
+
+// Bit per door that an MQTT refresh command asked publish() to send 
+// again
+uint32_t refreshDoors = 0;
+
 //----------------------------------------------------------------------
 // Function Prototypes
 //----------------------------------------------------------------------
@@ -168,7 +225,8 @@ void setup()
     activityLed.TurnOff();
     networkLed.TurnOff();
     
-    activityLed.Flash();
+    // The activity LED beats to show the device is running
+    activityLed.Heartbeat();
     networkLed.Flash();
 
     GarageDoor door0( PIN_SENSOR_DOOR_0, PIN_RELAY_DOOR_0 );
@@ -180,7 +238,18 @@ void setup()
     garagedoors.push_back( door0 );
     garagedoors.push_back( door1 );
 
+    // Start sampling the sensors.  Debounced changes are queued
+    // for publish() from here on.
+    DoorSensorMonitor::Begin( garagedoors );
+
     pinMode( PIN_FACTORY_RESET, INPUT_PULLDOWN_16 );
+
+    // Tick the LED animations
+    scheduler.SchedulePeriodic( []() 
+    { 
+        activityLed.Process();
+        networkLed.Process();
+    }, TASK_INTERVAL_LED_MS );
 }
 
 /*======================================================================
@@ -204,68 +273,6 @@ void saveConfigCallback()
     saveConfigFlag = true;
 }
 
-/*======================================================================
-FUNCTION:
-wifiDisconnected()
-
-DESCRIPTION:
-Callback when we are disconnected from the wifi network.
-
-RETURN VALUE:
-none
-
-SIDE EFFECTS:
-none.
-
-======================================================================*/
-void wifiDisconnected( WiFiEventStationModeDisconnected event_info )
-{
-    Serial.println( "**WIFI disconnected**" );
-
-    // Set the state machine
-    activeState = STATE_WIFI_STA_DISCONNECTED;
-}
-
-/*======================================================================
-FUNCTION:
-wifiConnectedWithIP()
-
-DESCRIPTION:
-Callback when we are associated with a wifi network and have 
-and IP address.
-
-RETURN VALUE:
-none
-
-SIDE EFFECTS:
-none.
-
-======================================================================*/
-void wifiConnectedWithIP( WiFiEventStationModeGotIP ipInfo )
-{
-    Serial.printf( "**WIFI connected and assigned ip %s\n", ipInfo.ip.toString().c_str() );
-}
-
-/*======================================================================
-FUNCTION:
-wifiConnected()
-
-DESCRIPTION:
-Callback when we are associated with a wifi network but do not 
-have an ip address
-
-RETURN VALUE:
-none
-
-SIDE EFFECTS:
-none.
-
-======================================================================*/
-void wifiConnected( const WiFiEventStationModeConnected &connectInfo )
-{
-    Serial.printf( "**Wifi connected\n" );
-}
-
 /*======================================================================
 FUNCTION:
 doFactoryReset()
@@ -290,58 +297,6 @@ bool doFactoryReset()
 FUNCTION:
 wifiApConfigMode()
 
-DESCRIPTION:
-Reads the GPIO pin that is used to indicate we should perform a factory
-reset.
-
-RETURN VALUE:
-true if the GPIO pin is HIGH
-
-SIDE EFFECTS:
-none.
-
-======================================================================*/
-bool connectWifi()
-{
-    bool connected = false;
-
-    config = ConfigurationManager::Load();
-
-    Serial.printf( "Found configuration, attempting to connect to WLAN %s\n", config.GetWlanSSID().c_str() );
-
-    WiFi.begin( config.GetWlanSSID().c_str(), config.GetWlanPassword().c_str() );
-
-    // Handlers seem to need to be set after the begin() call
-    WiFi.onStationModeDisconnected( wifiDisconnected );
-    WiFi.onStationModeGotIP( wifiConnectedWithIP );
-    WiFi.onStationModeConnected( wifiConnected );
-
-    WiFi.persistent( false );
-    WiFi.mode( WIFI_OFF );
-    WiFi.mode( WIFI_STA );
-
-    WiFi.begin( config.GetWlanSSID().c_str(), config.GetWlanPassword().c_str() );
-
-    while ( WiFi.status() != WL_CONNECTED )
-    {
-        // TODO... break out of  loop after some N amount of time
-        delay( 500 );
-        Serial.print( "." );
-    }
-
-    connected = true;
-
-    Serial.printf( "\nConnected to SSID %s, ip address %s\n",
-                   config.GetWlanSSID().c_str(),
-                   WiFi.localIP().toString().c_str() );
-
-    return connected;
-}
-
-/*======================================================================
-FUNCTION:
-wifiApConfigMode()
-
 DESCRIPTION:
 Puts the AP into stand-along access point (AP) mode.  The user then connects
 to this SSID and can use the web UI to set the garage-o-matic configuration
@@ -375,31 +330,52 @@ bool wifiApConfigMode()
     const int BUF_SIZE = 50;;
     char mqttServer [BUF_SIZE + 1] = { 0 };
     char mqttPubFeed[BUF_SIZE + 1] = { 0 };
-    char ntpServer  [BUF_SIZE + 1] = { 0 };
+    char mqttUser   [BUF_SIZE + 1] = { 0 };
+    char mqttPass   [BUF_SIZE + 1] = { 0 };
+    // Room for a few servers, comma separated
+    const int NTP_BUF_SIZE = 100;
+    char ntpServer  [NTP_BUF_SIZE + 1] = { 0 };
     char deviceUser [BUF_SIZE + 1] = { 0 };
     char devicePass [BUF_SIZE + 1] = { 0 };
 
     strncpy( mqttPubFeed, "garage/doors", BUF_SIZE );
-    strncpy( ntpServer, "us.pool.ntp.org", BUF_SIZE );
+    strncpy( ntpServer, "0.us.pool.ntp.org,1.us.pool.ntp.org,2.us.pool.ntp.org", NTP_BUF_SIZE );
 
     strncpy( deviceUser, "admin", BUF_SIZE );
     strncpy( devicePass, "password", BUF_SIZE );
 
     char mqttPort[6] = { 0 };
 
+    char mqttDoorTopics[2] = { '0', 0 };
+    char mqttCommands[2] = { '0', 0 };
+    char mqttCbor[2] = { '0', 0 };
+    char closingStops[2] = { '0', 0 };
+
     // The extra parameters to be configured (can be either global or just in the setup)
     // After connecting, parameter.getValue() will get you the configured value
     // id/name placeholder/prompt default length
     WiFiManagerParameter mqttServerParam( "mqtt_server", "mqtt server", mqttServer, BUF_SIZE );
     WiFiManagerParameter mqttPortParam( "mqtt_port", "1883", mqttPort, 6 );
     WiFiManagerParameter mqttPubFeedParam( "mqtt_pubfeed", "garage/doors", mqttPubFeed, BUF_SIZE );
-    WiFiManagerParameter ntpServerParam( "ntp_server", "ntp server", ntpServer, BUF_SIZE );
+    WiFiManagerParameter mqttUserParam( "mqtt_user", "mqtt username (blank = none)", mqttUser, BUF_SIZE );
+    WiFiManagerParameter mqttPassParam( "mqtt_pass", "mqtt password", mqttPass, BUF_SIZE );
+    WiFiManagerParameter mqttDoorTopicsParam( "mqtt_doortopics", "per door topics (1 = yes)", mqttDoorTopics, 2 );
+    WiFiManagerParameter mqttCommandsParam( "mqtt_commands", "door commands over mqtt (1 = yes)", mqttCommands, 2 );
+    WiFiManagerParameter mqttCborParam( "mqtt_cbor", "cbor payloads (1 = yes)", mqttCbor, 2 );
+    WiFiManagerParameter closingStopsParam( "closing_stops", "press stops a closing door (1 = yes)", closingStops, 2 );
+    WiFiManagerParameter ntpServerParam( "ntp_server", "ntp servers (comma separated)", ntpServer, NTP_BUF_SIZE );
     WiFiManagerParameter deviceUserParam( "device_user", "device username", deviceUser, BUF_SIZE );
     WiFiManagerParameter devicePassParam( "device_pass", "device password", devicePass, BUF_SIZE );
 
     wifiManager.addParameter( &mqttServerParam );
     wifiManager.addParameter( &mqttPortParam );
     wifiManager.addParameter( &mqttPubFeedParam );
+    wifiManager.addParameter( &mqttUserParam );
+    wifiManager.addParameter( &mqttPassParam );
+    wifiManager.addParameter( &mqttDoorTopicsParam );
+    wifiManager.addParameter( &mqttCommandsParam );
+    wifiManager.addParameter( &mqttCborParam );
+    wifiManager.addParameter( &closingStopsParam );
     wifiManager.addParameter( &ntpServerParam );
     wifiManager.addParameter( &deviceUserParam );
     wifiManager.addParameter( &devicePassParam );
@@ -422,6 +398,12 @@ bool wifiApConfigMode()
         config.SetMqttServer( mqttServerParam.getValue() );
         config.SetMqttPort( mqttPortParam.getValue() );
 config.SetMqttPubFeed( mqttPubFeedParam.getValue() );
+config.SetMqttUsername( mqttUserParam.getValue() );
+config.SetMqttPassword( mqttPassParam.getValue() );
+config.SetMqttDoorTopics( String( mqttDoorTopicsParam.getValue() ) );
+config.SetMqttCommands( String( mqttCommandsParam.getValue() ) );
+config.SetMqttCbor( String( mqttCborParam.getValue() ) );
+config.SetClosingPressStops( String( closingStopsParam.getValue() ) );
 config.SetNtpServer( ntpServerParam.getValue() );
 config.SetDeviceUsername( deviceUserParam.getValue() );
 config.SetDevicePassword( devicePassParam.getValue() );
@@ -437,66 +419,280 @@ FUNCTION:
 serializeJSONPayload()
 
 DESCRIPTION:
-Creates a JSON string that represents the state of the garage door(s).
+Writes the JSON document that represents the state of the garage 
+door(s) straight into the buffer.  No Strings, no printf, and no 
+strcat walking the document over and over.
 
 RETURN VALUE:
-String with the json data
+Number of bytes written (not counting the NUL), 0 if it didn't fit.
 
 SIDE EFFECTS:
 none
 
 ======================================================================*/
-String serializeJSONPayload( const GarageDoor::GarageDoorCollection & garageDoors )
+size_t serializeJSONPayload( const GarageDoor::GarageDoorCollection & garageDoors, char *buffer, size_t size )
 {
-    const int DOOR_BUF_SIZE = 50;
+    // All doors come from the same instant
+    const DoorInputSnapshot &snapshot = DoorInputSnapshot::Current();
+
+    char timeUTC[TimeProxy::TIME_STRING_SIZE];
+    timeProxy->FormatTimeUTC( timeUTC, sizeof( timeUTC ) );
+
+    bool   clockSet = ( timeStatus() != timeNotSet );
+    time_t utc      = now();
+
+    char lastChangeUTC[TimeProxy::TIME_STRING_SIZE];
+
+    JsonWriter writer( buffer, size );
+
+    writer.BeginObject();
+    writer.Key( "garageomatic" );
+    writer.BeginObject();
 
-    // We use about ~120 bytes for 2 doors.  This
-    // buffer size is stoopid big.
-    const int JSON_BUF_SIZE = 512;
-    char json[JSON_BUF_SIZE] = { 0 };
+    writer.Key( "version" );
+    writer.Value( "1.0.0" );
 
-    snprintf( json,
-              JSON_BUF_SIZE - 1,
-              "{\"garageomatic\":{\"version\":\"1.0.0\",\"timeUTC\":\"%s\",\"garagedoors\":[",
-              timeProxy->GetTimeStringUTC().c_str() );
+    writer.Key( "timeUTC" );
+    writer.Value( timeUTC );
+
+    // The latest state version of any door, for /garage/events?since=
+    writer.Key( "stateVersion" );
+    writer.Value( GarageDoor::GetLatestStateVersion() );
+
+    writer.Key( "garagedoors" );
+    writer.BeginArray();
 
     for ( int i = 0; i < garageDoors.size(); i++ )
     {
-        char doorjson[DOOR_BUF_SIZE] = { 0 };
+        const GarageDoor &door = garageDoors[i];
+
+        // status is the raw sensor, state is what the door is doing 
+        // (stateVersion numbers each change), and etaMS is roughly how
+        // long until a moving door gets where it's going.
+        writer.BeginObject();
+
+        writer.Key( "door" );
+        writer.Value( i );
+
+        writer.Key( "status" );
+        writer.Value( snapshot.Status( i ) == GarageDoor::OPEN ? "open" : "closed" );
+
+        writer.Key( "state" );
+        writer.Value( GarageDoor::StateToString( door.State() ) );
 
-        GarageDoor door = garageDoors[i];
+        unsigned long ageMS = door.GetTimeInStateMS();
 
-        const char *EMPTY = "";
-        const char *COMMA = ",";
+        writer.Key( "stateAgeMS" );
+        writer.Value( ageMS );
 
-        const char *SEPARATOR = COMMA;
+        // null until the clock has been set
+        writer.Key( "lastChangeUTC" );
 
-        if ( ( i + 1 ) == garageDoors.size() )
+        if ( true == clockSet )
         {
-            SEPARATOR = EMPTY;
+            TimeProxy::FormatTimeUTC( utc - (time_t) ( ageMS / 1000 ), lastChangeUTC, sizeof( lastChangeUTC ) );
+            writer.Value( lastChangeUTC );
         }
+        else
+        {
+            writer.Null();
+        }
+
+        writer.Key( "stateVersion" );
+        writer.Value( door.GetStateVersion() );
+
+        writer.Key( "etaMS" );
+        writer.Value( door.GetRemainingTravelMS() );
+
+        writer.EndObject();
+    }
 
-        // Format the door json
-        snprintf( doorjson, DOOR_BUF_SIZE - 1, "{\"door\": %d,\"status\":\"%s\"}%s",
-                  i,
-                  door.Status() == GarageDoor::OPEN ? "open" : "closed",
-                  SEPARATOR
-        );
+    writer.EndArray();
+
+    // Link health: is the broker there and how long it takes to
+    // answer a ping.  null without a broker configured.
+    writer.Key( "mqtt" );
+
+    if ( mqttProxy == false )
+    {
+        writer.Null();
+    }
+    else
+    {
+        writer.BeginObject();
+        writer.Key( "connected" );
+        writer.Value( mqttProxy->IsConnected() );
+        writer.Key( "pingRttMS" );
+        writer.Value( mqttProxy->GetPingRttMS() );
+        writer.EndObject();
+    }
 
-        strncat( json, doorjson, JSON_BUF_SIZE - strlen( json ) );
+    // Sync quality, so a client can tell how far to trust timeUTC.
+    // server and errorBoundMS are null until the first sync.
+    int           server     = timeProxy->GetSelectedServer();
+    unsigned long errorBound = timeProxy->GetErrorBoundMS();
+
+    writer.Key( "clock" );
+    writer.BeginObject();
+
+    writer.Key( "synced" );
+    writer.Value( timeProxy->IsSynced() );
+
+    writer.Key( "server" );
+
+    if ( server < 0 )
+    {
+        writer.Null();
+    }
+    else
+    {
+        writer.Value( timeProxy->GetServerName( server ).c_str() );
+    }
+
+    writer.Key( "offsetMS" );
+    writer.Value( timeProxy->GetOffsetMS() );
+
+    writer.Key( "errorBoundMS" );
+
+    if ( errorBound == ULONG_MAX )
+    {
+        writer.Null();
     }
+    else
+    {
+        writer.Value( errorBound );
+    }
+
+    writer.EndObject();
 
-    strncat( json, "]}}", JSON_BUF_SIZE - strlen( json ) );
+    writer.EndObject();
+    writer.EndObject();
 
-    return json;
+    return ( writer.Overflowed() == true ) ? 0 : writer.Length();
 }
 
 /*======================================================================
 FUNCTION:
-loop()
+serializeCBORPayload()
 
 DESCRIPTION:
-For arduinos this is your main function loop.
+Encodes the state of the garage door(s) as CBOR.  Same content as the
+JSON document, but with integer keys, the time as epoch seconds, and
+the status and state as their enum values:
+
+    55799({0: 1, 1: 1(time), 2: [[door, status, state, stateAgeMS, etaMS], ...]})
+
+Key 0 is the document version, so the layout can change later without
+confusing old subscribers.
+
+RETURN VALUE:
+Number of bytes written, 0 if it didn't fit.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+size_t serializeCBORPayload( const GarageDoor::GarageDoorCollection & garageDoors, uint8_t *buffer, size_t size )
+{
+    const uint32_t CBOR_PAYLOAD_VERSION = 1;
+
+    const DoorInputSnapshot &snapshot = DoorInputSnapshot::Current();
+
+    CborWriter writer( buffer, size );
+
+    writer.WriteTag( CborWriter::TAG_SELF_DESCRIBE );
+    writer.WriteMap( 3 );
+
+    writer.WriteUnsigned( 0 );
+    writer.WriteUnsigned( CBOR_PAYLOAD_VERSION );
+
+    writer.WriteUnsigned( 1 );
+    writer.WriteTag( CborWriter::TAG_EPOCH_TIME );
+    writer.WriteUnsigned( timeProxy->GetCurrentTimeUTC() );
+
+    writer.WriteUnsigned( 2 );
+    writer.WriteArray( garageDoors.size() );
+
+    for ( int i = 0; i < garageDoors.size(); i++ )
+    {
+        const GarageDoor &door = garageDoors[i];
+
+        writer.WriteArray( 5 );
+        writer.WriteUnsigned( i );
+        writer.WriteUnsigned( snapshot.Status( i ) );
+        writer.WriteUnsigned( door.State() );
+        writer.WriteUnsigned( door.GetTimeInStateMS() );
+        writer.WriteUnsigned( door.GetRemainingTravelMS() );
+    }
+
+    return ( writer.Overflowed() == true ) ? 0 : writer.Length();
+}
+
+/*======================================================================
+FUNCTION:
+serializePayload()
+
+DESCRIPTION:
+Gets the all doors document in the configured encoding.  JSON comes 
+straight from the status document cache; CBOR is encoded into 
+payloadBuffer.
+
+RETURN VALUE:
+The document, nullptr (and a length of 0) if it didn't fit.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+const uint8_t *serializePayload( size_t &length )
+{
+    if ( config.GetMqttCbor() == true )
+    {
+        length = serializeCBORPayload( garagedoors, payloadBuffer, sizeof( payloadBuffer ) );
+
+        return ( length != 0 ) ? payloadBuffer : nullptr;
+    }
+
+    return (const uint8_t *) statusDocument.Get( length );
+}
+
+/*======================================================================
+FUNCTION:
+publishPayload()
+
+DESCRIPTION:
+Publishes the all doors document.  JSON goes to the feed; CBOR goes 
+to <feed>/cbor so a subscriber always knows what it is getting.
+
+RETURN VALUE:
+true if successful
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool publishPayload( const uint8_t *payload, size_t length )
+{
+    String topic = config.GetMqttPubFeed();
+
+    if ( config.GetMqttCbor() == true )
+    {
+        topic += "/cbor";
+    }
+
+    return mqttProxy->Publish( topic, payload, length, false );
+}
+
+/*======================================================================
+FUNCTION:
+publish()
+
+DESCRIPTION:
+Drains the debounced door sensor change queue into the door state 
+machines and publishes if any door changed state.  Besides sensor 
+changes, a door also changes state when we pulse its relay or when
+its travel time runs out, so every door's state machine is stepped
+on each pass.
 
 RETURN VALUE:
 none.
@@ -507,18 +703,73 @@ none
 ======================================================================*/
 void publish()
 {
+    // Overflow count from the last pass.  If it moves we lost changes.
+    static uint32_t lastOverflowCount = 0;
+
     // We only want to publish on state changes
     bool changed = false;
 
+    // Bit per door that changed
+    uint32_t changedDoors = 0;
+
+    // Something happened at the sensors since the last pass
+    bool pending = false;
+
+    DoorEvent event;
+
+    while ( DoorSensorMonitor::Poll( event ) == true )
+    {
+        pending = true;
+
+        // Feed the edge in with its own timestamp so the time in 
+        // state is measured from when the sensor actually changed
+        if ( event.door < garagedoors.size() )
+        {
+            garagedoors[event.door].Update( GarageDoor::StatusFromLevel( event.level ),
+                                            event.timestampMS );
+        }
+    }
+
+    uint32_t overflowCount = DoorSensorMonitor::GetOverflowCount();
+
+    if ( overflowCount != lastOverflowCount )
+    {
+        // The queue filled up and we dropped changes, so check
+        // every door below.
+        lastOverflowCount = overflowCount;
+        pending = true;
+    }
+
+    if ( true == pending )
+    {
+        // A change may have landed after this pass's snapshot was 
+        // taken. Refresh it so the diff, the payload and anyone else
+        // later in this pass all agree.
+        DoorInputSnapshot::Refresh();
+    }
+
+    const DoorInputSnapshot &snapshot = DoorInputSnapshot::Current();
+
+    unsigned long now = millis();
+
+    // Step every door against the snapshot.  This runs the travel 
+    // time timeouts, and catches up any edges we lost to an overflow.
+    for ( int i = 0; i < garagedoors.size(); i++ )
+    {
+        garagedoors[i].Update( snapshot.Status( i ), now );
+    }
+
     // Is this an initialization/startup case?
-    if ( doorStatusCollection.size() == 0 )
+    if ( doorStateCollection.size() == 0 )
     {
         // Hydrate the collection with the current
-        // door statuses.  We will then use this 
+        // door states.  We will then use this 
         // initial state to compare against future states.
-        for ( auto door : garagedoors )
+        for ( int i = 0; i < garagedoors.size(); i++ )
         {
-            doorStatusCollection.push_back( door.Status() );
+            doorStateCollection.push_back( garagedoors[i].State() );
+
+            changedDoors |= 1UL << i;
         }
 
         changed = true;
@@ -531,33 +782,360 @@ void publish()
             // previous value. If the value doesn't match the previous
             // value, then we need to trap this new state as the 
             // current state, and flag that something has changed
-            if ( garagedoors[i].Status() != doorStatusCollection[i] )
+            GarageDoor::DoorState state = garagedoors[i].State();
+
+            if ( state != doorStateCollection[i] )
             {
-                // The door has opened/closed since the last check,
-                // so this becomes the current state.
-                doorStatusCollection[i] = garagedoors[i].Status();
+                // The door has started/stopped moving since the last
+                // check, so this becomes the current state.
+                doorStateCollection[i] = state;
 
-                // Flag that the status has changed
+                // Flag that the state has changed
                 changed = true;
+                changedDoors |= 1UL << i;
             }
         }
     }
 
-    // Only publish if we have a mqtt proxy object
-    if ( mqttProxy != false )
+    if ( refreshDoors != 0 )
+    {
+        changed = true;
+        changedDoors |= refreshDoors;
+
+        refreshDoors = 0;
+    }
+
+    // Only publish if we have a mqtt proxy object.  The proxy 
+    // connects in the background; until it has, changes are queued
+    // (timestamped now) and drainOutbox() sends them once it does.
+    if ( mqttProxy != false && true == changed )
     {
-        if ( true == changed )
+        size_t length = 0;
+        const uint8_t *payload = serializePayload( length );
+
+        // Anything already queued has to go out first to keep the
+        // order
+        if ( length != 0 &&
+             ( mqttOutbox.IsEmpty() == false || publishPayload( payload, length ) == false ) )
         {
-            // Something changed, so publish the event
-            mqttProxy->Connect();
-            bool ok = mqttProxy->Publish( serializeJSONPayload( garagedoors ) );
+            mqttOutbox.Push( payload, length );
         }
-        else
+    }
+
+    if ( mqttProxy != false && config.GetMqttDoorTopics() == true )
+    {
+        publishDoorTopics( changedDoors );
+    }
+}
+
+/*======================================================================
+FUNCTION:
+publishDoorTopics()
+
+DESCRIPTION:
+Publishes each changed door to its own retained topics under the feed:
+
+    <feed>/door/<n>/state   what the door is doing (open, closing...)
+    <feed>/door/<n>/since   when it started doing it (ISO 8601 UTC)
+    <feed>/availability     online, or offline (our will) if we drop
+
+Only the doors that changed go out, so a subscriber to one door isn't
+woken for the others.  Changes made while the broker is away are held
+here, and every (re)connect republishes all the doors and our 
+availability since the broker may have restarted without them.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void publishDoorTopics( uint32_t changedDoors )
+{
+    // Doors still to publish
+    static uint32_t pendingDoors = 0;
+
+    static uint32_t lastConnectCount = 0;
+
+    pendingDoors |= changedDoors;
+
+    if ( mqttProxy->IsConnected() == false )
+    {
+        return;
+    }
+
+    const String feed = config.GetMqttPubFeed();
+
+    if ( mqttProxy->GetConnectCount() != lastConnectCount )
+    {
+        lastConnectCount = mqttProxy->GetConnectCount();
+
+        mqttProxy->Publish( feed + "/availability", "online", true );
+
+        for ( int i = 0; i < garagedoors.size(); i++ )
         {
-            // We need to send an MQTT keep-alive
-            mqttProxy->Ping();
+            pendingDoors |= 1UL << i;
         }
     }
+
+    for ( int i = 0; i < garagedoors.size() && pendingDoors != 0; i++ )
+    {
+        if ( ( pendingDoors & ( 1UL << i ) ) == 0 )
+        {
+            continue;
+        }
+
+        const GarageDoor &door = garagedoors[i];
+
+        String topic = feed + "/door/" + String( i );
+
+        if ( mqttProxy->Publish( topic + "/state", GarageDoor::StateToString( door.State() ), true ) == false )
+        {
+            // Lost the connection.  The reconnect sends everything.
+            return;
+        }
+
+        // Without a clock we'd be retaining 1970
+        if ( timeProxy != false && timeProxy->IsSynced() == true )
+        {
+            time_t since = timeProxy->GetCurrentTimeUTC() - door.GetTimeInStateMS() / 1000;
+
+            char sinceUTC[TimeProxy::TIME_STRING_SIZE];
+            size_t length = TimeProxy::FormatTimeUTC( since, sinceUTC, sizeof( sinceUTC ) );
+
+            mqttProxy->Publish( topic + "/since", (const uint8_t *) sinceUTC, length, true );
+        }
+
+        pendingDoors &= ~( 1UL << i );
+    }
+}
+
+/*======================================================================
+FUNCTION:
+handleMqttCommand()
+
+DESCRIPTION:
+Message callback for <feed>/door/#/command.  The payload is open, 
+close or refresh.  Open and close go through the same door command 
+logic as the REST endpoints; refresh has publish() send the door's 
+state again.  The outcome is published (not retained) to 
+<feed>/door/#/result.
+
+Retained commands are ignored.  The broker replays a retained message
+every time we subscribe, which is on every reconnect, so acting on one
+would press the opener after each WiFi drop or broker restart.
+
+This runs from the MQTT proxy's Process(), and everything in here 
+just queues work, so it returns right away.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+May press a garage door opener.
+
+======================================================================*/
+void handleMqttCommand( const String &topic, const uint8_t *payload, size_t length, bool retained )
+{
+    if ( true == retained )
+    {
+        Serial.printf( "MQTT command on %s was retained, ignored\n", topic.c_str() );
+        return;
+    }
+
+    const String prefix = config.GetMqttPubFeed() + "/door/";
+
+    if ( topic.startsWith( prefix ) == false || topic.endsWith( "/command" ) == false )
+    {
+        return;
+    }
+
+    // The door number is between the prefix and /command
+    String number = topic.substring( prefix.length(), topic.length() - strlen( "/command" ) );
+
+    // Digits only, and no more of them than the REST paths allow, so
+    // door/1abc/command isn't taken for door 1
+    if ( number.length() == 0 || number.length() > 5 )
+    {
+        return;
+    }
+
+    int doornum = 0;
+
+    for ( unsigned int i = 0; i < number.length(); i++ )
+    {
+        if ( isDigit( number[i] ) == false )
+        {
+            return;
+        }
+
+        doornum = doornum * 10 + ( number[i] - '0' );
+    }
+
+    if ( doornum < 0 || doornum >= garagedoors.size() )
+    {
+        Serial.printf( "MQTT command for unknown door %d\n", doornum );
+        return;
+    }
+
+    String command;
+    command.reserve( length );
+
+    for ( size_t i = 0; i < length; i++ )
+    {
+        command += (char) payload[i];
+    }
+
+    command.trim();
+    command.toLowerCase();
+
+    GarageDoor &door = garagedoors[doornum];
+
+    const char *result = nullptr;
+
+    if ( command == "open" || command == "close" )
+    {
+        bool open = ( command == "open" );
+
+        switch ( door.Command( open ? GarageDoor::COMMAND_OPEN : GarageDoor::COMMAND_CLOSE ) )
+        {
+            case GarageDoor::COMMAND_QUEUED:
+                result = open ? "opening" : "closing";
+                break;
+
+            case GarageDoor::COMMAND_ALREADY_THERE:
+                result = open ? "door already open" : "door already closed";
+                break;
+
+            case GarageDoor::COMMAND_IN_PROGRESS:
+                result = open ? "door already opening" : "door already closing";
+                break;
+
+            case GarageDoor::COMMAND_BUSY:
+                result = "too many commands queued, try again";
+                break;
+
+            default:
+                result = "cannot determine if door is closed or open. check sensor(s)";
+                break;
+        }
+    }
+    else if ( command == "refresh" )
+    {
+        refreshDoors |= 1UL << doornum;
+        result = "refreshing";
+    }
+    else
+    {
+        result = "unknown command";
+    }
+
+    Serial.printf( "MQTT command '%s' for door %d: %s\n", command.c_str(), doornum, result );
+
+    mqttProxy->Publish( prefix + number + "/result", result, false );
+}
+
+/*======================================================================
+FUNCTION:
+drainOutbox()
+
+DESCRIPTION:
+Scheduled task that sends the oldest queued message once the broker
+is back.  One message per pass, so a long backlog doesn't hold up the
+loop or flood the broker.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void drainOutbox()
+{
+    if ( mqttProxy == false || mqttProxy->IsConnected() == false || mqttOutbox.IsEmpty() == true )
+    {
+        return;
+    }
+
+    size_t length = mqttOutbox.Peek( payloadBuffer, sizeof( payloadBuffer ) );
+
+    if ( length != 0 && publishPayload( payloadBuffer, length ) == true )
+    {
+        mqttOutbox.Pop();
+    }
+}
+
+/*======================================================================
+FUNCTION:
+scheduleNetworkTasks()
+
+DESCRIPTION:
+Adds the network services to the scheduler.  Each of these tasks does
+a small amount of work and returns, so none of them holds up the
+others.  This is only done once; on a WiFi reconnect the tasks are
+already running.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void scheduleNetworkTasks()
+{
+    if ( true == networkTasksScheduled )
+    {
+        return;
+    }
+
+    scheduler.SchedulePeriodic( []() { webserverProxy->Process(); }, TASK_INTERVAL_WEBSERVER_MS );
+    scheduler.SchedulePeriodic( []() { firmwareUpdater->Process(); }, TASK_INTERVAL_FIRMWARE_MS );
+    // The file system is up by now, so anything queued before a 
+    // reboot can be picked up
+    mqttOutbox.Begin();
+
+    // No invalidating needed: the cache renders again whenever a 
+    // door's state version, the sensor levels or the clock second 
+    // moves
+    statusDocument.Begin( []( char *buffer, size_t size ) 
+    { 
+        return serializeJSONPayload( garagedoors, buffer, size );
+    } );
+
+    scheduler.SchedulePeriodic( publish, TASK_INTERVAL_PUBLISH_MS );
+    scheduler.SchedulePeriodic( drainOutbox, TASK_INTERVAL_OUTBOX_MS );
+
+    // The broker connection is kept up (and pinged when idle) in the
+    // background.  A dead broker only holds up the loop (web server 
+    // included) during a connect attempt, for up to 
+    // MqttProxy::TCP_CONNECT_TIMEOUT_MS once per backoff.
+    scheduler.SchedulePeriodic( []() 
+    { 
+        if ( mqttProxy != false && wifiConnection.IsConnected() == true )
+        {
+            mqttProxy->Process();
+        }
+    }, TASK_INTERVAL_MQTT_MS );
+
+    // The file system is up by now, so the calibration history can
+    // be loaded
+    CalibrationManager::Begin( garagedoors );
+    scheduler.SchedulePeriodic( CalibrationManager::Process, TASK_INTERVAL_CALIBRATE_MS );
+
+    // The NTP client steps through a sync a little at a time and
+    // decides itself when the next one is due
+    scheduler.SchedulePeriodic( []() 
+    { 
+        if ( wifiConnection.IsConnected() == true )
+        {
+            timeProxy->Process();
+        }
+    }, TASK_INTERVAL_NTP_MS );
+
+    networkTasksScheduled = true;
 }
 
 
@@ -577,8 +1155,12 @@ none
 ======================================================================*/
 void loop()
 {
-    activityLed.Flash();
-   
+    // One read of the door sensors for everything in this pass
+    DoorInputSnapshot::Refresh();
+
+    // One step of the WLAN connection state machine
+    wifiConnection.Process();
+
     switch ( activeState )
     {
         case STATE_INITIALIZING:
@@ -597,27 +1179,28 @@ void loop()
 
                 // Let's do some LED animation to show we 
                 // successfully ran the factory reset.  
-                // We are going to wig-wag the 2 leds
-                for ( int x = 0; x < 100; x++ )
-                {
-                    int state = activityLed.Toggle();
+                // We are going to wig-wag the 2 leds for ~5 seconds
+                activityLed.WigWag( networkLed );
 
-                    if ( 0 == state )
-                    {
-                        networkLed.TurnOn();
-                    }
-                    else
-                    {
-                        networkLed.TurnOff();
-                    }
-
-                    delay( 50 );
-                }
+                activeState = STATE_FACTORY_RESET;
+                break;
             }
 
             activeState = STATE_CHECK_STORED_CONFIG;
             break;
 
+        case STATE_FACTORY_RESET:
+
+            // Hang out here until the wig-wag finishes
+            if ( activityLed.IsPlaying() == false )
+            {
+                activityLed.Heartbeat();
+
+                activeState = STATE_CHECK_STORED_CONFIG;
+            }
+
+            break;
+
         case STATE_CHECK_STORED_CONFIG:
 
             config = ConfigurationManager::Load();
@@ -653,25 +1236,38 @@ void loop()
             break;
 
         case STATE_WIFI_STA_DISCONNECTED:
-        {
-            networkLed.TurnOff();
-            bool connected = connectWifi();
-            if ( connected == true )
+
+            // Only starts things the first time through.  After that
+            // the connection manager retries on its own and we just
+            // wait here (the scheduled tasks keep running).
+            if ( wifiConnection.GetState() == WifiConnectionManager::WIFI_IDLE )
             {
-                Serial.printf( "Setting state to WIFI STA connected\n" );
-                activeState = STATE_WIFI_STA_CONNECTED;
+                networkLed.Blink();
+
+                // Tell the door state machines how the opener
+                // treats a press while closing
+                for ( int i = 0; i < garagedoors.size(); i++ )
+                {
+                    garagedoors[i].SetClosingPress( config.GetClosingPressStops() == true ?
+                                                    GarageDoor::CLOSING_PRESS_STOPS :
+                                                    GarageDoor::CLOSING_PRESS_REVERSES );
+                }
+
+                wifiConnection.Begin( config.GetWlanSSID(), config.GetWlanPassword() );
             }
-            else
+
+            if ( wifiConnection.IsConnected() == true )
             {
-                Serial.printf( "connectWifi() returned false\n" );
+                Serial.printf( "Setting state to WIFI STA connected\n" );
+                activeState = STATE_WIFI_STA_CONNECTED;
             }
-        }
 
             break;
 
         case STATE_WIFI_STA_CONNECTED:
             
             networkLed.TurnOn();
+            activityLed.Heartbeat();
             if ( firmwareUpdater == false )
             {
                 Serial.println( "Starting firmware OTA support" );
@@ -699,6 +1295,27 @@ void loop()
                         config.GetMqttServer(),
                         config.GetMqttPort(),
                         config.GetMqttPubFeed() ) );
+
+                    mqttProxy->SetCredentials( config.GetMqttUsername(), config.GetMqttPassword() );
+
+                    // The broker tells the door topic subscribers
+                    // when we go away
+                    if ( config.GetMqttDoorTopics() == true )
+                    {
+                        mqttProxy->SetWill( config.GetMqttPubFeed() + "/availability", "offline" );
+                    }
+
+                    // Door commands need a broker that knows who is 
+                    // publishing, so not without a login
+                    if ( config.GetMqttCommands() == true && config.GetMqttUsername().length() == 0 )
+                    {
+                        Serial.println( "MQTT door commands need an mqtt username, not subscribing" );
+                    }
+                    else if ( config.GetMqttCommands() == true )
+                    {
+                        mqttProxy->OnMessage( handleMqttCommand );
+                        mqttProxy->Subscribe( config.GetMqttPubFeed() + "/door/+/command" );
+                    }
                 }
             }
 
@@ -707,7 +1324,7 @@ void loop()
             {
                 Serial.println( "Starting webserver" );
                 // Allocate and start up
-                webserverProxy.reset( new WebserverProxy( config, garagedoors ) );
+                webserverProxy.reset( new WebserverProxy( config, garagedoors, statusDocument ) );
 
                 webserverProxy->Begin();
             }
@@ -730,28 +1347,28 @@ void loop()
                 discoveryProxy->AddService( "http", "tcp", 80 );
             }
 
+            scheduleNetworkTasks();
+
             activeState = STATE_READY;
             break;
 
         case STATE_READY:
 
-            if ( timeStatus() != timeNotSet )
+            // The web server, OTA, publishing and time sync all run
+            // as scheduled tasks (see scheduleNetworkTasks())
+            if ( wifiConnection.IsConnected() == false )
             {
-                //Serial.printf( "current time: %s\n", timeProxy->GetAscTime().c_str() );
+                // Keep the services, the connection manager brings
+                // the link back and we pick up where we left off
+                networkLed.Blink();
+                activeState = STATE_WIFI_STA_DISCONNECTED;
             }
-
-            //Serial.printf( "current time: %s\n", timeProxy->GetTimeStringUTC().c_str() );
-
-            // Call of the handlers so they can do their thing
-            webserverProxy->Process();
-            firmwareUpdater->Process();
-            
-            // Publish data if needed
-            publish();
-
-            delay( 50 );
             break;
     }
+
+    // Run whatever is due. This idles until the next deadline
+    // when there is nothing to do.
+    scheduler.Process();
 }
 
 
@@ -55,6 +55,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Arduino.h"
 
+#include "doorinputsnapshot.h"
+
+#include "relayactuator.h"
+
 //----------------------------------------------------------------------
 // Type Declarations
 //----------------------------------------------------------------------
@@ -77,7 +81,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // Static Variable Definitions 
 //----------------------------------------------------------------------
 
-// None.
+uint32_t GarageDoor::_latestStateVersion = 0;
 
 //----------------------------------------------------------------------
 // Function Prototypes
@@ -111,9 +115,15 @@ none
 
 ======================================================================*/
 GarageDoor::GarageDoor( int doorSensorGPIO, int relaySensorGPIO )
-    : _doorSensorPin( doorSensorGPIO), _doorRelayPin(relaySensorGPIO)
+    : _doorSensorPin( doorSensorGPIO), _doorRelayPin(relaySensorGPIO),
+      _state( DOOR_UNKNOWN ), _stateSinceMS( millis() ),
+      _lastDirection( DOOR_CLOSING ), _travelTimeMS( DEFAULT_TRAVEL_TIME_MS ),
+      _closingPress( CLOSING_PRESS_REVERSES ),
+      _seenPulses( 0 ), _stateVersion( 0 )
 {
     setupGPIO();
+
+    _seenPulses = RelayActuator::GetPulseCount( _doorRelayPin );
 }
 
 /*======================================================================
@@ -135,8 +145,7 @@ GarageDoor::GarageDoor( const GarageDoor &rhs )
     // Copy state. Note that since the gpio is setup as part of the
     // original object construction, we shouldn't need to call
     // setupgpio() since it's already set the way we want.
-    _doorRelayPin  = rhs._doorRelayPin;
-    _doorSensorPin = rhs._doorSensorPin;
+    copyFrom( rhs );
 }
 
 /*======================================================================
@@ -154,9 +163,36 @@ none
 
 ======================================================================*/
 void GarageDoor::operator=( const GarageDoor &rhs )
+{
+    copyFrom( rhs );
+}
+
+/*======================================================================
+FUNCTION:
+copyFrom()
+
+DESCRIPTION:
+Copies the pins and the state machine from another door
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void GarageDoor::copyFrom( const GarageDoor &rhs )
 {
     _doorRelayPin  = rhs._doorRelayPin;
     _doorSensorPin = rhs._doorSensorPin;
+
+    _state         = rhs._state;
+    _stateSinceMS  = rhs._stateSinceMS;
+    _lastDirection = rhs._lastDirection;
+    _travelTimeMS  = rhs._travelTimeMS;
+    _closingPress  = rhs._closingPress;
+    _seenPulses    = rhs._seenPulses;
+    _stateVersion  = rhs._stateVersion;
 }
 
 /*======================================================================
@@ -175,7 +211,8 @@ none
 ======================================================================*/
 void GarageDoor::setupGPIO()
 {
-   pinMode( _doorRelayPin, OUTPUT );
+   // The actuator owns the relay pin from here on
+   RelayActuator::Register( _doorRelayPin );
 
    // Note - we are using the internal pullups to keep
    // the value from floating. If your micro doesn't have
@@ -189,8 +226,9 @@ FUNCTION:
 Status()
 
 DESCRIPTION:
-Reads the GPIO pin and returns the corresponding value to indicate
-if the door is open/closed
+Returns the debounced sensor value to indicate if the door is 
+open/closed.  The value comes from the shared snapshot for this loop
+pass, so every caller in the same pass sees the same answer.
 
 RETURN VALUE:
 GarageDoor::DoorStatus enumeration indicating if the door is open/closed
@@ -201,9 +239,27 @@ none
 ======================================================================*/
 GarageDoor::DoorStatus GarageDoor::Status() const
 {
-    int state = digitalRead( _doorSensorPin );
+    return DoorInputSnapshot::Current().StatusForPin( _doorSensorPin );
+}
 
-    if ( state == 0 )
+/*======================================================================
+FUNCTION:
+StatusFromLevel()
+
+DESCRIPTION:
+Maps the sensor GPIO level to open/closed.  The reed switch pulls the
+pin low when the door is closed.
+
+RETURN VALUE:
+GarageDoor::DoorStatus enumeration indicating if the door is open/closed
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+GarageDoor::DoorStatus GarageDoor::StatusFromLevel( int level )
+{
+    if ( level == 0 )
     {
         return DoorStatus::CLOSED;
     }
@@ -224,8 +280,12 @@ closes the relay for that about of time.  You will need to set the
 duration accordingly for whatever min/avg time your garage door 
 opener needs to recognize a button press.
 
+The pulse is handed to the RelayActuator, which starts it (or queues 
+it behind an earlier one) and ends it from a timer, so this returns
+right away.  The state machine picks the pulse up when it starts.
+
 RETURN VALUE:
-True if successful.
+True if the pulse was queued.
 
 SIDE EFFECTS:
 none
@@ -233,26 +293,394 @@ none
 ======================================================================*/
 bool GarageDoor::ToogleRelay(int durationMS )
 {
-    // Turn the relay on...
-    digitalWrite( _doorRelayPin, HIGH );
+    return RelayActuator::Pulse( _doorRelayPin, durationMS );
+}
 
-    unsigned long start = millis();
-    unsigned long elapsed = 0;
+/*======================================================================
+FUNCTION:
+Command()
+
+DESCRIPTION:
+Works out where the door will be once any pulses already queued have 
+run, then how many more presses it takes to get it moving toward the
+commanded position, and queues them.  If the door is already there or 
+already headed there, the command is a duplicate and is dropped.
 
-    // Spin until we have elapsed past the duration.
-    do
+RETURN VALUE:
+GarageDoor::CommandResult
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+GarageDoor::CommandResult GarageDoor::Command( DoorCommand command )
+{
+    syncRelayPulses();
+
+    DoorState restState   = ( command == COMMAND_OPEN ) ? DOOR_OPEN : DOOR_CLOSED;
+    DoorState movingState = ( command == COMMAND_OPEN ) ? DOOR_OPENING : DOOR_CLOSING;
+
+    // Play the queued pulses forward to see where we'll be
+    DoorState projected = _state;
+    DoorState direction = _lastDirection;
+
+    int queued = RelayActuator::GetQueuedCount( _doorRelayPin );
+
+    for ( int i = 0; i < queued; i++ )
     {
-        elapsed = millis() - start;
+        projected = nextStateAfterPulse( projected, direction );
+    }
 
-        // Be nice and let others do things while we're doing nothing
-        // but killing time.
-        yield();
+    if ( projected == DOOR_UNKNOWN )
+    {
+        return COMMAND_UNKNOWN_STATE;
+    }
+
+    // Only treat the rest position as "already there" if nothing is 
+    // queued, since queued pulses will move it.
+    if ( projected == restState && queued == 0 )
+    {
+        return COMMAND_ALREADY_THERE;
+    }
 
-    } while ( elapsed <= durationMS );
- 
-    digitalWrite( _doorRelayPin, LOW );
+    if ( projected == movingState || projected == restState )
+    {
+        return COMMAND_IN_PROGRESS;
+    }
+
+    int pulses = 0;
+
+    while ( projected != movingState && pulses < MAX_COMMAND_PULSES )
+    {
+        projected = nextStateAfterPulse( projected, direction );
+        pulses++;
+    }
+
+    if ( projected != movingState ||
+         queued + pulses > RelayActuator::QUEUE_DEPTH )
+    {
+        return COMMAND_BUSY;
+    }
+
+    for ( int i = 0; i < pulses; i++ )
+    {
+        RelayActuator::Pulse( _doorRelayPin );
+    }
+
+    return COMMAND_QUEUED;
+}
+
+/*======================================================================
+FUNCTION:
+syncRelayPulses()
+
+DESCRIPTION:
+Runs the state machine for any relay pulses that have started since
+we last looked.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void GarageDoor::syncRelayPulses()
+{
+    uint32_t pulses = RelayActuator::GetPulseCount( _doorRelayPin );
+
+    // Pulses are at least a gap apart and we look every few ms, so
+    // there is normally only one.  If we fell behind they all get the
+    // last start time, which is close enough.
+    while ( _seenPulses != pulses )
+    {
+        _seenPulses++;
+
+        onRelayPulse( RelayActuator::GetLastPulseMS( _doorRelayPin ) );
+    }
+}
+
+/*======================================================================
+FUNCTION:
+Update()
+
+DESCRIPTION:
+Runs the door state machine against the sensor.  The sensor only sees
+the closed position, so:
+
+  - sensor closed always ends up CLOSED, except right after we pulsed
+    the opener, where the door gets START_GRACE_MS to start moving.
+  - sensor open while we think the door is closed means somebody used
+    the remote, so the door is OPENING.
+  - OPENING becomes OPEN once the travel time has passed.
+  - CLOSING that hasn't reached the sensor well past the travel time 
+    means the door reversed or stopped part way, so STOPPED.
+
+The first call (from DOOR_UNKNOWN) just takes the sensor at face
+value, since we can't know if an open door is still moving.
+
+RETURN VALUE:
+true if the state changed.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool GarageDoor::Update( DoorStatus sensor, unsigned long timestampMS )
+{
+    DoorState previous = _state;
+
+    syncRelayPulses();
+
+    unsigned long elapsed = timestampMS - _stateSinceMS;
+
+    // Readings taken before the current state started (e.g. a queued
+    // sensor event from before a relay pulse) tell us nothing new
+    if ( (long) elapsed < 0 )
+    {
+        elapsed = 0;
+    }
+
+    switch ( _state )
+    {
+        case DOOR_UNKNOWN:
+            setState( sensor == CLOSED ? DOOR_CLOSED : DOOR_OPEN, timestampMS );
+            break;
+
+        case DOOR_CLOSED:
+            if ( sensor == OPEN )
+            {
+                _lastDirection = DOOR_OPENING;
+                setState( DOOR_OPENING, timestampMS );
+            }
+            break;
+
+        case DOOR_OPENING:
+            if ( sensor == CLOSED )
+            {
+                if ( elapsed >= START_GRACE_MS )
+                {
+                    setState( DOOR_CLOSED, timestampMS );
+                }
+            }
+            else if ( elapsed >= _travelTimeMS )
+            {
+                setState( DOOR_OPEN, timestampMS );
+            }
+            break;
+
+        case DOOR_CLOSING:
+            if ( sensor == CLOSED )
+            {
+                setState( DOOR_CLOSED, timestampMS );
+            }
+            else if ( elapsed >= _travelTimeMS + TRAVEL_TOLERANCE_MS )
+            {
+                setState( DOOR_STOPPED, timestampMS );
+            }
+            break;
+
+        case DOOR_OPEN:
+        case DOOR_STOPPED:
+            if ( sensor == CLOSED )
+            {
+                setState( DOOR_CLOSED, timestampMS );
+            }
+            break;
+    }
+
+    return _state != previous;
+}
 
-    return true;
+/*======================================================================
+FUNCTION:
+onRelayPulse()
+
+DESCRIPTION:
+Moves the state machine the way a typical single button opener reacts
+to a press: a resting door starts moving, a moving door stops, and a
+stopped door heads back the other way.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void GarageDoor::onRelayPulse( unsigned long timestampMS )
+{
+    DoorState next = nextStateAfterPulse( _state, _lastDirection );
+
+    if ( next != _state )
+    {
+        setState( next, timestampMS );
+    }
+}
+
+/*======================================================================
+FUNCTION:
+nextStateAfterPulse()
+
+DESCRIPTION:
+The state a door goes to on a button press.  lastDirection is updated
+when the door starts moving.  A press stops an opening door; a press
+on a closing door stops or reverses it, depending on the opener.
+
+RETURN VALUE:
+The new state.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+GarageDoor::DoorState GarageDoor::nextStateAfterPulse( DoorState state, DoorState &lastDirection ) const
+{
+    switch ( state )
+    {
+        case DOOR_CLOSED:
+            lastDirection = DOOR_OPENING;
+            return DOOR_OPENING;
+
+        case DOOR_OPEN:
+            lastDirection = DOOR_CLOSING;
+            return DOOR_CLOSING;
+
+        case DOOR_OPENING:
+            return DOOR_STOPPED;
+
+        case DOOR_CLOSING:
+            if ( _closingPress == CLOSING_PRESS_REVERSES )
+            {
+                lastDirection = DOOR_OPENING;
+                return DOOR_OPENING;
+            }
+
+            return DOOR_STOPPED;
+
+        case DOOR_STOPPED:
+            lastDirection = ( lastDirection == DOOR_OPENING ) ? DOOR_CLOSING : DOOR_OPENING;
+            return lastDirection;
+
+        default:
+            // No idea what the opener will do, wait for the sensor
+            return state;
+    }
+}
+
+/*======================================================================
+FUNCTION:
+setState()
+
+DESCRIPTION:
+Switches to the new state, remembers when it happened and gives it
+the next state version
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void GarageDoor::setState( DoorState state, unsigned long timestampMS )
+{
+    _state        = state;
+    _stateSinceMS = timestampMS;
+    _stateVersion = ++_latestStateVersion;
+}
+
+/*======================================================================
+FUNCTION:
+GetTimeInStateMS()
+
+DESCRIPTION:
+How long the door has been in its current state
+
+RETURN VALUE:
+Milliseconds.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+unsigned long GarageDoor::GetTimeInStateMS() const
+{
+    return millis() - _stateSinceMS;
+}
+
+/*======================================================================
+FUNCTION:
+GetRemainingTravelMS()
+
+DESCRIPTION:
+Estimates how long until a moving door finishes, based on the 
+calibrated travel time.
+
+RETURN VALUE:
+Milliseconds, or 0 if the door isn't moving (or is overdue).
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+unsigned long GarageDoor::GetRemainingTravelMS() const
+{
+    if ( _state != DOOR_OPENING && _state != DOOR_CLOSING )
+    {
+        return 0;
+    }
+
+    unsigned long elapsed = GetTimeInStateMS();
+
+    return ( elapsed < _travelTimeMS ) ? _travelTimeMS - elapsed : 0;
+}
+
+/*======================================================================
+FUNCTION:
+SetTravelTimeMS()
+
+DESCRIPTION:
+Sets how long the door takes to open or close.  Usually comes from
+calibration.  0 puts the default back.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void GarageDoor::SetTravelTimeMS( unsigned long travelTimeMS )
+{
+    _travelTimeMS = ( travelTimeMS > 0 ) ? travelTimeMS : DEFAULT_TRAVEL_TIME_MS;
+}
+
+/*======================================================================
+FUNCTION:
+StateToString()
+
+DESCRIPTION:
+Text version of the door state, used in the status payloads
+
+RETURN VALUE:
+Static string.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+const char *GarageDoor::StateToString( DoorState state )
+{
+    switch ( state )
+    {
+        case DOOR_CLOSED:   return "closed";
+        case DOOR_OPEN:     return "open";
+        case DOOR_OPENING:  return "opening";
+        case DOOR_CLOSING:  return "closing";
+        case DOOR_STOPPED:  return "stopped";
+        default:            return "unknown";
+    }
 }
 
 /*=====================================================================
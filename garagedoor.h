@@ -55,6 +55,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <vector>
 
+#include <stdint.h>
+
 //----------------------------------------------------------------------
 // Type Declarations
 //----------------------------------------------------------------------
@@ -111,6 +113,13 @@ the garage door opener.
 After that, call Status() to determine if the door is open/closed
 and ToggleRelay() to engage the garage door opener.
 
+Each door also runs a small motion state machine.  Since there is only
+one sensor (at the closed position), the transitional states are
+worked out from the sensor, the relay commands we send and how long
+the door takes to travel (from calibration).  Call Update() with the
+sensor status regularly, then State() tells you what the door is
+doing and GetTimeInStateMS() how long it has been doing it.
+
 ======================================================================*/
 class GarageDoor
 {
@@ -120,16 +129,79 @@ class GarageDoor
     // TYPE DECLARATIONS AND CONSTANTS    
     //=================================================================
 
+    // What the sensor says
     enum DoorStatus
     {
         CLOSED = 0,
         OPEN = 1
     };
 
+    // What we think the door is doing
+    enum DoorState
+    {
+        DOOR_UNKNOWN = 0,
+        DOOR_CLOSED,
+        DOOR_OPEN,
+        DOOR_OPENING,
+        DOOR_CLOSING,
+        DOOR_STOPPED
+    };
+
+    // Travel time used until the door has been calibrated
+    static const unsigned long DEFAULT_TRAVEL_TIME_MS = 15000;
+
+    // How long after a relay pulse the sensor has to react before we
+    // decide the opener ignored us
+    static const unsigned long START_GRACE_MS = 3000;
+
+    // Extra time we give a closing door past its travel time before 
+    // deciding it stopped part way
+    static const unsigned long TRAVEL_TOLERANCE_MS = 5000;
+
+    enum DoorCommand
+    {
+        COMMAND_OPEN = 0,
+        COMMAND_CLOSE
+    };
+
+    enum CommandResult
+    {
+        // The relay pulses are queued
+        COMMAND_QUEUED = 0,
+
+        // The door is already where the command wants it
+        COMMAND_ALREADY_THERE,
+
+        // The door is already on its way there (or will be once the
+        // queued pulses run), so the command was dropped
+        COMMAND_IN_PROGRESS,
+
+        // The relay queue is full
+        COMMAND_BUSY,
+
+        // We don't know what the door is doing, so we can't tell how
+        // many presses it takes
+        COMMAND_UNKNOWN_STATE
+    };
+
+    // Most presses it can take to get a door moving the right way
+    // (moving the wrong way -> stopped -> reversed)
+    static const int MAX_COMMAND_PULSES = 3;
+
+    // What the opener does when pressed while the door is closing.
+    // Most residential openers reverse; some just stop.
+    enum ClosingPress
+    {
+        CLOSING_PRESS_REVERSES = 0,
+        CLOSING_PRESS_STOPS
+    };
+
     typedef std::vector<GarageDoor> GarageDoorCollection;
 
     typedef std::vector<DoorStatus> DoorStatusCollection;
 
+    typedef std::vector<DoorState> DoorStateCollection;
+
     //=================================================================
     // CLIENT INTERFACE
     //=================================================================
@@ -144,10 +216,54 @@ class GarageDoor
     // open or closed. 
     DoorStatus Status() const;
 
+    // Maps a raw sensor GPIO level to a door status
+    static DoorStatus StatusFromLevel( int level );
+
+    int GetSensorPin() const { return _doorSensorPin; }
+
+    int GetRelayPin() const { return _doorRelayPin; }
+
     // This will toggle the relay on for the given timeframe
-    // then the relay will toogle off
+    // then the relay will toogle off.  Doesn't block, the pulse is
+    // queued with the relay actuator.
     bool ToogleRelay(int durationMS = 500);
 
+    // Queues however many relay pulses it takes to get the door
+    // moving toward the commanded position.  Duplicate commands are
+    // dropped.
+    CommandResult Command( DoorCommand command );
+
+    // Feeds the sensor status into the state machine.  timestampMS is
+    // when the sensor reading was taken.  Returns true if the state
+    // changed.
+    bool Update( DoorStatus sensor, unsigned long timestampMS );
+
+    DoorState State() const { return _state; }
+
+    static const char *StateToString( DoorState state );
+
+    // millis() when the current state started
+    unsigned long GetStateSinceMS() const { return _stateSinceMS; }
+
+    unsigned long GetTimeInStateMS() const;
+
+    // While opening/closing, roughly how long until the door gets
+    // there.  0 otherwise.
+    unsigned long GetRemainingTravelMS() const;
+
+    void SetTravelTimeMS( unsigned long travelTimeMS );
+    unsigned long GetTravelTimeMS() const { return _travelTimeMS; }
+
+    void SetClosingPress( ClosingPress closingPress ) { _closingPress = closingPress; }
+    ClosingPress GetClosingPress() const { return _closingPress; }
+
+    // Every state change of any door takes the next number from one
+    // counter, so a client that remembers the latest version it saw
+    // can tell if anything changed since.  0 means no change yet.
+    uint32_t GetStateVersion() const { return _stateVersion; }
+
+    static uint32_t GetLatestStateVersion() { return _latestStateVersion; }
+
     protected:
 
     //=================================================================
@@ -170,12 +286,43 @@ class GarageDoor
 
     void setupGPIO();
 
+    void copyFrom( const GarageDoor &rhs );
+
+    // Moves the state machine in response to a relay pulse
+    void onRelayPulse( unsigned long timestampMS );
+
+    // Applies any relay pulses that started since the last call
+    void syncRelayPulses();
+
+    // What a single button opener does on a press
+    DoorState nextStateAfterPulse( DoorState state, DoorState &lastDirection ) const;
+
+    void setState( DoorState state, unsigned long timestampMS );
+
     //=================================================================
     // DATA MEMBERS    
     //=================================================================
 
     int _doorSensorPin;
     int _doorRelayPin;
+
+    DoorState     _state;
+    unsigned long _stateSinceMS;
+
+    // Direction of the last move, so we know which way a stopped 
+    // door goes on the next pulse
+    DoorState     _lastDirection;
+
+    unsigned long _travelTimeMS;
+
+    ClosingPress  _closingPress;
+
+    // Relay pulses the state machine has already accounted for
+    uint32_t      _seenPulses;
+
+    uint32_t      _stateVersion;
+
+    static uint32_t _latestStateVersion;
 };
 
 //======================================================================
@@ -0,0 +1,340 @@
+/*======================================================================
+FILE:
+httpresponse.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Builds a whole HTTP response (status line, headers and body) in one 
+fixed buffer and sends it with a single write.
+
+PUBLIC CLASSES AND FUNCTIONS:
+HttpResponse
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+Begin() before anything else.
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "httpresponse.h"
+
+#include "Arduino.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// Every response tells the client not to cache it
+static const char FIXED_HEADERS[] =
+    "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+    "Pragma: no-cache\r\n"
+    "Expires: -1\r\n";
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+HttpResponse()
+
+DESCRIPTION:
+C-tor
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+HttpResponse::HttpResponse()
+    : _headerLength( 0 ), _bodyLength( 0 ), _overflowed( false )
+{
+}
+
+/*======================================================================
+FUNCTION:
+Begin()
+
+DESCRIPTION:
+Throws away whatever was there and writes the status line, the fixed
+headers and the content type.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void HttpResponse::Begin( int code, const char *contentType )
+{
+    _headerLength = 0;
+    _bodyLength   = 0;
+    _overflowed   = false;
+
+    putHeader( "HTTP/1.1 " );
+    putHeader( code );
+    putHeader( " " );
+    putHeader( reasonPhrase( code ) );
+    putHeader( "\r\n" );
+
+    putHeader( FIXED_HEADERS, sizeof( FIXED_HEADERS ) - 1 );
+
+    AddHeader( "Content-Type", contentType );
+}
+
+/*======================================================================
+FUNCTION:
+AddHeader()
+
+DESCRIPTION:
+Adds a header line
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void HttpResponse::AddHeader( const char *name, const char *value )
+{
+    putHeader( name );
+    putHeader( ": " );
+    putHeader( value );
+    putHeader( "\r\n" );
+}
+
+void HttpResponse::AddHeader( const char *name, unsigned long value )
+{
+    putHeader( name );
+    putHeader( ": " );
+    putHeader( value );
+    putHeader( "\r\n" );
+}
+
+/*======================================================================
+FUNCTION:
+write()
+
+DESCRIPTION:
+Print interface.  Appends to the body.
+
+RETURN VALUE:
+Bytes taken, 0 once the buffer is full.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+size_t HttpResponse::write( uint8_t c )
+{
+    return write( &c, 1 );
+}
+
+size_t HttpResponse::write( const uint8_t *data, size_t length )
+{
+    if ( HEADER_SPACE + _bodyLength + length > BUFFER_SIZE )
+    {
+        _overflowed = true;
+        return 0;
+    }
+
+    memcpy( &_buffer[HEADER_SPACE + _bodyLength], data, length );
+    _bodyLength += length;
+
+    return length;
+}
+
+/*======================================================================
+FUNCTION:
+Send()
+
+DESCRIPTION:
+Adds the Connection and Content-Length headers and the blank line, 
+moves the headers up to meet the body and writes it all out at once.
+
+RETURN VALUE:
+true if the client took all of it.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool HttpResponse::Send( Client &client, bool keepAlive )
+{
+    if ( true == _overflowed )
+    {
+        Serial.println( "HttpResponse: response too large" );
+
+        Begin( 500, "text/plain" );
+        print( "response too large" );
+    }
+
+    putHeader( ( true == keepAlive ) ? "Connection: keep-alive\r\n" : "Connection: close\r\n" );
+
+    putHeader( "Content-Length: " );
+    putHeader( (unsigned long) _bodyLength );
+    putHeader( "\r\n\r\n" );
+
+    char *start = &_buffer[HEADER_SPACE - _headerLength];
+
+    memmove( start, _buffer, _headerLength );
+
+    size_t length = _headerLength + _bodyLength;
+
+    return client.write( (const uint8_t *) start, length ) == length;
+}
+
+/*======================================================================
+FUNCTION:
+putHeader()
+
+DESCRIPTION:
+Appends to the header area
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void HttpResponse::putHeader( const char *text, size_t length )
+{
+    if ( _headerLength + length > HEADER_SPACE )
+    {
+        _overflowed = true;
+        return;
+    }
+
+    memcpy( &_buffer[_headerLength], text, length );
+    _headerLength += length;
+}
+
+void HttpResponse::putHeader( const char *text )
+{
+    putHeader( text, strlen( text ) );
+}
+
+void HttpResponse::putHeader( unsigned long value )
+{
+    // 4294967295 is 10 digits
+    char digits[10];
+    int  n = sizeof( digits );
+
+    do
+    {
+        digits[--n] = '0' + ( value % 10 );
+        value /= 10;
+
+    } while ( value > 0 );
+
+    putHeader( &digits[n], sizeof( digits ) - n );
+}
+
+/*======================================================================
+FUNCTION:
+reasonPhrase()
+
+DESCRIPTION:
+The text for the status codes we send
+
+RETURN VALUE:
+Reason phrase.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+const char *HttpResponse::reasonPhrase( int code )
+{
+    switch ( code )
+    {
+        case 200: return "OK";
+        case 202: return "Accepted";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 404: return "Not Found";
+        case 409: return "Conflict";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default:  return "";
+    }
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
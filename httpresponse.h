@@ -0,0 +1,221 @@
+#ifndef _GARAGEOMATIC_HTTPRESPONSE_H_
+#define _GARAGEOMATIC_HTTPRESPONSE_H_
+
+/*======================================================================
+FILE:
+httpresponse.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Builds a whole HTTP response (status line, headers and body) in one 
+fixed buffer and sends it with a single write.
+
+PUBLIC CLASSES AND FUNCTIONS:
+HttpResponse
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <Client.h>
+#include <Print.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// Add the headers before writing any of the body.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+HttpResponse
+
+DESCRIPTION:
+The headers are written into the front of the buffer and the body 
+after a fixed gap, so the body can be written (it is a Print, so 
+print() and JsonWriter work) before its length is known.  Send() adds
+the Content-Length, slides the headers up against the body and sends
+the lot in one write, which usually means one TCP segment.  The
+no-cache headers every response carries are one precomposed block.
+
+Nothing is allocated.  A response that doesn't fit goes out as a 500
+instead.
+
+HOW TO USE:
+1. Begin() with the status code and content type.
+2. AddHeader() any extra headers.
+3. print() the body.
+4. Send().
+
+======================================================================*/
+class HttpResponse : public Print
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    // One full size TCP segment
+    static const size_t BUFFER_SIZE = 1460;
+
+    // Room for the status line and headers
+    static const size_t HEADER_SPACE = 320;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    HttpResponse();
+
+    // Starts a new response
+    void Begin( int code, const char *contentType );
+
+    void AddHeader( const char *name, const char *value );
+    void AddHeader( const char *name, unsigned long value );
+
+    // The body
+    size_t write( uint8_t c ) override;
+    size_t write( const uint8_t *data, size_t length ) override;
+
+    using Print::write;
+
+    // Finishes the headers and sends the response.  keepAlive says
+    // if the server leaves the connection open afterwards.
+    bool Send( Client &client, bool keepAlive = false );
+
+    bool Overflowed() const { return _overflowed; }
+
+    size_t GetBodyLength() const { return _bodyLength; }
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    void putHeader( const char *text, size_t length );
+    void putHeader( const char *text );
+    void putHeader( unsigned long value );
+
+    static const char *reasonPhrase( int code );
+
+    // No copying. Leaving the implementation undefined to cause a link
+    // error
+    HttpResponse( const HttpResponse &rhs );
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    char   _buffer[BUFFER_SIZE];
+
+    size_t _headerLength;
+    size_t _bodyLength;
+
+    bool   _overflowed;
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+// None.
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+Buffer layout while building:
+
+    | status + headers ... gap | body ...                 |
+    0                          HEADER_SPACE               BUFFER_SIZE
+
+and as sent:
+
+    | gap | status + headers + Content-Length | body ...  |
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_HTTPRESPONSE_H_
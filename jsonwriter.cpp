@@ -0,0 +1,581 @@
+/*======================================================================
+FILE:
+jsonwriter.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Streaming JSON writer.  Writes a document straight into a caller 
+supplied buffer, or out to any Print (a socket, Serial...), without 
+building it up in Strings first.
+
+PUBLIC CLASSES AND FUNCTIONS:
+JsonWriter
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+None.
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "jsonwriter.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+JsonWriter()
+
+DESCRIPTION:
+C-tor for a writer that only counts
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+JsonWriter::JsonWriter()
+    : _buffer( nullptr ), _size( 0 ), _out( nullptr ), _chunkLength( 0 ),
+      _length( 0 ), _overflowed( false ), _hasItems( 0 ), _depth( 0 ),
+      _afterKey( false )
+{
+}
+
+/*======================================================================
+FUNCTION:
+JsonWriter( buffer )
+
+DESCRIPTION:
+C-tor for a writer into a buffer.  One byte of the buffer is kept for
+the NUL.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+JsonWriter::JsonWriter( char *buffer, size_t size )
+    : _buffer( buffer ), _size( size ), _out( nullptr ), _chunkLength( 0 ),
+      _length( 0 ), _overflowed( false ), _hasItems( 0 ), _depth( 0 ),
+      _afterKey( false )
+{
+    if ( _size > 0 )
+    {
+        _buffer[0] = 0;
+    }
+    else
+    {
+        _overflowed = true;
+    }
+}
+
+/*======================================================================
+FUNCTION:
+JsonWriter( out )
+
+DESCRIPTION:
+C-tor for a writer to a Print
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+JsonWriter::JsonWriter( Print &out )
+    : _buffer( nullptr ), _size( 0 ), _out( &out ), _chunkLength( 0 ),
+      _length( 0 ), _overflowed( false ), _hasItems( 0 ), _depth( 0 ),
+      _afterKey( false )
+{
+}
+
+/*======================================================================
+FUNCTION:
+BeginObject()/EndObject()/BeginArray()/EndArray()
+
+DESCRIPTION:
+Open and close containers
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void JsonWriter::BeginObject()
+{
+    begin( '{' );
+}
+
+void JsonWriter::EndObject()
+{
+    end( '}' );
+}
+
+void JsonWriter::BeginArray()
+{
+    begin( '[' );
+}
+
+void JsonWriter::EndArray()
+{
+    end( ']' );
+}
+
+/*======================================================================
+FUNCTION:
+Key()
+
+DESCRIPTION:
+Writes an object member's name and the colon
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void JsonWriter::Key( const char *name )
+{
+    separate();
+    writeString( name );
+    write( ':' );
+
+    _afterKey = true;
+}
+
+/*======================================================================
+FUNCTION:
+Value( const char * )
+
+DESCRIPTION:
+Writes a string value
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void JsonWriter::Value( const char *value )
+{
+    if ( value == nullptr )
+    {
+        Null();
+        return;
+    }
+
+    separate();
+    writeString( value );
+}
+
+/*======================================================================
+FUNCTION:
+Value( bool )
+
+DESCRIPTION:
+Writes true or false
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void JsonWriter::Value( bool value )
+{
+    separate();
+
+    if ( true == value )
+    {
+        write( "true", 4 );
+    }
+    else
+    {
+        write( "false", 5 );
+    }
+}
+
+/*======================================================================
+FUNCTION:
+Null()
+
+DESCRIPTION:
+Writes null
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void JsonWriter::Null()
+{
+    separate();
+    write( "null", 4 );
+}
+
+/*======================================================================
+FUNCTION:
+Flush()
+
+DESCRIPTION:
+Hands whatever has been gathered to the Print sink
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void JsonWriter::Flush()
+{
+    if ( _out != nullptr && _chunkLength > 0 )
+    {
+        _out->write( (const uint8_t *) _chunk, _chunkLength );
+        _chunkLength = 0;
+    }
+}
+
+/*======================================================================
+FUNCTION:
+separate()
+
+DESCRIPTION:
+Every item but the first in a container gets a comma in front of it.
+A value right after its key doesn't.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void JsonWriter::separate()
+{
+    if ( true == _afterKey )
+    {
+        _afterKey = false;
+        return;
+    }
+
+    if ( _depth == 0 || _depth > MAX_DEPTH )
+    {
+        return;
+    }
+
+    uint16_t bit = 1 << ( _depth - 1 );
+
+    if ( ( _hasItems & bit ) != 0 )
+    {
+        write( ',' );
+    }
+
+    _hasItems |= bit;
+}
+
+/*======================================================================
+FUNCTION:
+begin()/end()
+
+DESCRIPTION:
+Open and close a container, one level of comma tracking each
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void JsonWriter::begin( char bracket )
+{
+    separate();
+    write( bracket );
+
+    _depth++;
+
+    if ( _depth <= MAX_DEPTH )
+    {
+        _hasItems &= ~( 1 << ( _depth - 1 ) );
+    }
+}
+
+void JsonWriter::end( char bracket )
+{
+    if ( _depth > 0 )
+    {
+        _depth--;
+    }
+
+    write( bracket );
+}
+
+/*======================================================================
+FUNCTION:
+writeString()
+
+DESCRIPTION:
+Writes a quoted string.  Quotes, backslashes and control characters 
+are escaped; everything else (including UTF-8) goes through as is.  
+Runs that need no escaping are written in one go.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void JsonWriter::writeString( const char *value )
+{
+    write( '"' );
+
+    const char *run = value;
+
+    for ( const char *p = value; *p != 0; p++ )
+    {
+        unsigned char c = *p;
+
+        if ( c >= 0x20 && c != '"' && c != '\\' )
+        {
+            continue;
+        }
+
+        write( run, p - run );
+        run = p + 1;
+
+        switch ( c )
+        {
+            case '"':  write( "\\\"", 2 ); break;
+            case '\\': write( "\\\\", 2 ); break;
+            case '\n': write( "\\n", 2 );  break;
+            case '\r': write( "\\r", 2 );  break;
+            case '\t': write( "\\t", 2 );  break;
+
+            default:
+            {
+                char escape[6] = { '\\', 'u', '0', '0', HEX_DIGITS[c >> 4], HEX_DIGITS[c & 0x0F] };
+                write( escape, sizeof( escape ) );
+            }
+                break;
+        }
+    }
+
+    write( run, strlen( run ) );
+    write( '"' );
+}
+
+/*======================================================================
+FUNCTION:
+writeUnsigned()
+
+DESCRIPTION:
+Writes the number's digits.  No printf, so no format parsing.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void JsonWriter::writeUnsigned( uint32_t value )
+{
+    separate();
+
+    // 4294967295 is 10 digits
+    char digits[10];
+    int  n = sizeof( digits );
+
+    do
+    {
+        digits[--n] = '0' + ( value % 10 );
+        value /= 10;
+
+    } while ( value > 0 );
+
+    write( &digits[n], sizeof( digits ) - n );
+}
+
+/*======================================================================
+FUNCTION:
+writeSigned()
+
+DESCRIPTION:
+Writes the number's digits, with a minus sign if it needs one
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void JsonWriter::writeSigned( int32_t value )
+{
+    if ( value >= 0 )
+    {
+        writeUnsigned( value );
+        return;
+    }
+
+    separate();
+    write( '-' );
+
+    // The comma (if any) is already out
+    _afterKey = true;
+
+    // Negate as unsigned so INT32_MIN works
+    writeUnsigned( 0u - (uint32_t) value );
+}
+
+/*======================================================================
+FUNCTION:
+write()
+
+DESCRIPTION:
+Sends bytes to the sink.  Length counts everything, even what didn't
+fit, so a caller can size a buffer from a failed attempt.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void JsonWriter::write( const char *data, size_t length )
+{
+    _length += length;
+
+    if ( _buffer != nullptr )
+    {
+        if ( true == _overflowed )
+        {
+            return;
+        }
+
+        size_t used = _length - length;
+
+        if ( used + length + 1 > _size )
+        {
+            // Leave the buffer holding what did fit, terminated
+            _overflowed = true;
+            return;
+        }
+
+        memcpy( &_buffer[used], data, length );
+        _buffer[used + length] = 0;
+    }
+    else if ( _out != nullptr )
+    {
+        while ( length > 0 )
+        {
+            size_t room = CHUNK_SIZE - _chunkLength;
+            size_t n = ( length < room ) ? length : room;
+
+            memcpy( &_chunk[_chunkLength], data, n );
+            _chunkLength += n;
+
+            data   += n;
+            length -= n;
+
+            if ( _chunkLength == CHUNK_SIZE )
+            {
+                Flush();
+            }
+        }
+    }
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
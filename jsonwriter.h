@@ -0,0 +1,250 @@
+#ifndef _GARAGEOMATIC_JSONWRITER_H_
+#define _GARAGEOMATIC_JSONWRITER_H_
+
+/*======================================================================
+FILE:
+jsonwriter.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Streaming JSON writer.  Writes a document straight into a caller 
+supplied buffer, or out to any Print (a socket, Serial...), without 
+building it up in Strings first.
+
+PUBLIC CLASSES AND FUNCTIONS:
+JsonWriter
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <Print.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// With a Print sink, call Flush() once the document is done.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+JsonWriter
+
+DESCRIPTION:
+Writes JSON a token at a time, keeping track of the commas itself.
+Nothing is allocated, and each token is written once, so the cost is 
+linear in the size of the document.
+
+There are three sinks:
+  - a buffer: the document is kept NUL terminated.  If it doesn't fit,
+    writing stops and Overflowed() says so.
+  - a Print: output is gathered into small chunks so a socket doesn't
+    get a packet per token.
+  - none: nothing is written, but Length() still counts, which is 
+    handy for a Content-Length before streaming the real thing.
+
+HOW TO USE:
+1. Construct over a sink.
+2. BeginObject(), Key()/Value()..., EndObject().
+3. Check Overflowed() (buffer) or call Flush() (Print).
+
+======================================================================*/
+class JsonWriter
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    // Deepest nesting of objects/arrays we track commas for
+    static const uint8_t MAX_DEPTH = 16;
+
+    // Bytes gathered before writing to a Print sink
+    static const uint8_t CHUNK_SIZE = 64;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    // Counts only
+    JsonWriter();
+
+    JsonWriter( char *buffer, size_t size );
+
+    JsonWriter( Print &out );
+
+    void BeginObject();
+    void EndObject();
+
+    void BeginArray();
+    void EndArray();
+
+    // An object member's name.  The value goes next.
+    void Key( const char *name );
+
+    // Escaped as needed.  nullptr writes null.
+    void Value( const char *value );
+
+    // The fundamental types rather than uint32_t and friends, which
+    // alias one of these depending on the toolchain
+    void Value( unsigned int value ) { writeUnsigned( value ); }
+    void Value( unsigned long value ) { writeUnsigned( value ); }
+    void Value( int value ) { writeSigned( value ); }
+    void Value( long value ) { writeSigned( value ); }
+
+    void Value( bool value );
+
+    void Null();
+
+    // Writes out anything gathered for a Print sink
+    void Flush();
+
+    // Length of the whole document, including anything that didn't
+    // fit the buffer
+    size_t Length() const { return _length; }
+
+    bool Overflowed() const { return _overflowed; }
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    // Writes the comma in front of a value or key, if it needs one
+    void separate();
+
+    void begin( char bracket );
+    void end( char bracket );
+
+    void writeString( const char *value );
+
+    void writeUnsigned( uint32_t value );
+    void writeSigned( int32_t value );
+
+    void write( const char *data, size_t length );
+    void write( char c ) { write( &c, 1 ); }
+
+    // No copying. Leaving the implementation undefined to cause a link
+    // error
+    JsonWriter( const JsonWriter &rhs );
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    char  *_buffer;
+    size_t _size;
+
+    Print *_out;
+    char   _chunk[CHUNK_SIZE];
+    uint8_t _chunkLength;
+
+    size_t _length;
+    bool   _overflowed;
+
+    // Bit per depth, set once the container there has an item
+    uint16_t _hasItems;
+    uint8_t  _depth;
+
+    // The next value belongs to a key, so it takes no comma
+    bool _afterKey;
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+// None.
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+None.
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_JSONWRITER_H_
@@ -7,7 +7,8 @@ Sean Foley
 
 GENERAL DESCRIPTION:
 Helper class that does some simple animation for an LED hooked
-up to a micro GPIO pin.
+up to a micro GPIO pin.  Animations are played by a small pattern
+engine that is ticked from the main loop, so callers never block.
 
 PUBLIC CLASSES AND FUNCTIONS:
 LedHelper
@@ -95,7 +96,7 @@ FUNCTION:
 TurnOn()
 
 DESCRIPTION:
-Turns the LED on
+Turns the LED on and stops any pattern that is playing.
 
 RETURN VALUE:
 none.
@@ -106,14 +107,9 @@ none
 ======================================================================*/
 void LedHelper::TurnOn() 
 {
-    uint8_t value = HIGH;
+    _playing = false;
 
-    if ( true == _invertLogicLevel )
-    {
-        value = !value;
-    }
-
-    digitalWrite( _gpio, value );
+    write( true );
 }
 
 /*======================================================================
@@ -121,7 +117,7 @@ FUNCTION:
 TurnOff()
 
 DESCRIPTION:
-Turns the LED off.
+Turns the LED off and stops any pattern that is playing.
 
 RETURN VALUE:
 none.
@@ -132,14 +128,9 @@ none
 ======================================================================*/
 void LedHelper::TurnOff() 
 {
-    uint8_t value = LOW;
-
-    if ( true == _invertLogicLevel )
-    {
-        value = !value;
-    }
+    _playing = false;
 
-    digitalWrite( _gpio, value );
+    write( false );
 }
 
 /*======================================================================
@@ -147,10 +138,11 @@ FUNCTION:
 Toggle()
 
 DESCRIPTION:
-This will either turn the LED on/off based on it's previous state
+This will either turn the LED on/off based on it's previous state.
+Any pattern that is playing is stopped.
 
 RETURN VALUE:
-The resulting on or off state after the toggle
+The resulting on (1) or off (0) state after the toggle
 
 SIDE EFFECTS:
 none
@@ -158,12 +150,11 @@ none
 ======================================================================*/
 int LedHelper::Toggle() 
 {
-    // Read the current state and flip it
-    int state = !digitalRead( _gpio );
+    _playing = false;
 
-    digitalWrite( _gpio, state );
+    write( !_on );
 
-    return state;
+    return _on ? 1 : 0;
 }
 
 /*======================================================================
@@ -171,8 +162,9 @@ FUNCTION:
 Flash()
 
 DESCRIPTION:
-Flashes the LED. The LED will be ON for durationMS/2, and off 
-for the other half of the duration.
+Flashes the LED once. The LED will be ON for durationMS/2, and off 
+for the other half of the duration.  This used to spin for the whole
+duration; it now just starts a one-shot pattern.
 
 RETURN VALUE:
 none.
@@ -183,25 +175,272 @@ none
 ======================================================================*/
 void LedHelper::Flash( const int durationMS ) 
 {
-    unsigned int waitcycle = durationMS / 2;
+    Blink( durationMS, 1 );
+}
+
+/*======================================================================
+FUNCTION:
+Blink()
+
+DESCRIPTION:
+Even on/off blinking.  Each blink is on for periodMS/2 and off for
+periodMS/2.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void LedHelper::Blink( const unsigned int periodMS, const int repeat )
+{
+    const uint16_t half = periodMS / 2;
+
+    const uint16_t steps[] = { half, half };
+
+    play( steps, 2, repeat, true );
+}
+
+/*======================================================================
+FUNCTION:
+Heartbeat()
+
+DESCRIPTION:
+Plays a "lub-dub" heartbeat - two short flashes followed by a pause,
+repeating forever.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void LedHelper::Heartbeat()
+{
+    const uint16_t steps[] = { 100, 100, 100, 700 };
 
-    // Flip/flop for 2 cycles
-    for( int i = 0; i < 2; i++ )
+    play( steps, 4, REPEAT_FOREVER, true );
+}
+
+/*======================================================================
+FUNCTION:
+WigWag()
+
+DESCRIPTION:
+Alternates this LED with the partner LED.  Both LEDs play the same
+steps from the same start time, with the partner starting off, so 
+they stay in lock step as long as both are ticked.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+The partner LED's pattern is replaced.
+
+======================================================================*/
+void LedHelper::WigWag( LedHelper &partner, const unsigned int stepMS, const int cycles )
+{
+    const uint16_t steps[] = { (uint16_t) stepMS, (uint16_t) stepMS };
+
+    play( steps, 2, cycles, true );
+    partner.play( steps, 2, cycles, false );
+
+    partner._stepStart = _stepStart;
+}
+
+/*======================================================================
+FUNCTION:
+ErrorCode()
+
+DESCRIPTION:
+Blinks out an error code: code short flashes then a long pause, 
+repeating forever.  Codes bigger than the pattern can hold are 
+clamped.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void LedHelper::ErrorCode( uint8_t code )
+{
+    const uint16_t FLASH_MS = 200;
+    const uint16_t PAUSE_MS = 1500;
+
+    uint16_t steps[MAX_STEPS];
+
+    if ( code == 0 )
     {
-        unsigned long start = millis();
-        Toggle();
+        code = 1;
+    }
 
-        while ( true )
-        {
-            unsigned long stop = millis();
+    if ( code > MAX_STEPS / 2 )
+    {
+        code = MAX_STEPS / 2;
+    }
 
-            unsigned long elapsed = stop - start;
+    uint8_t count = 0;
 
-            if ( elapsed >= waitcycle ) { break; }
+    for ( uint8_t i = 0; i < code; i++ )
+    {
+        steps[count++] = FLASH_MS;
+        steps[count++] = FLASH_MS;
+    }
 
-            yield();
+    // Stretch the last off step into the pause between codes
+    steps[count - 1] = PAUSE_MS;
+
+    play( steps, count, REPEAT_FOREVER, true );
+}
+
+/*======================================================================
+FUNCTION:
+Stop()
+
+DESCRIPTION:
+Stops the current pattern and turns the LED off.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void LedHelper::Stop()
+{
+    TurnOff();
+}
+
+/*======================================================================
+FUNCTION:
+Process()
+
+DESCRIPTION:
+Ticks the pattern engine.  If the current step's time is up we move
+to the next step (and the next repeat when we run off the end).  When
+the last repeat finishes the LED is left off.  This is one millis()
+compare on most calls.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void LedHelper::Process()
+{
+    if ( false == _playing )
+    {
+        return;
+    }
+
+    unsigned long now = millis();
+
+    // A slow tick can cover more than one short step
+    while ( now - _stepStart >= _steps[_stepIndex] )
+    {
+        _stepStart += _steps[_stepIndex];
+        _stepIndex++;
+
+        if ( _stepIndex >= _stepCount )
+        {
+            _stepIndex = 0;
+
+            if ( _repeat != REPEAT_FOREVER && --_repeat <= 0 )
+            {
+                TurnOff();
+                return;
+            }
         }
     }
+
+    // Even steps are "on" when the pattern starts on
+    bool on = ( ( _stepIndex % 2 ) == 0 ) == _startOn;
+
+    if ( on != _on )
+    {
+        write( on );
+    }
+}
+
+/*======================================================================
+FUNCTION:
+play()
+
+DESCRIPTION:
+Loads a pattern into the engine and lights the LED for the first step.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void LedHelper::play( const uint16_t *steps, uint8_t count, int repeat, bool startOn )
+{
+    if ( count > MAX_STEPS )
+    {
+        count = MAX_STEPS;
+    }
+
+    _stepCount = 0;
+
+    for ( uint8_t i = 0; i < count; i++ )
+    {
+        // A zero length step would never end, so make it 1ms
+        _steps[i] = steps[i] > 0 ? steps[i] : 1;
+        _stepCount++;
+    }
+
+    if ( 0 == _stepCount || 0 == repeat )
+    {
+        TurnOff();
+        return;
+    }
+
+    _stepIndex = 0;
+    _repeat    = repeat;
+    _startOn   = startOn;
+    _stepStart = millis();
+    _playing   = true;
+
+    write( startOn );
+}
+
+/*======================================================================
+FUNCTION:
+write()
+
+DESCRIPTION:
+Drives the GPIO pin, flipping the level if the LED is wired active
+low.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void LedHelper::write( bool on )
+{
+    _on = on;
+
+    uint8_t value = on ? HIGH : LOW;
+
+    if ( true == _invertLogicLevel )
+    {
+        value = !value;
+    }
+
+    digitalWrite( _gpio, value );
 }
 
 /*=====================================================================
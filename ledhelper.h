@@ -10,7 +10,8 @@ Sean Foley
 
 DESCRIPTION:
 Helper class that does some simple animation for an LED hooked 
-up to a micro GPIO pin.
+up to a micro GPIO pin.  Animations are played by a small pattern
+engine that is ticked from the main loop, so callers never block.
 
 PUBLIC CLASSES AND FUNCTIONS:
 LedHelper
@@ -99,10 +100,17 @@ DESCRIPTION:
 Helper class that does some simple animation for an LED hooked
 up to a micro GPIO pin.
 
+A pattern is a list of step durations.  The LED alternates on/off at
+each step, and the list repeats a given number of times (or forever).
+Nothing in here waits; Process() checks if the current step is over
+and moves to the next one.
+
 HOW TO USE:
 Construct the object with the GPIO pin and logic level.   
 
-Then call the various methods to control the Led.
+Then call the various methods to control the Led, and call Process()
+every few milliseconds (e.g. from a scheduled task) to run the 
+animations.
 
 ======================================================================*/
 class LedHelper
@@ -113,7 +121,11 @@ class LedHelper
     // TYPE DECLARATIONS AND CONSTANTS    
     //=================================================================
 
-    // None.
+    // Pass as the repeat count to play a pattern until told otherwise
+    static const int REPEAT_FOREVER = -1;
+
+    // Longest pattern (in on/off steps) we can hold
+    static const uint8_t MAX_STEPS = 20;
 
     //=================================================================
     // CLIENT INTERFACE
@@ -121,6 +133,7 @@ class LedHelper
 
     LedHelper( const uint8_t gpio, bool invertLogicLevel = true );
 
+    // These set a steady state and stop any pattern that is playing
     void TurnOn();
     void TurnOff();
 
@@ -128,9 +141,31 @@ class LedHelper
     // and if it is on, it turns off.
     int Toggle();
 
-    // This will flash the LED for the given duration in milliseconds
+    // This will flash the LED once over the given duration in 
+    // milliseconds.  Returns right away.
     void Flash( const int durationMS = 500 );
 
+    // Even on/off blinking with the given period
+    void Blink( const unsigned int periodMS = 500, const int repeat = REPEAT_FOREVER );
+
+    // Two quick flashes then a pause.  Used to show we are alive.
+    void Heartbeat();
+
+    // Alternates this LED and the partner LED, one on while the 
+    // other is off, stepMS at a time for the given number of cycles.
+    void WigWag( LedHelper &partner, const unsigned int stepMS = 50, const int cycles = 50 );
+
+    // Blinks the code out (e.g. 3 blinks then a long pause) forever
+    void ErrorCode( uint8_t code );
+
+    // Stops the current pattern and turns the LED off
+    void Stop();
+
+    bool IsPlaying() const { return _playing; }
+
+    // Advances the current pattern.  Call this every few ms.
+    void Process();
+
     protected:
 
     //=================================================================
@@ -151,7 +186,12 @@ class LedHelper
     // IMPLEMENTATION INTERFACE    
     //=================================================================
 
-    // None.
+    // Starts playing the steps.  startOn says if the first step
+    // lights the LED.
+    void play( const uint16_t *steps, uint8_t count, int repeat, bool startOn );
+
+    // Drives the GPIO, taking the logic level into account
+    void write( bool on );
 
     //=================================================================
     // DATA MEMBERS    
@@ -160,6 +200,17 @@ class LedHelper
     uint8_t _gpio;
     bool _invertLogicLevel;
 
+    // Current LED state (true == lit)
+    bool _on;
+
+    // Pattern engine state
+    bool          _playing;
+    bool          _startOn;
+    uint16_t      _steps[MAX_STEPS];
+    uint8_t       _stepCount;
+    uint8_t       _stepIndex;
+    int           _repeat;
+    unsigned long _stepStart;
 };
 
 //======================================================================
@@ -168,7 +219,9 @@ class LedHelper
 
 // C-tor
 inline LedHelper::LedHelper( const uint8_t gpio, bool invertLogicLevel ) 
-    : _gpio( gpio ), _invertLogicLevel( invertLogicLevel )
+    : _gpio( gpio ), _invertLogicLevel( invertLogicLevel ), _on( false ),
+      _playing( false ), _startOn( true ), _stepCount( 0 ), _stepIndex( 0 ),
+      _repeat( 0 ), _stepStart( 0 )
 { 
     pinMode( _gpio, OUTPUT );
 }
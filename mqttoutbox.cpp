@@ -0,0 +1,637 @@
+/*======================================================================
+FILE:
+mqttoutbox.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Store and forward queue for MQTT messages the broker couldn't take.
+Messages are appended to a file on the flash file system, so a door
+change made while the broker is down (or across a reboot) still gets
+published, in order, once the broker is back.
+
+PUBLIC CLASSES AND FUNCTIONS:
+MqttOutbox
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+Begin() must be called before anything is queued.
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "mqttoutbox.h"
+
+#include "Arduino.h"
+
+// Flash file system support
+#include <FS.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// SPIFFS names are limited to 31 characters
+static const char *OUTBOX_FILENAME = "/mqttoutbox.bin";
+static const char *HEAD_FILENAME   = "/mqttoutbox.hd";
+static const char *TEMP_FILENAME   = "/mqttoutbox.tmp";
+
+// Each record starts with its length
+static const uint32_t RECORD_HEADER_BYTES = 2;
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+MqttOutbox()
+
+DESCRIPTION:
+C-tor
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+MqttOutbox::MqttOutbox() : _head( 0 ), _tail( 0 ), _count( 0 ), _dropped( 0 )
+{
+}
+
+/*======================================================================
+FUNCTION:
+Begin()
+
+DESCRIPTION:
+Finds the messages left queued before a reboot.  The records from the
+saved head offset on are walked to count them; a record cut short (we
+lost power while appending it) ends the queue and is cut off.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+data in the flash file system may be modified
+
+======================================================================*/
+void MqttOutbox::Begin()
+{
+    // Harmless if the file system is already up
+    SPIFFS.begin();
+
+    _head  = 0;
+    _tail  = 0;
+    _count = 0;
+
+    recoverCompaction();
+
+    File headFile = SPIFFS.open( HEAD_FILENAME, "r" );
+    if ( headFile )
+    {
+        uint8_t bytes[4] = { 0 };
+
+        if ( headFile.read( bytes, sizeof( bytes ) ) == sizeof( bytes ) )
+        {
+            _head = bytes[0] | ( bytes[1] << 8 ) | ( (uint32_t) bytes[2] << 16 ) | ( (uint32_t) bytes[3] << 24 );
+        }
+
+        headFile.close();
+    }
+
+    File outboxFile = SPIFFS.open( OUTBOX_FILENAME, "r" );
+    if ( !outboxFile )
+    {
+        // Nothing was queued
+        reset();
+        return;
+    }
+
+    uint32_t size = outboxFile.size();
+
+    if ( _head > size )
+    {
+        _head = 0;
+    }
+
+    uint32_t offset = _head;
+
+    while ( offset + RECORD_HEADER_BYTES <= size )
+    {
+        uint8_t header[RECORD_HEADER_BYTES];
+
+        outboxFile.seek( offset, SeekSet );
+
+        if ( outboxFile.read( header, sizeof( header ) ) != sizeof( header ) )
+        {
+            break;
+        }
+
+        uint16_t length = header[0] | ( header[1] << 8 );
+
+        if ( length == 0 || offset + RECORD_HEADER_BYTES + length > size )
+        {
+            break;
+        }
+
+        offset += RECORD_HEADER_BYTES + length;
+        _count++;
+    }
+
+    outboxFile.close();
+
+    _tail = offset;
+
+    if ( _count == 0 )
+    {
+        reset();
+        return;
+    }
+
+    if ( _tail != size )
+    {
+        Serial.printf( "MqttOutbox: dropping %u bytes of partial record\n", size - _tail );
+        compact();
+    }
+
+    Serial.printf( "MqttOutbox: %u messages queued from before\n", _count );
+}
+
+/*======================================================================
+FUNCTION:
+Push()
+
+DESCRIPTION:
+Appends a message to the queue.  If the queue is full the oldest
+messages are dropped to make room; the newest state matters more to 
+anyone catching up than the oldest.
+
+RETURN VALUE:
+true if the message was queued.
+
+SIDE EFFECTS:
+data in the flash file system is modified
+
+======================================================================*/
+bool MqttOutbox::Push( const uint8_t *payload, size_t length )
+{
+    if ( length == 0 || length > MAX_MESSAGE_BYTES )
+    {
+        _dropped++;
+        return false;
+    }
+
+    uint32_t recordBytes = RECORD_HEADER_BYTES + length;
+
+    while ( _count > 0 && ( _tail - _head ) + recordBytes > MAX_QUEUED_BYTES )
+    {
+        Serial.println( "MqttOutbox: full, dropping oldest message" );
+
+        advance();
+        _dropped++;
+    }
+
+    if ( _tail + recordBytes > MAX_FILE_BYTES )
+    {
+        compact();
+    }
+
+    File outboxFile = SPIFFS.open( OUTBOX_FILENAME, "a" );
+    if ( !outboxFile )
+    {
+        Serial.printf( "Failed to open %s for writing\n", OUTBOX_FILENAME );
+
+        _dropped++;
+        return false;
+    }
+
+    uint8_t header[RECORD_HEADER_BYTES] = { (uint8_t) ( length & 0xFF ), (uint8_t) ( length >> 8 ) };
+
+    bool ok = outboxFile.write( header, sizeof( header ) ) == sizeof( header ) &&
+              outboxFile.write( payload, length ) == length;
+
+    outboxFile.close();
+
+    if ( false == ok )
+    {
+        Serial.println( "MqttOutbox: write failed (file system full?)" );
+
+        // Cut off whatever part of the record made it out.  Compacting
+        // needs room too, so on a full file system it can fail; the 
+        // next append would then land after the partial record and 
+        // every record from there on would be misread.  Starting over
+        // is the only safe thing left.
+        if ( compact() == false )
+        {
+            Serial.println( "MqttOutbox: can't trim the partial record, emptying the queue" );
+
+            _dropped += _count;
+            reset();
+        }
+
+        _dropped++;
+        return false;
+    }
+
+    _tail += recordBytes;
+    _count++;
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+Peek()
+
+DESCRIPTION:
+Reads the oldest message without removing it, so it stays queued if
+the publish fails.
+
+RETURN VALUE:
+The message length, 0 if there isn't one.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+size_t MqttOutbox::Peek( uint8_t *buffer, size_t size )
+{
+    if ( _count == 0 )
+    {
+        return 0;
+    }
+
+    uint16_t length = headLength();
+
+    if ( length == 0 )
+    {
+        // The file went bad under us.  Nothing to do but start over.
+        Serial.println( "MqttOutbox: queue file unreadable, discarding" );
+
+        _dropped += _count;
+        reset();
+        return 0;
+    }
+
+    if ( length > size )
+    {
+        return 0;
+    }
+
+    File outboxFile = SPIFFS.open( OUTBOX_FILENAME, "r" );
+    if ( !outboxFile )
+    {
+        return 0;
+    }
+
+    outboxFile.seek( _head + RECORD_HEADER_BYTES, SeekSet );
+
+    size_t n = outboxFile.read( buffer, length );
+
+    outboxFile.close();
+
+    return ( n == length ) ? length : 0;
+}
+
+/*======================================================================
+FUNCTION:
+Pop()
+
+DESCRIPTION:
+Removes the oldest message, once the broker has it.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+data in the flash file system is modified
+
+======================================================================*/
+void MqttOutbox::Pop()
+{
+    if ( _count > 0 )
+    {
+        advance();
+    }
+}
+
+/*======================================================================
+FUNCTION:
+headLength()
+
+DESCRIPTION:
+Reads the length of the oldest record
+
+RETURN VALUE:
+The payload length, 0 if it can't be read.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+uint16_t MqttOutbox::headLength()
+{
+    File outboxFile = SPIFFS.open( OUTBOX_FILENAME, "r" );
+    if ( !outboxFile )
+    {
+        return 0;
+    }
+
+    uint8_t header[RECORD_HEADER_BYTES] = { 0 };
+
+    outboxFile.seek( _head, SeekSet );
+
+    if ( outboxFile.read( header, sizeof( header ) ) != sizeof( header ) )
+    {
+        header[0] = 0;
+        header[1] = 0;
+    }
+
+    outboxFile.close();
+
+    return header[0] | ( header[1] << 8 );
+}
+
+/*======================================================================
+FUNCTION:
+advance()
+
+DESCRIPTION:
+Moves the head past the oldest record.  The space isn't reclaimed 
+until the next compact(), or until the queue empties and the files 
+are removed.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+data in the flash file system is modified
+
+======================================================================*/
+void MqttOutbox::advance()
+{
+    uint16_t length = headLength();
+
+    if ( length == 0 )
+    {
+        reset();
+        return;
+    }
+
+    _head += RECORD_HEADER_BYTES + length;
+    _count--;
+
+    if ( _count == 0 )
+    {
+        reset();
+    }
+    else
+    {
+        saveHead();
+    }
+}
+
+/*======================================================================
+FUNCTION:
+compact()
+
+DESCRIPTION:
+Copies the live records (head to tail) to a new file that replaces the
+old one, and moves the head back to the start.  Ordered so that losing
+power at any point leaves either the old queue and head or the new 
+queue with the head at 0 (see the header's DOCUMENTATION and 
+recoverCompaction()).
+
+RETURN VALUE:
+true if successful.
+
+SIDE EFFECTS:
+data in the flash file system is modified
+
+======================================================================*/
+bool MqttOutbox::compact()
+{
+    // The head file has to exist while the new file is written, since
+    // its removal is what says the new file is complete
+    if ( saveHead() == false )
+    {
+        return false;
+    }
+
+    File inFile = SPIFFS.open( OUTBOX_FILENAME, "r" );
+    if ( !inFile )
+    {
+        return false;
+    }
+
+    File outFile = SPIFFS.open( TEMP_FILENAME, "w" );
+    if ( !outFile )
+    {
+        inFile.close();
+        return false;
+    }
+
+    inFile.seek( _head, SeekSet );
+
+    uint32_t remaining = _tail - _head;
+    bool ok = true;
+
+    while ( remaining > 0 )
+    {
+        uint8_t buffer[128];
+
+        size_t chunk = ( remaining < sizeof( buffer ) ) ? remaining : sizeof( buffer );
+
+        if ( inFile.read( buffer, chunk ) != chunk || outFile.write( buffer, chunk ) != chunk )
+        {
+            ok = false;
+            break;
+        }
+
+        remaining -= chunk;
+    }
+
+    inFile.close();
+    outFile.close();
+
+    if ( false == ok )
+    {
+        SPIFFS.remove( TEMP_FILENAME );
+        return false;
+    }
+
+    // Commit.  From here on the temp file is the queue.
+    SPIFFS.remove( HEAD_FILENAME );
+
+    SPIFFS.remove( OUTBOX_FILENAME );
+    SPIFFS.rename( TEMP_FILENAME, OUTBOX_FILENAME );
+
+    _tail -= _head;
+    _head  = 0;
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+recoverCompaction()
+
+DESCRIPTION:
+Cleans up after a compaction that was cut short.  A temp file next to
+a head file was never committed and is removed.  A temp file without
+one was committed, so it replaces the queue file and the head starts 
+at 0.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+data in the flash file system may be modified
+
+======================================================================*/
+void MqttOutbox::recoverCompaction()
+{
+    if ( SPIFFS.exists( TEMP_FILENAME ) == false )
+    {
+        return;
+    }
+
+    if ( SPIFFS.exists( HEAD_FILENAME ) == true )
+    {
+        Serial.println( "MqttOutbox: discarding an unfinished compaction" );
+
+        SPIFFS.remove( TEMP_FILENAME );
+    }
+    else
+    {
+        Serial.println( "MqttOutbox: finishing a compaction" );
+
+        SPIFFS.remove( OUTBOX_FILENAME );
+        SPIFFS.rename( TEMP_FILENAME, OUTBOX_FILENAME );
+    }
+}
+
+/*======================================================================
+FUNCTION:
+saveHead()
+
+DESCRIPTION:
+Saves the head offset so messages already sent aren't sent again
+after a reboot
+
+RETURN VALUE:
+true if the head was written.
+
+SIDE EFFECTS:
+data in the flash file system is modified
+
+======================================================================*/
+bool MqttOutbox::saveHead()
+{
+    File headFile = SPIFFS.open( HEAD_FILENAME, "w" );
+    if ( !headFile )
+    {
+        return false;
+    }
+
+    uint8_t bytes[4] = { (uint8_t) _head, (uint8_t) ( _head >> 8 ), (uint8_t) ( _head >> 16 ), (uint8_t) ( _head >> 24 ) };
+
+    bool ok = ( headFile.write( bytes, sizeof( bytes ) ) == sizeof( bytes ) );
+    headFile.close();
+
+    return ok;
+}
+
+/*======================================================================
+FUNCTION:
+reset()
+
+DESCRIPTION:
+Empties the queue
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+data in the flash file system is modified
+
+======================================================================*/
+void MqttOutbox::reset()
+{
+    SPIFFS.remove( OUTBOX_FILENAME );
+    SPIFFS.remove( HEAD_FILENAME );
+
+    _head  = 0;
+    _tail  = 0;
+    _count = 0;
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
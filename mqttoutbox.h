@@ -0,0 +1,243 @@
+#ifndef _GARAGEOMATIC_MQTTOUTBOX_H_
+#define _GARAGEOMATIC_MQTTOUTBOX_H_
+
+/*======================================================================
+FILE:
+mqttoutbox.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Store and forward queue for MQTT messages the broker couldn't take.
+Messages are appended to a file on the flash file system, so a door
+change made while the broker is down (or across a reboot) still gets
+published, in order, once the broker is back.
+
+PUBLIC CLASSES AND FUNCTIONS:
+MqttOutbox
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <stddef.h>
+#include <stdint.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// Each call touches the flash file system, which takes a few ms.  The
+// owner should only queue messages the broker didn't take, and drain 
+// one message per pass.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+MqttOutbox
+
+DESCRIPTION:
+Bounded FIFO of message payloads kept in an append-only file.  The 
+oldest message is found through a head offset that is saved in a 
+second small file as messages go out.  When the queue is full the 
+oldest message is dropped to make room, and the file is compacted 
+once the dead space at its front gets large.
+
+HOW TO USE:
+1. Call Begin() once the file system is up.
+2. Push() what the broker couldn't take.
+3. While connected, Peek() the oldest, publish it, and Pop() it once
+   the broker has it.
+
+======================================================================*/
+class MqttOutbox
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    // Queued payload bytes we keep before dropping the oldest
+    static const uint32_t MAX_QUEUED_BYTES = 16384;
+
+    // The file is compacted before it grows past this
+    static const uint32_t MAX_FILE_BYTES = 2 * MAX_QUEUED_BYTES;
+
+    // Bigger messages are refused
+    static const uint16_t MAX_MESSAGE_BYTES = 1024;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    MqttOutbox();
+
+    // Picks up whatever was queued before a reboot
+    void Begin();
+
+    // Queues a message.  false if it is too big or can't be written.
+    bool Push( const uint8_t *payload, size_t length );
+
+    // Copies the oldest message into the buffer (which should hold 
+    // MAX_MESSAGE_BYTES).  Returns its length, 0 if the queue is empty
+    // or it can't be read.
+    size_t Peek( uint8_t *buffer, size_t size );
+
+    // Removes the oldest message
+    void Pop();
+
+    bool IsEmpty() const { return _count == 0; }
+
+    uint32_t GetCount() const { return _count; }
+
+    // Messages dropped (full queue, too big) since boot
+    uint32_t GetDroppedCount() const { return _dropped; }
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    // Length of the record at the head, 0 if it can't be read
+    uint16_t headLength();
+
+    // Moves the head past the oldest record
+    void advance();
+
+    // Rewrites the file with only the live records
+    bool compact();
+
+    bool saveHead();
+
+    // Finishes or throws away a compaction a reboot cut short
+    void recoverCompaction();
+
+    // Forgets everything and removes the files
+    void reset();
+
+    // No copying. Leaving the implementation undefined to cause a link
+    // error
+    MqttOutbox( const MqttOutbox &rhs );
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    // File offset of the oldest record, and of the end of the file
+    uint32_t _head;
+    uint32_t _tail;
+
+    uint32_t _count;
+    uint32_t _dropped;
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+// None.
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+Queue file (/mqttoutbox.bin), one record per message, oldest first:
+
+    length (2 bytes, little endian), payload (length bytes)
+
+Head file (/mqttoutbox.hd): the 4 byte (little endian) offset of the
+oldest record still queued.  Both files are removed when the queue 
+empties.
+
+Compaction writes the live records to /mqttoutbox.tmp, then removes 
+the head file, then renames the new file over the queue file.  
+Removing the head file is the commit point:
+
+    temp and head files both there   - not committed, the queue file 
+                                       and head are still good, the 
+                                       temp file is removed
+    temp file there, head file gone  - committed, the temp file 
+                                       becomes the queue with the head
+                                       at 0
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_MQTTOUTBOX_H_
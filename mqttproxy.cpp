@@ -50,6 +50,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "mqttproxy.h"
 
+#include "Arduino.h"
+
+// For unique_ptr support
+#include <memory>
+
 //----------------------------------------------------------------------
 // Type Declarations
 //----------------------------------------------------------------------
@@ -60,7 +65,32 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // Global Constant Definitions
 //----------------------------------------------------------------------
 
-// None.
+// MQTT 3.1.1 control packet types (high nibble of the first byte)
+static const uint8_t MQTT_PACKET_CONNECT  = 0x10;
+static const uint8_t MQTT_PACKET_CONNACK  = 0x20;
+static const uint8_t MQTT_PACKET_PUBLISH  = 0x30;
+static const uint8_t MQTT_PACKET_SUBSCRIBE = 0x82;
+static const uint8_t MQTT_PACKET_SUBACK   = 0x90;
+static const uint8_t MQTT_PACKET_PINGREQ  = 0xC0;
+static const uint8_t MQTT_PACKET_PINGRESP = 0xD0;
+
+// Protocol level 4 is MQTT 3.1.1
+static const uint8_t MQTT_PROTOCOL_LEVEL = 4;
+
+static const uint8_t MQTT_CONNECT_FLAG_CLEAN_SESSION = 0x02;
+static const uint8_t MQTT_CONNECT_FLAG_WILL          = 0x04;
+static const uint8_t MQTT_CONNECT_FLAG_WILL_RETAIN   = 0x20;
+static const uint8_t MQTT_CONNECT_FLAG_PASSWORD      = 0x40;
+static const uint8_t MQTT_CONNECT_FLAG_USERNAME      = 0x80;
+
+static const uint8_t MQTT_PUBLISH_FLAG_RETAIN = 0x01;
+static const uint8_t MQTT_PUBLISH_QOS_MASK     = 0x06;
+
+// SUBACK return code for a refused subscription
+static const uint8_t MQTT_SUBACK_FAILURE = 0x80;
+
+// Remaining length tops out at 4 bytes of 7 bits
+static const uint32_t MQTT_MAX_REMAINING_LENGTH = 268435455;
 
 //----------------------------------------------------------------------
 // Global Data Definitions
@@ -78,7 +108,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // Function Prototypes
 //----------------------------------------------------------------------
 
-// None.
+static int remainingLengthBytes( uint32_t length );
+static uint8_t *putRemainingLength( uint8_t *p, uint32_t length );
+static uint8_t *putString( uint8_t *p, const String &value );
 
 //----------------------------------------------------------------------
 // Required Libraries
@@ -113,57 +145,189 @@ MqttProxy::MqttProxy( WiFiClient &client,
     , _mqttserver(mqttserver)
     , _mqttport( mqttport )
     , _mqttfeedPubName(mqttPublishFeed)
+    , _state( MQTT_DISCONNECTED )
+    , _stateStartMS( 0 )
+    , _backoffMS( BACKOFF_MIN_MS )
+    , _retryDelayMS( 0 )
+    , _connectCount( 0 )
+    , _failedCount( 0 )
+    , _lastSendMS( 0 )
+    , _pingPending( false )
+    , _pingSentMS( 0 )
+    , _pingRttMS( 0 )
+    , _rxPhase( RX_TYPE )
+    , _rxType( 0 )
+    , _rxLength( 0 )
+    , _rxShift( 0 )
+    , _rxCount( 0 )
+    , _nextPacketId( 1 )
 {
-    _mqttClient.reset(
-        new Adafruit_MQTT_Client( &_wifiClient, _mqttserver.c_str(), mqttport )
-    );
+    _clientId = "garage-o-matic-" + String( ESP.getChipId(), HEX );
+}
+
+/*======================================================================
+FUNCTION:
+SetWill()
+
+DESCRIPTION:
+Sets the last will and testament.  The broker publishes it, retained,
+when our connection drops without a DISCONNECT (or the keepalive runs
+out), which is how subscribers find out we are gone.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
 
-    _mqttPublisher.reset(
-        new Adafruit_MQTT_Publish( _mqttClient.get(), _mqttfeedPubName.c_str() )
-    );
+======================================================================*/
+void MqttProxy::SetWill( const String &topic, const String &message )
+{
+    _willTopic   = topic;
+    _willMessage = message;
 }
 
 /*======================================================================
 FUNCTION:
-Connect()
+SetCredentials()
 
 DESCRIPTION:
-This method will connect to the MQTT broker (server).  It is safe
-to call even if you are already connected.
+Sets the login sent in CONNECT.  MQTT 3.1.1 doesn't allow a password 
+without a username, so with no username neither is sent.
 
 RETURN VALUE:
-true if connected.
+none.
 
 SIDE EFFECTS:
 none
 
 ======================================================================*/
-bool MqttProxy::Connect()
-{    
-    // Stop if already connected.
-    if ( _mqttClient->connected() )
-    {
-        return true;
-    }
+void MqttProxy::SetCredentials( const String &username, const String &password )
+{
+    _username = username;
+    _password = password;
+}
 
-    Serial.printf( "Attempting to connect to MQTT server %s on port %d...", 
-                  _mqttserver.c_str(),
-                  _mqttport );
+/*======================================================================
+FUNCTION:
+Process()
+
+DESCRIPTION:
+Advances the connection one step.  The only call in here that can
+wait is the TCP connect, which is bounded by TCP_CONNECT_TIMEOUT_MS.
+
+RETURN VALUE:
+none.
 
-    int8_t result = _mqttClient->connect();
-    
-    const int8_t CONNECTED = 0;
+SIDE EFFECTS:
+none
 
-    if ( result == CONNECTED )
+======================================================================*/
+void MqttProxy::Process()
+{
+    unsigned long elapsed = millis() - _stateStartMS;
+
+    switch ( _state )
     {
-        Serial.println( "MQTT Connected!" );
+        case MQTT_DISCONNECTED:
+
+            Serial.printf( "Attempting to connect to MQTT server %s on port %d\n", 
+                           _mqttserver.c_str(),
+                           _mqttport );
+
+            setState( MQTT_RESOLVING );
+            _dns.Start( _mqttserver.c_str() );
+            break;
+
+        case MQTT_RESOLVING:
+        {
+            AsyncDnsLookup::Result result = _dns.Poll( _serverAddress );
+
+            if ( result == AsyncDnsLookup::DNS_DONE )
+            {
+                openConnection();
+            }
+            else if ( result == AsyncDnsLookup::DNS_FAILED )
+            {
+                backoff( "lookup failed" );
+            }
+            else if ( elapsed >= DNS_TIMEOUT_MS )
+            {
+                backoff( "lookup timed out" );
+            }
+        }
+            break;
+
+        case MQTT_WAIT_CONNACK:
+
+            if ( _wifiClient.connected() == false )
+            {
+                backoff( "closed by broker" );
+                break;
+            }
+
+            // Moves us to CONNECTED (or BACKOFF) when the CONNACK 
+            // shows up
+            receive();
+
+            if ( _state == MQTT_WAIT_CONNACK && elapsed >= CONNACK_TIMEOUT_MS )
+            {
+                backoff( "CONNACK timed out" );
+            }
+            break;
+
+        case MQTT_CONNECTED:
+
+            if ( _wifiClient.connected() == false )
+            {
+                backoff( "connection lost" );
+                break;
+            }
+
+            receive();
+
+            if ( _state == MQTT_CONNECTED )
+            {
+                keepAlive();
+            }
+            break;
+
+        case MQTT_BACKOFF:
+
+            if ( elapsed >= _retryDelayMS )
+            {
+                setState( MQTT_DISCONNECTED );
+            }
+            break;
     }
-    else
+}
+
+/*======================================================================
+FUNCTION:
+StateToString()
+
+DESCRIPTION:
+Converts the connection state to a string
+
+RETURN VALUE:
+Name of the state.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+const char *MqttProxy::StateToString( ConnectionState state )
+{
+    switch ( state )
     {
-        Serial.println( "MQTT no connection" );
+        case MQTT_DISCONNECTED: return "disconnected";
+        case MQTT_RESOLVING:    return "resolving";
+        case MQTT_WAIT_CONNACK: return "connecting";
+        case MQTT_CONNECTED:    return "connected";
+        case MQTT_BACKOFF:      return "backoff";
     }
 
-    return result == CONNECTED;
+    return "unknown";
 }
 
 /*======================================================================
@@ -182,15 +346,35 @@ none
 ======================================================================*/
 bool MqttProxy::Publish( const String &message )
 {
-    return _mqttPublisher->publish( message.c_str() );
+    return Publish( _mqttfeedPubName, message, false );
+}
+
+/*======================================================================
+FUNCTION:
+Publish( topic, message, retain )
+
+DESCRIPTION:
+Publishes the message to the topic
+
+RETURN VALUE:
+true if successful
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool MqttProxy::Publish( const String &topic, const String &message, bool retain )
+{
+    return Publish( topic, (const uint8_t *) message.c_str(), message.length(), retain );
 }
 
 /*======================================================================
 FUNCTION:
-Ping()
+Publish( topic, payload, length, retain )
 
 DESCRIPTION:
-Pings the MQTT server to keep the connection alive
+Builds a QoS 0 PUBLISH and sends it as one write.  A failed write 
+means the connection is broken, so we drop it and reconnect.
 
 RETURN VALUE:
 true if successful
@@ -199,9 +383,685 @@ SIDE EFFECTS:
 none
 
 ======================================================================*/
-bool MqttProxy::Ping()
+bool MqttProxy::Publish( const String &topic, const uint8_t *payload, size_t length, bool retain )
+{
+    if ( IsConnected() == false )
+    {
+        return false;
+    }
+
+    uint32_t remaining = 2 + topic.length() + length;
+
+    if ( remaining > MQTT_MAX_REMAINING_LENGTH )
+    {
+        return false;
+    }
+
+    size_t total = 1 + remainingLengthBytes( remaining ) + remaining;
+
+    std::unique_ptr<uint8_t[]> packet( new uint8_t[total] );
+
+    uint8_t *p = packet.get();
+
+    *p++ = MQTT_PACKET_PUBLISH | ( ( true == retain ) ? MQTT_PUBLISH_FLAG_RETAIN : 0 );
+    p = putRemainingLength( p, remaining );
+    p = putString( p, topic );
+    memcpy( p, payload, length );
+
+    if ( send( packet.get(), total ) == false )
+    {
+        backoff( "publish failed" );
+        return false;
+    }
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+Subscribe()
+
+DESCRIPTION:
+Remembers the topic filter and subscribes to it.  We connect with a 
+clean session, so the broker forgets our subscriptions when we drop;
+connected() sends them all again.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void MqttProxy::Subscribe( const String &topicFilter )
+{
+    _subscriptions.push_back( topicFilter );
+
+    if ( IsConnected() == true )
+    {
+        sendSubscribe( topicFilter );
+    }
+}
+
+/*======================================================================
+FUNCTION:
+openConnection()
+
+DESCRIPTION:
+Opens the TCP connection to the broker and sends our CONNECT (with
+the will and the login, if they are set).  The CONNACK is picked up by receive() on
+later passes.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void MqttProxy::openConnection()
+{
+    _wifiClient.setTimeout( TCP_CONNECT_TIMEOUT_MS );
+
+    if ( _wifiClient.connect( _serverAddress, _mqttport ) == 0 )
+    {
+        backoff( "TCP connect failed" );
+        return;
+    }
+
+    _wifiClient.setNoDelay( true );
+
+    _rxPhase     = RX_TYPE;
+    _pingPending = false;
+    _pingRttMS   = 0;
+
+    bool hasWill     = ( _willTopic.length() != 0 );
+    bool hasUsername = ( _username.length() != 0 );
+    bool hasPassword = ( true == hasUsername && _password.length() != 0 );
+
+    uint8_t flags = MQTT_CONNECT_FLAG_CLEAN_SESSION;
+
+    // Variable header is 10 bytes, then the length prefixed client id,
+    // will and login
+    uint32_t remaining = 10 + 2 + _clientId.length();
+
+    if ( true == hasWill )
+    {
+        flags |= MQTT_CONNECT_FLAG_WILL | MQTT_CONNECT_FLAG_WILL_RETAIN;
+        remaining += 2 + _willTopic.length() + 2 + _willMessage.length();
+    }
+
+    if ( true == hasUsername )
+    {
+        flags |= MQTT_CONNECT_FLAG_USERNAME;
+        remaining += 2 + _username.length();
+    }
+
+    if ( true == hasPassword )
+    {
+        flags |= MQTT_CONNECT_FLAG_PASSWORD;
+        remaining += 2 + _password.length();
+    }
+
+    size_t total = 1 + remainingLengthBytes( remaining ) + remaining;
+
+    std::unique_ptr<uint8_t[]> packet( new uint8_t[total] );
+
+    uint8_t *p = packet.get();
+
+    *p++ = MQTT_PACKET_CONNECT;
+    p = putRemainingLength( p, remaining );
+
+    *p++ = 0;
+    *p++ = 4;
+    *p++ = 'M';
+    *p++ = 'Q';
+    *p++ = 'T';
+    *p++ = 'T';
+    *p++ = MQTT_PROTOCOL_LEVEL;
+    *p++ = flags;
+    *p++ = KEEPALIVE_S >> 8;
+    *p++ = KEEPALIVE_S & 0xFF;
+
+    p = putString( p, _clientId );
+
+    if ( true == hasWill )
+    {
+        p = putString( p, _willTopic );
+        p = putString( p, _willMessage );
+    }
+
+    if ( true == hasUsername )
+    {
+        p = putString( p, _username );
+    }
+
+    if ( true == hasPassword )
+    {
+        p = putString( p, _password );
+    }
+
+    if ( send( packet.get(), total ) == false )
+    {
+        backoff( "CONNECT not sent" );
+        return;
+    }
+
+    setState( MQTT_WAIT_CONNACK );
+}
+
+/*======================================================================
+FUNCTION:
+send()
+
+DESCRIPTION:
+Writes a whole packet to the broker
+
+RETURN VALUE:
+true if it all went out.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool MqttProxy::send( const uint8_t *packet, size_t length )
+{
+    if ( _wifiClient.write( packet, length ) != length )
+    {
+        return false;
+    }
+
+    _lastSendMS = millis();
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+sendSubscribe()
+
+DESCRIPTION:
+Sends a SUBSCRIBE for one topic filter at QoS 0.  The SUBACK comes
+back through receive().
+
+RETURN VALUE:
+true if it went out.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool MqttProxy::sendSubscribe( const String &topicFilter )
+{
+    // Packet id, the filter, and the requested QoS
+    uint32_t remaining = 2 + 2 + topicFilter.length() + 1;
+
+    size_t total = 1 + remainingLengthBytes( remaining ) + remaining;
+
+    std::unique_ptr<uint8_t[]> packet( new uint8_t[total] );
+
+    uint8_t *p = packet.get();
+
+    uint16_t packetId = _nextPacketId++;
+
+    // 0 isn't a valid packet id
+    if ( _nextPacketId == 0 )
+    {
+        _nextPacketId = 1;
+    }
+
+    *p++ = MQTT_PACKET_SUBSCRIBE;
+    p = putRemainingLength( p, remaining );
+    *p++ = packetId >> 8;
+    *p++ = packetId & 0xFF;
+    p = putString( p, topicFilter );
+    *p++ = 0;
+
+    if ( send( packet.get(), total ) == false )
+    {
+        backoff( "subscribe failed" );
+        return false;
+    }
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+receive()
+
+DESCRIPTION:
+Reads whatever the broker has sent so far.  Packets are put together
+a byte at a time, so a packet split across TCP segments just finishes
+on a later pass instead of us waiting for the rest of it.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+May change the connection state (CONNACK, bad packet).
+
+======================================================================*/
+void MqttProxy::receive()
+{
+    while ( _wifiClient.available() > 0 )
+    {
+        uint8_t b = _wifiClient.read();
+
+        switch ( _rxPhase )
+        {
+            case RX_TYPE:
+
+                _rxType   = b;
+                _rxLength = 0;
+                _rxShift  = 0;
+                _rxCount  = 0;
+                _rxPhase  = RX_LENGTH;
+                break;
+
+            case RX_LENGTH:
+
+                // Remaining length is 7 bits a byte, low bits first,
+                // at most 4 bytes
+                _rxLength |= (uint32_t) ( b & 0x7F ) << _rxShift;
+                _rxShift  += 7;
+
+                if ( ( b & 0x80 ) == 0 )
+                {
+                    if ( _rxLength == 0 )
+                    {
+                        _rxPhase = RX_TYPE;
+                        packetReceived();
+                    }
+                    else
+                    {
+                        _rxPhase = RX_BODY;
+                    }
+                }
+                else if ( _rxShift >= 28 )
+                {
+                    backoff( "bad packet length" );
+                    return;
+                }
+                break;
+
+            case RX_BODY:
+
+                if ( _rxCount < RX_BUFFER_SIZE )
+                {
+                    _rxBuffer[_rxCount] = b;
+                }
+
+                _rxCount++;
+
+                if ( _rxCount == _rxLength )
+                {
+                    _rxPhase = RX_TYPE;
+                    packetReceived();
+                }
+                break;
+        }
+
+        // The packet may have dropped the connection
+        if ( _state != MQTT_WAIT_CONNACK && _state != MQTT_CONNECTED )
+        {
+            return;
+        }
+    }
+}
+
+/*======================================================================
+FUNCTION:
+packetReceived()
+
+DESCRIPTION:
+Handles a complete incoming packet.  The body is in _rxBuffer, cut 
+short if it was longer than the buffer.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+May change the connection state.
+
+======================================================================*/
+void MqttProxy::packetReceived()
+{
+    switch ( _rxType & 0xF0 )
+    {
+        case MQTT_PACKET_CONNACK:
+
+            if ( _state != MQTT_WAIT_CONNACK || _rxLength != 2 )
+            {
+                backoff( "bad CONNACK" );
+            }
+            else if ( _rxBuffer[1] != 0 )
+            {
+                // Bad protocol, id rejected, not authorized...
+                Serial.printf( "MQTT broker refused connection, code %d\n", _rxBuffer[1] );
+                backoff( "connection refused" );
+            }
+            else
+            {
+                connected();
+            }
+            break;
+
+        case MQTT_PACKET_PUBLISH:
+
+            messageReceived();
+            break;
+
+        case MQTT_PACKET_SUBACK:
+
+            if ( _rxLength >= 3 && _rxBuffer[2] == MQTT_SUBACK_FAILURE )
+            {
+                Serial.println( "MQTT broker refused a subscription" );
+            }
+            break;
+
+        case MQTT_PACKET_PINGRESP:
+
+            if ( true == _pingPending )
+            {
+                _pingPending = false;
+                _pingRttMS   = millis() - _pingSentMS;
+            }
+            break;
+
+        default:
+
+            // Nothing else is expected yet.  Skip it.
+            break;
+    }
+}
+
+/*======================================================================
+FUNCTION:
+messageReceived()
+
+DESCRIPTION:
+Pulls the topic, payload and retain flag out of an incoming PUBLISH 
+and hands them to the message callback.  We only subscribe at QoS 0, so there is 
+nothing to acknowledge; a packet id (if the broker sent one anyway) is
+skipped.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+Whatever the callback does.
+
+======================================================================*/
+void MqttProxy::messageReceived()
+{
+    if ( _rxLength > RX_BUFFER_SIZE )
+    {
+        Serial.printf( "MQTT message too big (%u bytes), dropped\n", _rxLength );
+        return;
+    }
+
+    if ( _rxLength < 2 || !_messageCallback )
+    {
+        return;
+    }
+
+    uint16_t topicLength = ( _rxBuffer[0] << 8 ) | _rxBuffer[1];
+
+    uint32_t offset = 2 + topicLength;
+
+    if ( ( _rxType & MQTT_PUBLISH_QOS_MASK ) != 0 )
+    {
+        offset += 2;
+    }
+
+    if ( offset > _rxLength )
+    {
+        return;
+    }
+
+    String topic;
+    topic.reserve( topicLength );
+
+    for ( uint16_t i = 0; i < topicLength; i++ )
+    {
+        topic += (char) _rxBuffer[2 + i];
+    }
+
+    bool retained = ( _rxType & MQTT_PUBLISH_FLAG_RETAIN ) != 0;
+
+    _messageCallback( topic, &_rxBuffer[offset], _rxLength - offset, retained );
+}
+
+/*======================================================================
+FUNCTION:
+keepAlive()
+
+DESCRIPTION:
+The broker drops us if it hears nothing for 1.5 times the keepalive,
+so we only ping once we have been quiet for close to the keepalive.
+Publishes reset that clock, so a busy connection never pings at all.
+The ping's answer is read by receive() like any other packet.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void MqttProxy::keepAlive()
 {
-    return _mqttClient->ping();
+    unsigned long now = millis();
+
+    if ( true == _pingPending )
+    {
+        if ( now - _pingSentMS >= PINGRESP_TIMEOUT_MS )
+        {
+            backoff( "ping timed out" );
+        }
+
+        return;
+    }
+
+    if ( now - _lastSendMS < KEEPALIVE_S * 1000UL - PING_MARGIN_MS )
+    {
+        return;
+    }
+
+    static const uint8_t PINGREQ[] = { MQTT_PACKET_PINGREQ, 0 };
+
+    if ( send( PINGREQ, sizeof( PINGREQ ) ) == false )
+    {
+        backoff( "ping not sent" );
+        return;
+    }
+
+    _pingPending = true;
+    _pingSentMS  = now;
+}
+
+/*======================================================================
+FUNCTION:
+connected()
+
+DESCRIPTION:
+The broker took us.  Resets the backoff for the next time the 
+connection drops.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void MqttProxy::connected()
+{
+    setState( MQTT_CONNECTED );
+
+    _backoffMS = BACKOFF_MIN_MS;
+    _connectCount++;
+
+    Serial.printf( "MQTT Connected! (%s)\n", _clientId.c_str() );
+
+    for ( size_t i = 0; i < _subscriptions.size() && IsConnected() == true; i++ )
+    {
+        sendSubscribe( _subscriptions[i] );
+    }
+}
+
+/*======================================================================
+FUNCTION:
+backoff()
+
+DESCRIPTION:
+Drops whatever is left of the connection and waits out the current
+backoff (with jitter) before the next attempt.  The backoff doubles
+for the time after that.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void MqttProxy::backoff( const char *why )
+{
+    _wifiClient.stop();
+
+    if ( _state != MQTT_CONNECTED )
+    {
+        _failedCount++;
+    }
+
+    long jitterRange = ( _backoffMS * BACKOFF_JITTER_PERCENT ) / 100;
+
+    // Hardware random number generator
+    long jitter = (long) ( RANDOM_REG32 % ( 2 * jitterRange + 1 ) ) - jitterRange;
+
+    _retryDelayMS = _backoffMS + jitter;
+
+    Serial.printf( "MQTT %s, retrying in %lu ms\n", why, _retryDelayMS );
+
+    _backoffMS *= 2;
+
+    if ( _backoffMS > BACKOFF_MAX_MS )
+    {
+        _backoffMS = BACKOFF_MAX_MS;
+    }
+
+    setState( MQTT_BACKOFF );
+}
+
+/*======================================================================
+FUNCTION:
+setState()
+
+DESCRIPTION:
+Moves to a new state and restarts the state's clock
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void MqttProxy::setState( ConnectionState state )
+{
+    _state = state;
+    _stateStartMS = millis();
+}
+
+/*======================================================================
+FUNCTION:
+remainingLengthBytes()
+
+DESCRIPTION:
+How many bytes the remaining length field takes
+
+RETURN VALUE:
+1 to 4
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+static int remainingLengthBytes( uint32_t length )
+{
+    int bytes = 1;
+
+    while ( length > 127 )
+    {
+        length >>= 7;
+        bytes++;
+    }
+
+    return bytes;
+}
+
+/*======================================================================
+FUNCTION:
+putRemainingLength()
+
+DESCRIPTION:
+Writes the remaining length field, 7 bits a byte with the low bits 
+first and the top bit set on all but the last byte
+
+RETURN VALUE:
+Where the next byte goes
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+static uint8_t *putRemainingLength( uint8_t *p, uint32_t length )
+{
+    do
+    {
+        uint8_t b = length & 0x7F;
+
+        length >>= 7;
+
+        if ( length > 0 )
+        {
+            b |= 0x80;
+        }
+
+        *p++ = b;
+
+    } while ( length > 0 );
+
+    return p;
+}
+
+/*======================================================================
+FUNCTION:
+putString()
+
+DESCRIPTION:
+Writes a UTF-8 string the MQTT way, with a 2 byte big endian length
+in front
+
+RETURN VALUE:
+Where the next byte goes
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+static uint8_t *putString( uint8_t *p, const String &value )
+{
+    uint16_t length = value.length();
+
+    *p++ = length >> 8;
+    *p++ = length & 0xFF;
+
+    memcpy( p, value.c_str(), length );
+
+    return p + length;
 }
 
 /*=====================================================================
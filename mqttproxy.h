@@ -47,12 +47,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // Include Files
 //----------------------------------------------------------------------
 
-// For unique_ptr support
-#include <memory>
-
 #include <ESP8266WiFi.h>
-#include "Adafruit_MQTT.h"
-#include "Adafruit_MQTT_Client.h"
+
+// std::function support
+#include <functional>
+#include <vector>
+
+#include "asyncdnslookup.h"
 
 //----------------------------------------------------------------------
 // Type Declarations
@@ -76,7 +77,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // WARNINGS!!!
 //======================================================================
 
-// None.
+// The ESP8266 core has no non-blocking TCP connect.  Each connect 
+// attempt blocks the whole loop (web server included) for up to 
+// TCP_CONNECT_TIMEOUT_MS when the broker doesn't answer.  With the 
+// backoff that happens at most once per retry, so at worst once a 
+// minute against a broker that stays down.
 
 //======================================================================
 // FUNCTION DECLARATIONS
@@ -102,12 +107,21 @@ DESCRIPTION:
 Proxy class that hides the details of using MQTT on a micro/SoC 
 platform.
 
+The broker connection is a state machine stepped by Process():
+
+    DISCONNECTED -> RESOLVING -> WAIT_CONNACK -> CONNECTED
+                        |             |              |
+                        v             v              |
+                     BACKOFF <--------+--------------+
+
+The name lookup and the CONNACK wait are polled.  The TCP connect is
+the one blocking step (see WARNINGS).  Failed attempts back 
+off exponentially with some random jitter.
+
 HOW TO USE:
 1. Construct with the required info
-2. Call Connect() to connect to the MQTT broker (server).
-3. Call Publish() to publish data. 
-
-A good usage pattern would be to pair Connect() then a Publish() call.
+2. Call Process() regularly while the WLAN is up.
+3. Call Publish() to publish data once IsConnected() says so.
 
 ======================================================================*/
 class MqttProxy
@@ -118,7 +132,49 @@ class MqttProxy
     // TYPE DECLARATIONS AND CONSTANTS    
     //=================================================================
 
-    // None.
+    enum ConnectionState
+    {
+        MQTT_DISCONNECTED = 0,
+        MQTT_RESOLVING,
+        MQTT_WAIT_CONNACK,
+        MQTT_CONNECTED,
+        MQTT_BACKOFF
+    };
+
+    // Upper bound on the (blocking) TCP connect.  Plenty for a broker
+    // on the local network or a nearby one on the Internet, and short
+    // enough that a dead one is a hiccup rather than a stall.
+    static const unsigned long TCP_CONNECT_TIMEOUT_MS = 200;
+
+    static const unsigned long DNS_TIMEOUT_MS     = 5000;
+    static const unsigned long CONNACK_TIMEOUT_MS = 5000;
+
+    // Backoff after the first failure, doubled after each one after
+    // that up to the max
+    static const unsigned long BACKOFF_MIN_MS = 1000;
+    static const unsigned long BACKOFF_MAX_MS = 60000;
+
+    // +/- this percent of the backoff is random
+    static const int BACKOFF_JITTER_PERCENT = 25;
+
+    // Keepalive we ask the broker for
+    static const uint16_t KEEPALIVE_S = 60;
+
+    // We ping when we haven't sent anything for the keepalive less
+    // this margin, so the broker never sees us go quiet
+    static const unsigned long PING_MARGIN_MS = 5000;
+
+    // A broker that doesn't answer a ping in this long is gone
+    static const unsigned long PINGRESP_TIMEOUT_MS = 10000;
+
+    // Largest incoming packet body we keep.  Bigger ones are skipped.
+    static const uint16_t RX_BUFFER_SIZE = 128;
+
+    // Called from Process() for each message on a subscribed topic.
+    // retained is set when the broker is replaying a message it kept
+    // (which it does on every subscribe) rather than passing on a new
+    // one.
+    typedef std::function<void( const String &topic, const uint8_t *payload, size_t length, bool retained )> MessageCallback;
 
     //=================================================================
     // CLIENT INTERFACE
@@ -129,17 +185,50 @@ class MqttProxy
                const int mqttport,
                const String &mqttPublishFeed);
 
-    // Call to connect to the MQTT broker (server).  This method is
-    // safe to call even if already connected.  
-    bool Connect();
+    // Advances the connection state machine one step.  Only a connect
+    // attempt waits on the broker, for up to TCP_CONNECT_TIMEOUT_MS.
+    void Process();
+
+    bool IsConnected() const { return _state == MQTT_CONNECTED; }
+
+    ConnectionState GetState() const { return _state; }
+
+    static const char *StateToString( ConnectionState state );
+
+    // Number of times we have connected, and connect attempts that
+    // failed, since boot
+    uint32_t GetConnectCount() const { return _connectCount; }
+    uint32_t GetFailedCount() const { return _failedCount; }
+
+    // Round trip time of the last answered ping, 0 if there hasn't 
+    // been one on this connection yet
+    unsigned long GetPingRttMS() const { return _pingRttMS; }
+
+    // Sets the last will the broker publishes (retained) if we drop
+    // off without saying goodbye.  Takes effect on the next connect.
+    void SetWill( const String &topic, const String &message );
+
+    // Sets the username and password sent in CONNECT, for brokers that
+    // require a login.  An empty username sends neither.  Takes effect
+    // on the next connect.
+    void SetCredentials( const String &username, const String &password );
 
     // Publishes that message to the feed that was specified
-    // when this object was constructed
+    // when this object was constructed.  Returns false right away if
+    // we aren't connected.
     bool Publish( const String &message );
 
-    // If you don't have data to publish, you should periodically call
-    // this method to keep the connection alive.
-    bool Ping();
+    // Publishes to any topic.  A retained message is kept by the 
+    // broker and handed to anyone who subscribes later.
+    bool Publish( const String &topic, const String &message, bool retain );
+
+    bool Publish( const String &topic, const uint8_t *payload, size_t length, bool retain );
+
+    // Subscribes (QoS 0) to the topic filter, now if we are connected
+    // and again on every reconnect
+    void Subscribe( const String &topicFilter );
+
+    void OnMessage( MessageCallback callback ) { _messageCallback = callback; }
 
     protected:
 
@@ -161,7 +250,45 @@ class MqttProxy
     // IMPLEMENTATION INTERFACE    
     //=================================================================
 
-    // None.
+    enum RxPhase
+    {
+        RX_TYPE = 0,
+        RX_LENGTH,
+        RX_BODY
+    };
+
+    // Opens the TCP connection and sends CONNECT
+    void openConnection();
+
+    // Writes a whole packet, and notes the time for the keepalive
+    bool send( const uint8_t *packet, size_t length );
+
+    bool sendSubscribe( const String &topicFilter );
+
+    // Hands an incoming PUBLISH to the message callback
+    void messageReceived();
+
+    // Reads whatever has arrived, a byte at a time, and hands each
+    // complete packet to packetReceived()
+    void receive();
+
+    void packetReceived();
+
+    // Sends a PINGREQ if we have been quiet for close to the
+    // keepalive, and checks on the answer to the last one
+    void keepAlive();
+
+    void connected();
+
+    // Drops the connection, schedules the next attempt and moves to
+    // BACKOFF
+    void backoff( const char *why );
+
+    void setState( ConnectionState state );
+
+    // No copying. Leaving the implementation undefined to cause a link
+    // error
+    MqttProxy( const MqttProxy &rhs );
 
     //=================================================================
     // DATA MEMBERS    
@@ -169,21 +296,57 @@ class MqttProxy
 
     WiFiClient _wifiClient;
 
-    std::unique_ptr<Adafruit_MQTT_Client> _mqttClient;
-
-    std::unique_ptr<Adafruit_MQTT_Publish> _mqttPublisher;
-
     int _mqttport;
 
-    // After a bit of debugging, the AdaFruit MQTT libraries will only
-    // cache a char* to the memory location given.  For example, if you
-    // allocate the server name on the stack while constructing this object, 
-    // then later try to call connect(), the server name is POOF.  Rather than
-    // follow most Arduino dev patterns of declaring globals, we'll make
-    // this object properly manage the state (buffers)
     String _mqttserver;
     String _mqttfeedPubName;
 
+    // Empty topic means no will
+    String _willTopic;
+    String _willMessage;
+
+    // Empty username means no login
+    String _username;
+    String _password;
+
+    std::vector<String> _subscriptions;
+
+    MessageCallback _messageCallback;
+
+    uint16_t _nextPacketId;
+
+    // Unique per device so brokers don't kick one of us off when
+    // another connects
+    String _clientId;
+
+    ConnectionState _state;
+
+    // millis() when the current state started
+    unsigned long _stateStartMS;
+
+    unsigned long _backoffMS;
+    unsigned long _retryDelayMS;
+
+    uint32_t _connectCount;
+    uint32_t _failedCount;
+
+    IPAddress      _serverAddress;
+    AsyncDnsLookup _dns;
+
+    // millis() when we last sent the broker anything
+    unsigned long _lastSendMS;
+
+    bool          _pingPending;
+    unsigned long _pingSentMS;
+    unsigned long _pingRttMS;
+
+    // Incoming packet being put together
+    RxPhase  _rxPhase;
+    uint8_t  _rxType;
+    uint32_t _rxLength;
+    uint8_t  _rxShift;
+    uint32_t _rxCount;
+    uint8_t  _rxBuffer[RX_BUFFER_SIZE];
 };
 
 //======================================================================
@@ -0,0 +1,392 @@
+/*======================================================================
+FILE:
+relayactuator.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Drives the garage door opener relays without blocking.  A pulse is
+started right away (or queued) and an os_timer ends it, so the caller
+gets control back in microseconds instead of spinning for the length
+of the pulse.
+
+PUBLIC CLASSES AND FUNCTIONS:
+RelayActuator
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+Register() a relay pin before pulsing it.
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "relayactuator.h"
+
+#include "Arduino.h"
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+RelayActuator::Relay RelayActuator::_relays[RelayActuator::MAX_RELAYS];
+
+int RelayActuator::_relayCount = 0;
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+Register()
+
+DESCRIPTION:
+Claims a relay slot for the pin and drives the relay off.
+
+RETURN VALUE:
+true if the pin is registered (now or already).  false if all the
+slots are taken.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool RelayActuator::Register( int relayPin )
+{
+    if ( find( relayPin ) != nullptr )
+    {
+        return true;
+    }
+
+    if ( _relayCount >= MAX_RELAYS )
+    {
+        Serial.printf( "RelayActuator: no free slot for pin %d\n", relayPin );
+        return false;
+    }
+
+    Relay &relay = _relays[_relayCount];
+
+    relay.pin         = relayPin;
+    relay.phase       = PHASE_IDLE;
+    relay.head        = 0;
+    relay.count       = 0;
+    relay.pulses      = 0;
+    relay.lastStartMS = 0;
+
+    // Pretend the last pulse ended a gap ago so the first one
+    // can start right away
+    relay.lastEndMS   = millis() - MIN_GAP_MS;
+
+    os_timer_disarm( &relay.timer );
+    os_timer_setfn( &relay.timer, onTimer, &relay );
+
+    pinMode( relayPin, OUTPUT );
+    digitalWrite( relayPin, LOW );
+
+    _relayCount++;
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+Pulse()
+
+DESCRIPTION:
+Queues a button press on the relay.  If the relay is idle it starts
+now (or as soon as the gap after the last pulse is up).
+
+RETURN VALUE:
+true if the pulse was queued.
+
+SIDE EFFECTS:
+Arms the relay's os_timer.
+
+======================================================================*/
+bool RelayActuator::Pulse( int relayPin, unsigned long durationMS )
+{
+    Relay *relay = find( relayPin );
+
+    if ( relay == nullptr || relay->count >= QUEUE_DEPTH )
+    {
+        return false;
+    }
+
+    int tail = ( relay->head + relay->count ) % QUEUE_DEPTH;
+
+    relay->queue[tail] = durationMS;
+    relay->count++;
+
+    // A running pulse or gap picks the new one up when its timer fires
+    if ( relay->phase == PHASE_IDLE )
+    {
+        startNext( *relay );
+    }
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+GetQueuedCount()
+
+DESCRIPTION:
+Number of pulses queued that haven't started yet
+
+RETURN VALUE:
+Count, 0 for an unknown pin.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+int RelayActuator::GetQueuedCount( int relayPin )
+{
+    Relay *relay = find( relayPin );
+
+    return ( relay != nullptr ) ? relay->count : 0;
+}
+
+/*======================================================================
+FUNCTION:
+IsBusy()
+
+DESCRIPTION:
+Checks if the relay is pulsing or waiting out the gap
+
+RETURN VALUE:
+true if busy.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool RelayActuator::IsBusy( int relayPin )
+{
+    Relay *relay = find( relayPin );
+
+    return ( relay != nullptr ) && ( relay->phase != PHASE_IDLE );
+}
+
+/*======================================================================
+FUNCTION:
+GetPulseCount()
+
+DESCRIPTION:
+Number of pulses started on the relay since boot
+
+RETURN VALUE:
+Count, 0 for an unknown pin.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+uint32_t RelayActuator::GetPulseCount( int relayPin )
+{
+    Relay *relay = find( relayPin );
+
+    return ( relay != nullptr ) ? relay->pulses : 0;
+}
+
+/*======================================================================
+FUNCTION:
+GetLastPulseMS()
+
+DESCRIPTION:
+When the last pulse started
+
+RETURN VALUE:
+millis() timestamp, 0 if there hasn't been one.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+unsigned long RelayActuator::GetLastPulseMS( int relayPin )
+{
+    Relay *relay = find( relayPin );
+
+    return ( relay != nullptr ) ? relay->lastStartMS : 0;
+}
+
+/*======================================================================
+FUNCTION:
+find()
+
+DESCRIPTION:
+Looks up the slot for a relay pin
+
+RETURN VALUE:
+The slot, or nullptr if the pin isn't registered.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+RelayActuator::Relay *RelayActuator::find( int relayPin )
+{
+    for ( int i = 0; i < _relayCount; i++ )
+    {
+        if ( _relays[i].pin == relayPin )
+        {
+            return &_relays[i];
+        }
+    }
+
+    return nullptr;
+}
+
+/*======================================================================
+FUNCTION:
+startNext()
+
+DESCRIPTION:
+Starts the next queued pulse if the gap since the last one is up.
+Otherwise parks the relay in the gap phase with the timer set for
+whatever is left of it.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+Drives the relay pin and arms the relay's os_timer.
+
+======================================================================*/
+void RelayActuator::startNext( Relay &relay )
+{
+    if ( relay.count == 0 )
+    {
+        relay.phase = PHASE_IDLE;
+        return;
+    }
+
+    unsigned long now = millis();
+    unsigned long sinceEnd = now - relay.lastEndMS;
+
+    if ( sinceEnd < MIN_GAP_MS )
+    {
+        relay.phase = PHASE_GAP;
+        os_timer_arm( &relay.timer, MIN_GAP_MS - sinceEnd, false );
+        return;
+    }
+
+    unsigned long durationMS = relay.queue[relay.head];
+
+    relay.head = ( relay.head + 1 ) % QUEUE_DEPTH;
+    relay.count--;
+
+    digitalWrite( relay.pin, HIGH );
+
+    relay.phase       = PHASE_PULSING;
+    relay.lastStartMS = now;
+    relay.pulses++;
+
+    os_timer_arm( &relay.timer, durationMS, false );
+}
+
+/*======================================================================
+FUNCTION:
+onTimer()
+
+DESCRIPTION:
+Timer callback.  At the end of a pulse this releases the relay and
+moves on to the gap; at the end of a gap it starts the next pulse.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+Drives the relay pin.
+
+======================================================================*/
+void RelayActuator::onTimer( void *arg )
+{
+    Relay &relay = *static_cast<Relay *>( arg );
+
+    if ( relay.phase == PHASE_PULSING )
+    {
+        digitalWrite( relay.pin, LOW );
+
+        relay.lastEndMS = millis();
+
+        if ( relay.count == 0 )
+        {
+            // Stay busy through the gap so nobody thinks they can
+            // press again right away
+            relay.phase = PHASE_GAP;
+            os_timer_arm( &relay.timer, MIN_GAP_MS, false );
+            return;
+        }
+    }
+
+    startNext( relay );
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
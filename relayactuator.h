@@ -0,0 +1,242 @@
+#ifndef _GARAGEOMATIC_RELAYACTUATOR_H_
+#define _GARAGEOMATIC_RELAYACTUATOR_H_
+
+/*======================================================================
+FILE:
+relayactuator.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Drives the garage door opener relays without blocking.  A pulse is
+started right away (or queued) and an os_timer ends it, so the caller
+gets control back in microseconds instead of spinning for the length
+of the pulse.
+
+PUBLIC CLASSES AND FUNCTIONS:
+RelayActuator
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <stdint.h>
+
+extern "C" {
+#include "user_interface.h"
+}
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// The pulse timers run from the SDK timer task, between loop() passes.
+// Anything they touch is read from the main loop through the getters
+// below, never written by it.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+RelayActuator
+
+DESCRIPTION:
+Owns the relay pins.  Each relay has a small queue of pulses and one
+os_timer that walks it through IDLE -> PULSING -> GAP -> ... so that
+back to back pulses are always at least MIN_GAP_MS apart.  A garage
+door opener treats two presses that are too close together as one (or
+ignores the second), which is why the gap exists.
+
+Pulses are counted as they start, so the door state machine can tell
+that the opener was pressed and when.
+
+HOW TO USE:
+1. Call Register() with the relay pin (GarageDoor does this).
+2. Call Pulse() to queue a button press.
+3. Read GetPulseCount()/GetLastPulseMS() to see pulses as they start.
+
+======================================================================*/
+class RelayActuator
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    static const int MAX_RELAYS = 4;
+
+    // Pulses that can wait behind the one that is running
+    static const int QUEUE_DEPTH = 4;
+
+    static const unsigned long DEFAULT_PULSE_MS = 500;
+
+    // Minimum time between the end of one pulse and the start of the
+    // next on the same relay
+    static const unsigned long MIN_GAP_MS = 1000;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    // Sets the pin up as an output (relay off).  Registering the same
+    // pin again is harmless.
+    static bool Register( int relayPin );
+
+    // Queues a pulse.  It starts right away if the relay is idle and
+    // the gap has passed.  Returns false if the pin isn't registered
+    // or the queue is full.
+    static bool Pulse( int relayPin, unsigned long durationMS = DEFAULT_PULSE_MS );
+
+    // Number of pulses waiting to start
+    static int GetQueuedCount( int relayPin );
+
+    // true while a pulse is running or waiting out the gap
+    static bool IsBusy( int relayPin );
+
+    // Number of pulses started since boot
+    static uint32_t GetPulseCount( int relayPin );
+
+    // millis() when the last pulse started
+    static unsigned long GetLastPulseMS( int relayPin );
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    enum Phase
+    {
+        PHASE_IDLE = 0,
+        PHASE_PULSING,
+        PHASE_GAP
+    };
+
+    struct Relay
+    {
+        int           pin;
+        os_timer_t    timer;
+        volatile int  phase;
+
+        unsigned long queue[QUEUE_DEPTH];
+        volatile int  head;
+        volatile int  count;
+
+        volatile uint32_t      pulses;
+        volatile unsigned long lastStartMS;
+        volatile unsigned long lastEndMS;
+    };
+
+    // No direct construction by callers. We won't define an
+    // implementation to throw a link error in case someone magically
+    // finds a way to try to directly instantiate this object
+    RelayActuator();
+
+    static Relay *find( int relayPin );
+
+    // Starts the next queued pulse, or waits out the rest of the gap
+    static void startNext( Relay &relay );
+
+    // os_timer callback for the end of a pulse or the end of a gap
+    static void onTimer( void *arg );
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    static Relay _relays[MAX_RELAYS];
+
+    static int _relayCount;
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+// None.
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+None.
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_RELAYACTUATOR_H_
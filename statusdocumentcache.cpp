@@ -0,0 +1,191 @@
+/*======================================================================
+FILE:
+statusdocumentcache.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Keeps the rendered all doors status document around so every reader
+(MQTT, HTTP, ...) gets the same bytes without formatting them again.
+
+PUBLIC CLASSES AND FUNCTIONS:
+StatusDocumentCache
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+Begin() before Get().
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "statusdocumentcache.h"
+#include "garagedoor.h"
+#include "doorinputsnapshot.h"
+
+#include <TimeLib.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+StatusDocumentCache()
+
+DESCRIPTION:
+C-tor.  Nothing is rendered until the first Get().
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+StatusDocumentCache::StatusDocumentCache()
+    : _length( 0 ), _rendered( false ), _renderedVersion( 0 ),
+      _renderedLevels( 0 ), _renderedSecond( 0 ), _renderCount( 0 )
+{
+    _document[0] = 0;
+}
+
+/*======================================================================
+FUNCTION:
+Begin()
+
+DESCRIPTION:
+Sets the function that renders the document
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void StatusDocumentCache::Begin( RenderFunction render )
+{
+    _render = render;
+
+    _rendered = false;
+}
+
+/*======================================================================
+FUNCTION:
+Get()
+
+DESCRIPTION:
+Hands back the cached document.  It is only rendered again if a door
+changed state, a sensor input moved or the clock ticked over to a new
+second since the last render, so a burst of readers costs one render.
+
+RETURN VALUE:
+The document, nullptr if it couldn't be rendered.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+const char *StatusDocumentCache::Get( size_t &length )
+{
+    time_t   second  = now();
+    uint32_t version = GarageDoor::GetLatestStateVersion();
+    uint32_t levels  = DoorInputSnapshot::Current().GetLevels();
+
+    if ( false == _rendered          || 
+         _renderedVersion != version || 
+         _renderedLevels  != levels  || 
+         _renderedSecond  != second )
+    {
+        _length = 0;
+
+        if ( _render )
+        {
+            _length = _render( _document, sizeof( _document ) );
+        }
+
+        _rendered        = true;
+        _renderedVersion = version;
+        _renderedLevels  = levels;
+        _renderedSecond  = second;
+        _renderCount++;
+    }
+
+    length = _length;
+
+    return ( _length != 0 ) ? _document : nullptr;
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
@@ -0,0 +1,202 @@
+#ifndef _GARAGEOMATIC_STATUSDOCUMENTCACHE_H_
+#define _GARAGEOMATIC_STATUSDOCUMENTCACHE_H_
+
+/*======================================================================
+FILE:
+statusdocumentcache.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Keeps the rendered all doors status document around so every reader
+(MQTT, HTTP, ...) gets the same bytes without formatting them again.
+
+PUBLIC CLASSES AND FUNCTIONS:
+StatusDocumentCache
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <functional>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// The pointer Get() returns is only good until the next Get().  Send 
+// (or copy) the bytes before yielding.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+StatusDocumentCache
+
+DESCRIPTION:
+One rendered copy of the status document, tagged with the door state
+version (GarageDoor::GetLatestStateVersion()), the raw sensor levels 
+and the clock second it was rendered at.  The document goes stale when
+any of them moves; until then Get() just hands back the bytes.
+
+The millisecond ages in the document are as of the render, so they 
+can be up to a second old.
+
+HOW TO USE:
+1. Call Begin() with the function that renders the document.
+2. Call Get() to send it.
+
+======================================================================*/
+class StatusDocumentCache
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    // Four doors plus the link and clock objects come to about 850 
+    // bytes.  It also has to fit in an outbox message.
+    static const size_t MAX_DOCUMENT_BYTES = 1024;
+
+    // Renders into the buffer.  Returns the length, 0 if it didn't
+    // fit.
+    typedef std::function<size_t( char *buffer, size_t size )> RenderFunction;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    StatusDocumentCache();
+
+    void Begin( RenderFunction render );
+
+    // The document (NUL terminated), rendered again first if it is 
+    // stale.  nullptr if it can't be rendered.
+    const char *Get( size_t &length );
+
+    // Number of times the document has been rendered since boot
+    uint32_t GetRenderCount() const { return _renderCount; }
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    // No copying. Leaving the implementation undefined to cause a link
+    // error
+    StatusDocumentCache( const StatusDocumentCache &rhs );
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    RenderFunction _render;
+
+    char   _document[MAX_DOCUMENT_BYTES];
+    size_t _length;
+
+    // What the document in the buffer was rendered for
+    bool     _rendered;
+    uint32_t _renderedVersion;
+    uint32_t _renderedLevels;
+    time_t   _renderedSecond;
+
+    uint32_t _renderCount;
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+// None.
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+None.
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_STATUSDOCUMENTCACHE_H_
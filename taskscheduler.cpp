@@ -0,0 +1,424 @@
+/*======================================================================
+FILE:
+taskscheduler.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+A small cooperative task scheduler.  Work is broken up into tasks that
+run to completion quickly and the scheduler calls them when they are
+due, which keeps the main loop from blocking on any one subsystem.
+
+PUBLIC CLASSES AND FUNCTIONS:
+TaskScheduler
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+Process() must be called from loop().
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "taskscheduler.h"
+
+#include "Arduino.h"
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+TaskScheduler()
+
+DESCRIPTION:
+C-tor
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+TaskScheduler::TaskScheduler()
+{
+    for ( int i = 0; i < MAX_TASKS; i++ )
+    {
+        _tasks[i].intervalMS = 0;
+        _tasks[i].deadline   = 0;
+        _tasks[i].periodic   = false;
+        _tasks[i].active     = false;
+
+        _runQueue[i] = INVALID_TASK;
+    }
+}
+
+/*======================================================================
+FUNCTION:
+SchedulePeriodic()
+
+DESCRIPTION:
+Adds a task that runs every intervalMS milliseconds.
+
+RETURN VALUE:
+The task id, or INVALID_TASK if there are no free task slots.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+TaskScheduler::TaskId TaskScheduler::SchedulePeriodic( TaskCallback callback,
+                                                       unsigned long intervalMS,
+                                                       unsigned long initialDelayMS )
+{
+    return schedule( callback, intervalMS, initialDelayMS, true );
+}
+
+/*======================================================================
+FUNCTION:
+ScheduleOnce()
+
+DESCRIPTION:
+Adds a task that runs one time after delayMS milliseconds.  The task
+slot is freed once the task has run.
+
+RETURN VALUE:
+The task id, or INVALID_TASK if there are no free task slots.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+TaskScheduler::TaskId TaskScheduler::ScheduleOnce( TaskCallback callback, unsigned long delayMS )
+{
+    return schedule( callback, 0, delayMS, false );
+}
+
+/*======================================================================
+FUNCTION:
+Reschedule()
+
+DESCRIPTION:
+Moves the task's next deadline to delayMS milliseconds from now.  A
+periodic task keeps its interval after that.
+
+RETURN VALUE:
+true if the task exists.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool TaskScheduler::Reschedule( TaskId id, unsigned long delayMS )
+{
+    if ( IsScheduled( id ) == false )
+    {
+        return false;
+    }
+
+    _tasks[id].deadline = millis() + delayMS;
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+Cancel()
+
+DESCRIPTION:
+Removes the task from the scheduler.  This is safe to call from inside
+a running task, including the task cancelling itself.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void TaskScheduler::Cancel( TaskId id )
+{
+    if ( id < 0 || id >= MAX_TASKS )
+    {
+        return;
+    }
+
+    _tasks[id].active = false;
+}
+
+/*======================================================================
+FUNCTION:
+IsScheduled()
+
+DESCRIPTION:
+Checks if the task id refers to an active task.
+
+RETURN VALUE:
+true if the task is active.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool TaskScheduler::IsScheduled( TaskId id ) const
+{
+    if ( id < 0 || id >= MAX_TASKS )
+    {
+        return false;
+    }
+
+    return _tasks[id].active;
+}
+
+/*======================================================================
+FUNCTION:
+RunPending()
+
+DESCRIPTION:
+Builds the run queue from every task whose deadline has passed, sorts
+it so the most overdue task runs first, then runs the queue.  Periodic
+tasks are given their next deadline before they run, and one-shot
+tasks are removed before they run, so a callback is free to reschedule
+or cancel itself.
+
+RETURN VALUE:
+Number of milliseconds until the next task is due.  0 means something
+is already due again.
+
+SIDE EFFECTS:
+Runs task callbacks.
+
+======================================================================*/
+unsigned long TaskScheduler::RunPending()
+{
+    unsigned long now = millis();
+
+    int queued = 0;
+
+    for ( int i = 0; i < MAX_TASKS; i++ )
+    {
+        if ( _tasks[i].active == false || isDue( _tasks[i].deadline, now ) == false )
+        {
+            continue;
+        }
+
+        // Insertion sort on the deadline.  There are only a handful
+        // of tasks, so this is cheaper than anything fancier.
+        int pos = queued;
+
+        while ( pos > 0 &&
+                (long) ( _tasks[_runQueue[pos - 1]].deadline - _tasks[i].deadline ) > 0 )
+        {
+            _runQueue[pos] = _runQueue[pos - 1];
+            pos--;
+        }
+
+        _runQueue[pos] = i;
+        queued++;
+    }
+
+    for ( int q = 0; q < queued; q++ )
+    {
+        Task &task = _tasks[_runQueue[q]];
+
+        // An earlier task on this pass may have cancelled this one
+        if ( task.active == false )
+        {
+            continue;
+        }
+
+        if ( task.periodic == true )
+        {
+            task.deadline += task.intervalMS;
+
+            // If we fell more than an interval behind, don't try to
+            // catch up with a burst of back-to-back runs.
+            if ( isDue( task.deadline, now ) == true )
+            {
+                task.deadline = now + task.intervalMS;
+            }
+        }
+        else
+        {
+            task.active = false;
+        }
+
+        // Copy the callback so a task that cancels itself and gets its
+        // slot reused doesn't pull the function out from under us.
+        TaskCallback callback = task.callback;
+
+        callback();
+    }
+
+    // Figure out how long until the next deadline
+    now = millis();
+
+    unsigned long wait = MAX_IDLE_MS;
+
+    for ( int i = 0; i < MAX_TASKS; i++ )
+    {
+        if ( _tasks[i].active == false )
+        {
+            continue;
+        }
+
+        if ( isDue( _tasks[i].deadline, now ) == true )
+        {
+            return 0;
+        }
+
+        unsigned long remaining = _tasks[i].deadline - now;
+
+        if ( remaining < wait )
+        {
+            wait = remaining;
+        }
+    }
+
+    return wait;
+}
+
+/*======================================================================
+FUNCTION:
+Process()
+
+DESCRIPTION:
+Call this from loop().  Runs any due tasks and, when nothing else is
+due, idles until the next deadline.  delay() hands the time back to
+the SDK so the WiFi stack keeps running while we wait.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void TaskScheduler::Process()
+{
+    unsigned long wait = RunPending();
+
+    if ( wait > 0 )
+    {
+        delay( wait );
+    }
+    else
+    {
+        yield();
+    }
+}
+
+/*======================================================================
+FUNCTION:
+schedule()
+
+DESCRIPTION:
+Finds a free task slot and fills it in.
+
+RETURN VALUE:
+The task id, or INVALID_TASK if there are no free task slots.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+TaskScheduler::TaskId TaskScheduler::schedule( TaskCallback callback,
+                                               unsigned long intervalMS,
+                                               unsigned long delayMS,
+                                               bool periodic )
+{
+    for ( int i = 0; i < MAX_TASKS; i++ )
+    {
+        if ( _tasks[i].active == true )
+        {
+            continue;
+        }
+
+        _tasks[i].callback   = callback;
+        _tasks[i].intervalMS = intervalMS;
+        _tasks[i].deadline   = millis() + delayMS;
+        _tasks[i].periodic   = periodic;
+        _tasks[i].active     = true;
+
+        return i;
+    }
+
+    Serial.println( "TaskScheduler: no free task slots" );
+
+    return INVALID_TASK;
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
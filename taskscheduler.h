@@ -0,0 +1,235 @@
+#ifndef _GARAGEOMATIC_TASKSCHEDULER_H_
+#define _GARAGEOMATIC_TASKSCHEDULER_H_
+
+/*======================================================================
+FILE:
+taskscheduler.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+A small cooperative task scheduler.  Work is broken up into tasks that
+run to completion quickly and the scheduler calls them when they are
+due, which keeps the main loop from blocking on any one subsystem.
+
+PUBLIC CLASSES AND FUNCTIONS:
+TaskScheduler
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+// std::function support
+#include <functional>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// Tasks are cooperative.  A task that blocks holds up every other
+// task, so keep each callback short and return right away.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+TaskScheduler
+
+DESCRIPTION:
+Runs periodic and one-shot tasks from the main loop.  Each task has a
+deadline (in millis() time).  On every pass the scheduler builds a run
+queue of the tasks whose deadline has passed, ordered earliest first,
+and runs them.  When nothing is due the scheduler idles until the next
+deadline so the loop does not spin.
+
+HOW TO USE:
+1. Construct the object (usually as a global).
+2. Call SchedulePeriodic() or ScheduleOnce() to add tasks.
+3. Call Process() from loop().
+
+======================================================================*/
+class TaskScheduler
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    typedef std::function<void()> TaskCallback;
+
+    typedef int TaskId;
+
+    // Returned when a task could not be scheduled
+    static const TaskId INVALID_TASK = -1;
+
+    // Fixed number of task slots.  We don't allocate per-task so
+    // the heap doesn't fragment as tasks come and go.
+    static const int MAX_TASKS = 16;
+
+    // Upper bound on how long Process() will idle in one call.  This
+    // keeps the loop (and the SDK) serviced even with no tasks due.
+    static const unsigned long MAX_IDLE_MS = 10;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    TaskScheduler();
+
+    // Runs the callback every intervalMS, starting after
+    // initialDelayMS.  An interval of 0 runs the task on every pass.
+    TaskId SchedulePeriodic( TaskCallback callback,
+                             unsigned long intervalMS,
+                             unsigned long initialDelayMS = 0 );
+
+    // Runs the callback once after delayMS
+    TaskId ScheduleOnce( TaskCallback callback, unsigned long delayMS );
+
+    // Moves the task's next deadline to delayMS from now
+    bool Reschedule( TaskId id, unsigned long delayMS );
+
+    // Removes the task.  Safe to call from inside a task callback.
+    void Cancel( TaskId id );
+
+    bool IsScheduled( TaskId id ) const;
+
+    // Runs every task that is due and returns the number of
+    // milliseconds until the next deadline.
+    unsigned long RunPending();
+
+    // Runs the due tasks, then idles until the next deadline
+    // (capped at MAX_IDLE_MS).
+    void Process();
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    struct Task
+    {
+        TaskCallback  callback;
+        unsigned long intervalMS;
+        unsigned long deadline;
+        bool          periodic;
+        bool          active;
+    };
+
+    TaskId schedule( TaskCallback callback,
+                     unsigned long intervalMS,
+                     unsigned long delayMS,
+                     bool periodic );
+
+    // Wrap-safe check if a millis() deadline has passed
+    static bool isDue( unsigned long deadline, unsigned long now );
+
+    // No copying. Leaving the implementation undefined to cause a link
+    // error
+    TaskScheduler( const TaskScheduler &rhs );
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    Task _tasks[MAX_TASKS];
+
+    // Indexes of the tasks to run on this pass, earliest deadline first
+    TaskId _runQueue[MAX_TASKS];
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+inline bool TaskScheduler::isDue( unsigned long deadline, unsigned long now )
+{
+    // Signed difference handles millis() rolling over
+    return (long) ( now - deadline ) >= 0;
+}
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+None.
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_TASKSCHEDULER_H_
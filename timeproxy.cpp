@@ -6,9 +6,10 @@ CREATOR:
 Sean Foley
 
 GENERAL DESCRIPTION:
-Uses Network Time Protocol (NTP) to seed the timing routines.  This code is
-based on the TimeNTP_ESP8266WIFI example (there is no copyright/author info
-in the file to give credit to - thanks and you rock!)
+Uses Network Time Protocol (NTP) to discipline a millisecond clock and
+keep the timing routines in step with it.  This code started out from
+the TimeNTP_ESP8266WIFI example (there is no copyright/author info in
+the file to give credit to - thanks and you rock!)
 
 PUBLIC CLASSES AND FUNCTIONS:
 TimeProxy
@@ -51,10 +52,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "timeproxy.h"
 
 #include <TimeLib.h>
+#include <limits.h>
 #include <ESP8266WiFi.h>
 #include <WiFiUdp.h>
 
-
 //----------------------------------------------------------------------
 // Type Declarations
 //----------------------------------------------------------------------
@@ -68,6 +69,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // NTP time is in the first 48 bytes of message
 const int NTP_PACKET_SIZE = 48; 
 
+// Where the fields we use sit in the packet
+const int NTP_ROOT_DELAY_OFFSET      = 4;
+const int NTP_ROOT_DISPERSION_OFFSET = 8;
+const int NTP_ORIGINATE_OFFSET       = 24;
+const int NTP_RECEIVE_OFFSET         = 32;
+const int NTP_TRANSMIT_OFFSET        = 40;
+
+// Seconds from 1900 (NTP) to 1970 (Unix)
+const int64_t NTP_UNIX_EPOCH_S = 2208988800LL;
+
 //----------------------------------------------------------------------
 // Global Data Definitions
 //----------------------------------------------------------------------
@@ -80,11 +91,11 @@ const int NTP_PACKET_SIZE = 48;
 
 WiFiUDP TimeProxy::_udp;
 
-String TimeProxy::_ntpServer;
+TimeProxy *TimeProxy::_instance = nullptr;
 
-// We haven't built functionality to reference back to 
-// UTC yet, so we need to start at UTC time for now.
-int TimeProxy::_timezone = TimeProxy::TimeZones::UTC;
+char   TimeProxy::_timeCache[20] = { 0 };
+time_t TimeProxy::_timeCacheTime = 0;
+long   TimeProxy::_timeCacheDay  = -1;
 
 // NTP Servers:
 //static const char ntpServerName[] = "us.pool.ntp.org";
@@ -97,7 +108,8 @@ int TimeProxy::_timezone = TimeProxy::TimeZones::UTC;
 // Function Prototypes
 //----------------------------------------------------------------------
 
-// None.
+static void putUint32( uint8_t *p, uint32_t value );
+static uint32_t getUint32( const uint8_t *p );
 
 //----------------------------------------------------------------------
 // Required Libraries
@@ -115,7 +127,7 @@ FUNCTION:
 TimeProxy()
 
 DESCRIPTION:
-C-tor
+C-tor.  Splits the server list on commas.
 
 RETURN VALUE:
 none.
@@ -124,10 +136,49 @@ SIDE EFFECTS:
 none
 
 ======================================================================*/
-TimeProxy::TimeProxy( const String &ntpServer, unsigned int syncIntervalS )
-    :_syncIntervalS( syncIntervalS )
+TimeProxy::TimeProxy( const String &ntpServers, unsigned int syncIntervalS )
+    :_serverCount( 0 ), _syncIntervalS( syncIntervalS ), _state( NTP_IDLE ),
+     _stateStartMS( 0 ), _nextSyncMS( 0 ), _synced( false ), 
+     _serverIndex( 0 ), _requestUs( 0 ), _baseUs( 0 ), _baseMS( 0 ),
+     _driftPpb( 0 ), _slewUs( 0 ), _lastSyncMS( 0 ), _lastOffsetUs( 0 ),
+     _lastDelayUs( 0 ), _lastRootDistanceUs( 0 ), _selectedServer( -1 )
 {
-    _ntpServer = ntpServer;
+    _best.valid = false;
+
+    if ( _syncIntervalS < MIN_POLL_S )
+    {
+        _syncIntervalS = MIN_POLL_S;
+    }
+    else if ( _syncIntervalS > MAX_POLL_S )
+    {
+        _syncIntervalS = MAX_POLL_S;
+    }
+
+    int start = 0;
+
+    while ( start <= (int) ntpServers.length() && _serverCount < MAX_SERVERS )
+    {
+        int comma = ntpServers.indexOf( ',', start );
+
+        if ( comma < 0 )
+        {
+            comma = ntpServers.length();
+        }
+
+        String name = ntpServers.substring( start, comma );
+        name.trim();
+
+        if ( name.length() > 0 )
+        {
+            Server &server = _servers[_serverCount++];
+
+            server.name         = name;
+            server.addressValid = false;
+            server.addressMS    = 0;
+        }
+
+        start = comma + 1;
+    }
 }
 
 /*======================================================================
@@ -135,8 +186,11 @@ FUNCTION:
 Begin()
 
 DESCRIPTION:
-Starts the udp subsystem and sets the callback handlers needed by
-the TimeLib routines
+Starts the udp subsystem and hands TimeLib our clock.  TimeLib calls
+its sync provider from inside now(), which is fine since ours only 
+reads the clock; the network side runs from Process() on the owner's
+schedule.
+
 RETURN VALUE:
 none.
 
@@ -151,8 +205,113 @@ void TimeProxy::Begin()
         Serial.printf( "starting udp on port %d failed\n", _localport );
     }
 
-    setSyncProvider( &TimeProxy::getNtpTime );
-    setSyncInterval( _syncIntervalS );
+    _instance = this;
+
+    // TimeLib only counts whole seconds from when it was last set, so
+    // bring it back in line with our clock every minute
+    setSyncProvider( timeLibProvider );
+    setSyncInterval( 60 );
+
+    // First sync on the next Process()
+    _nextSyncMS = millis();
+}
+
+/*======================================================================
+FUNCTION:
+Process()
+
+DESCRIPTION:
+Advances the NTP client one step.  Each call either checks a timer,
+checks for the DNS answer or checks for a reply packet, so it returns
+right away.  A sync asks each server in turn.  If none of them answer
+the clock keeps free-running (drift corrected) and we try again after
+RETRY_INTERVAL_MS.
+
+RETURN VALUE:
+true if the clock was corrected on this call
+
+SIDE EFFECTS:
+TimeLib time is set when a sync finishes
+
+======================================================================*/
+bool TimeProxy::Process()
+{
+    if ( millis() - _baseMS >= REBASE_MS )
+    {
+        rebase();
+    }
+
+    unsigned long elapsed = millis() - _stateStartMS;
+
+    Server &server = _servers[_serverIndex];
+
+    switch ( _state )
+    {
+        case NTP_IDLE:
+
+            if ( (long) ( millis() - _nextSyncMS ) >= 0 )
+            {
+                return startSync();
+            }
+            break;
+
+        case NTP_RESOLVING:
+
+        {
+            AsyncDnsLookup::Result result = _dns.Poll( server.address );
+
+            if ( result == AsyncDnsLookup::DNS_FAILED )
+            {
+                Serial.printf( "NTP: could not resolve %s\n", server.name.c_str() );
+                return nextServer();
+            }
+            else if ( result == AsyncDnsLookup::DNS_DONE )
+            {
+                server.addressValid = true;
+                server.addressMS    = millis();
+
+                sendRequest();
+            }
+            else if ( elapsed >= DNS_TIMEOUT_MS )
+            {
+                Serial.printf( "NTP: lookup of %s timed out\n", server.name.c_str() );
+                return nextServer();
+            }
+        }
+            break;
+
+        case NTP_WAITING:
+        {
+            Sample sample;
+
+            if ( readResponse( sample ) == true )
+            {
+                // Lowest delay wins: the less time the packets spent
+                // in flight, the less room for an asymmetric path to
+                // throw the offset off
+                if ( _best.valid == false || sample.delayUs < _best.delayUs )
+                {
+                    _best = sample;
+                }
+
+                return nextServer();
+            }
+
+            if ( elapsed >= REPLY_TIMEOUT_MS )
+            {
+                Serial.printf( "No NTP Response from %s :-(\n", server.name.c_str() );
+
+                // Maybe that pool member went away.  Look it up
+                // again next time.
+                server.addressValid = false;
+
+                return nextServer();
+            }
+        }
+            break;
+    }
+
+    return false;
 }
 
 /*======================================================================
@@ -169,127 +328,194 @@ SIDE EFFECTS:
 none
 
 ======================================================================*/
-time_t TimeProxy::GetCurrentTimeUTC()
+time_t TimeProxy::GetCurrentTimeUTC() const
 {
-    // TODO - handle fixups in case we are not using a UTC referenced 
-    // timezone
-    return now();
+    return clockUs( millis() ) / 1000000;
 }
 
 /*======================================================================
 FUNCTION:
-GetTimeStringUTC()
+GetCurrentTimeUTCMS()
 
 DESCRIPTION:
-Returns an ISO 8601 date/time string relative to UTC time.
-https://en.wikipedia.org/wiki/ISO_8601
-Example time string: 2017-11-10T01:28:49Z
+Returns the current time to the millisecond
 
 RETURN VALUE:
-ISO 8601 date/time string
+Milliseconds since 1970 (UTC)
 
 SIDE EFFECTS:
 none
 
 ======================================================================*/
-String TimeProxy::GetTimeStringUTC()
+uint64_t TimeProxy::GetCurrentTimeUTCMS() const
 {
-    time_t t = GetCurrentTimeUTC();
-
-    const int BUF_SIZE = 30;
-    char buffer[BUF_SIZE + 1] = { 0 };
-
-    // TODO - handle fixups in case we are not using a UTC referenced 
-    // timezone
-    snprintf( buffer, BUF_SIZE, "%d-%02d-%02dT%02d:%02d:%02dZ",
-              year( t ),
-              month( t ),
-              day( t ),
-              hour( t ),
-              minute( t ),
-              second( t )
-    );
+    return clockUs( millis() ) / 1000;
+}
 
-    // Note - a String object will implicitly be
-    // constructed and returned
-    return buffer;
+/*======================================================================
+FUNCTION:
+GetErrorBoundMS()
+
+DESCRIPTION:
+Works out how far off the clock could be.  Right after a sync that is
+the server's distance from its reference plus half our round trip 
+(the most an asymmetric path can hide); after that it grows with the 
+time since the sync, for the drift we can't have measured exactly, 
+and with whatever slew is still to run.
+
+RETURN VALUE:
+Error bound in ms, ULONG_MAX if the clock has never been synced.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+unsigned long TimeProxy::GetErrorBoundMS() const
+{
+    if ( _synced == false )
+    {
+        return ULONG_MAX;
+    }
+
+    unsigned long sinceSync = millis() - _lastSyncMS;
+
+    int64_t slewLeft = _slewUs - slewDoneUs( millis() - _baseMS );
+
+    if ( slewLeft < 0 )
+    {
+        slewLeft = -slewLeft;
+    }
+
+    int64_t boundUs = _lastRootDistanceUs + _lastDelayUs / 2 + slewLeft +
+                      (int64_t) sinceSync * DRIFT_ERROR_PPM / 1000;
+
+    return boundUs / 1000;
 }
 
 /*======================================================================
 FUNCTION:
-getNtpTime()
+startSync()
 
 DESCRIPTION:
-This is the callback handler that is called from the TimeLib
-routines.  This calls out to the NTP server and returns the 
-time_t value used by the TimeLib routines to manage time.  This code is 
-based on the TimeNTP_ESP8266WIFI example (there is no copyright/author 
-info in the file to give credit to - thanks and you rock!)
+Starts a sync round with the first server
 
 RETURN VALUE:
-time_t value 
+true if the round finished (successfully) right away.
 
 SIDE EFFECTS:
 none
 
 ======================================================================*/
-time_t TimeProxy::getNtpTime()
+bool TimeProxy::startSync()
 {
-    IPAddress ntpServerIP; // NTP server's ip address
+    _serverIndex = 0;
+    _best.valid  = false;
 
-    while ( _udp.parsePacket() > 0 ); // discard any previously received packets
-    Serial.println( "Transmit NTP Request" );
-    
-    // get a random server from the pool
-    WiFi.hostByName( _ntpServer.c_str(), ntpServerIP );
-    Serial.print( _ntpServer.c_str() );
-    Serial.print( ": " );
-    Serial.println( ntpServerIP );
-    sendNTPpacket( ntpServerIP );
-    uint32_t beginWait = millis();
+    return queryServer();
+}
 
-    //buffer to hold incoming & outgoing packets
-    byte packetBuffer[NTP_PACKET_SIZE]; 
+/*======================================================================
+FUNCTION:
+queryServer()
+
+DESCRIPTION:
+Asks the current server.  With a fresh cached address we go straight
+to sending the request; otherwise we start an asynchronous DNS lookup.
+lwIP answers right away if it has the name cached (or it is an IP 
+address).  Once every server has had its turn the best answer (if 
+any) corrects the clock.
+
+RETURN VALUE:
+true if that finished the round successfully.
 
-    while ( millis() - beginWait < 1500 )
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool TimeProxy::queryServer()
+{
+    if ( _serverIndex >= _serverCount )
     {
-        int size = _udp.parsePacket();
-        if ( size >= NTP_PACKET_SIZE )
+        bool success = _best.valid;
+
+        if ( true == success )
         {
-            Serial.println( "Receive NTP Response" );
-            _udp.read( packetBuffer, NTP_PACKET_SIZE );  // read packet into the buffer
-            unsigned long secsSince1900;
-            // convert four bytes starting at location 40 to a long integer
-            secsSince1900 = (unsigned long) packetBuffer[40] << 24;
-            secsSince1900 |= (unsigned long) packetBuffer[41] << 16;
-            secsSince1900 |= (unsigned long) packetBuffer[42] << 8;
-            secsSince1900 |= (unsigned long) packetBuffer[43];
-            return secsSince1900 - 2208988800UL + _timezone * SECS_PER_HOUR;
+            discipline( _best );
         }
+
+        finishSync( success );
+
+        return success;
     }
-    Serial.println( "No NTP Response :-(" );
-    return 0; // return 0 if unable to get the time
+
+    Server &server = _servers[_serverIndex];
+
+    if ( server.addressValid == true && millis() - server.addressMS < ADDRESS_TTL_MS )
+    {
+        sendRequest();
+        return false;
+    }
+
+    _state        = NTP_RESOLVING;
+    _stateStartMS = millis();
+
+    _dns.Start( server.name.c_str() );
+
+    return false;
 }
 
 /*======================================================================
 FUNCTION:
-sendNTPpacket()
+nextServer()
 
 DESCRIPTION:
-This method formats an NTP request and stuffs it into a UDP packet
-that gets sent to the NTP server.  This code is  based on the 
-TimeNTP_ESP8266WIFI example (there is no copyright/author
-info in the file to give credit to - thanks and you rock!)
+Moves on to the next server in the round
 
 RETURN VALUE:
+true if that finished the round successfully.
+
+SIDE EFFECTS:
 none
 
+======================================================================*/
+bool TimeProxy::nextServer()
+{
+    _serverIndex++;
+
+    return queryServer();
+}
+
+/*======================================================================
+FUNCTION:
+sendRequest()
+
+DESCRIPTION:
+Formats an NTP request and sends it to the current server, then 
+starts waiting for the reply.  Our clock goes in the transmit 
+timestamp; the server echoes it back as the originate timestamp, 
+which gives us T1 and lets us match the reply to this request.  The
+packet layout is from the TimeNTP_ESP8266WIFI example (there is no 
+copyright/author info in the file to give credit to - thanks and you
+rock!)
+
+RETURN VALUE:
+none.
+
 SIDE EFFECTS:
 none
 
 ======================================================================*/
-void TimeProxy::sendNTPpacket( IPAddress &address )
+void TimeProxy::sendRequest()
 {
+    while ( _udp.parsePacket() > 0 ); // discard any previously received packets
+
+    Server &server = _servers[_serverIndex];
+
+    Serial.print( "Transmit NTP Request " );
+    Serial.print( server.name.c_str() );
+    Serial.print( ": " );
+    Serial.println( server.address );
+
     //buffer to hold incoming & outgoing packets
     byte packetBuffer[NTP_PACKET_SIZE];
 
@@ -307,14 +533,631 @@ void TimeProxy::sendNTPpacket( IPAddress &address )
     packetBuffer[13] = 0x4E;
     packetBuffer[14] = 49;
     packetBuffer[15] = 52;
+
+    _requestUs = clockUs( millis() );
+
+    putTimestamp( &packetBuffer[NTP_TRANSMIT_OFFSET], _requestUs );
     
     // all NTP fields have been given values, now
     // you can send a packet requesting a timestamp:
     // NTP requests are to port 123
     const int NTP_PORT = 123;
-    _udp.beginPacket( address, NTP_PORT );
+    _udp.beginPacket( server.address, NTP_PORT );
     _udp.write( packetBuffer, NTP_PACKET_SIZE );
     _udp.endPacket();
+
+    _state        = NTP_WAITING;
+    _stateStartMS = millis();
+}
+
+/*======================================================================
+FUNCTION:
+readResponse()
+
+DESCRIPTION:
+Checks for a reply from the current server.  From the four timestamps
+
+    T1  we sent the request      (our clock)
+    T2  the server received it   (its clock)
+    T3  the server replied       (its clock)
+    T4  we received the reply    (our clock)
+
+the round trip delay is (T4 - T1) - (T3 - T2), the time the packets
+actually spent on the network, and the offset is 
+((T2 - T1) + (T3 - T4)) / 2, which cancels the delay as long as the
+path is about as long both ways.
+
+RETURN VALUE:
+true if a usable reply was read into sample
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool TimeProxy::readResponse( Sample &sample )
+{
+    int size = _udp.parsePacket();
+
+    if ( size < NTP_PACKET_SIZE )
+    {
+        return false;
+    }
+
+    // As close to the packet's arrival as we can get
+    int64_t t4 = clockUs( millis() );
+
+    if ( _udp.remoteIP() != _servers[_serverIndex].address )
+    {
+        // Not from the server we asked.  The next parsePacket() 
+        // drops it.
+        return false;
+    }
+
+    //buffer to hold incoming & outgoing packets
+    byte packetBuffer[NTP_PACKET_SIZE]; 
+
+    _udp.read( packetBuffer, NTP_PACKET_SIZE );  // read packet into the buffer
+
+    int leap    = packetBuffer[0] >> 6;
+    int mode    = packetBuffer[0] & 0x07;
+    int stratum = packetBuffer[1];
+
+    // Unsynchronized server, not a server reply, or a kiss-o'-death
+    if ( leap == 3 || mode != 4 || stratum == 0 || stratum > 15 )
+    {
+        Serial.println( "NTP: server isn't synchronized" );
+        return false;
+    }
+
+    // Must echo what we sent, or it is a stale (or forged) reply
+    byte origin[8];
+    putTimestamp( origin, _requestUs );
+
+    if ( memcmp( origin, &packetBuffer[NTP_ORIGINATE_OFFSET], sizeof( origin ) ) != 0 )
+    {
+        return false;
+    }
+
+    Serial.println( "Receive NTP Response" );
+
+    int64_t t1 = _requestUs;
+    int64_t t2 = getTimestamp( &packetBuffer[NTP_RECEIVE_OFFSET] );
+    int64_t t3 = getTimestamp( &packetBuffer[NTP_TRANSMIT_OFFSET] );
+
+    sample.valid    = true;
+    sample.server   = _serverIndex;
+    sample.offsetUs = ( ( t2 - t1 ) + ( t3 - t4 ) ) / 2;
+    sample.delayUs  = ( t4 - t1 ) - ( t3 - t2 );
+
+    if ( sample.delayUs < 0 )
+    {
+        // Our clock only counts whole ms
+        sample.delayUs = 0;
+    }
+
+    // Root delay and dispersion are 16.16 fixed point seconds
+    uint32_t rootDelay = getUint32( &packetBuffer[NTP_ROOT_DELAY_OFFSET] );
+    uint32_t rootDispersion = getUint32( &packetBuffer[NTP_ROOT_DISPERSION_OFFSET] );
+
+    sample.rootDistanceUs = ( ( (int64_t) rootDelay / 2 + rootDispersion ) * 1000000 ) >> 16;
+
+    Serial.printf( "NTP: %s offset %ld ms, delay %lu ms\n",
+                   _servers[_serverIndex].name.c_str(),
+                   (long) ( sample.offsetUs / 1000 ),
+                   (unsigned long) ( sample.delayUs / 1000 ) );
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+discipline()
+
+DESCRIPTION:
+Corrects the clock with the sync's best sample.
+
+The first sync, or an offset too big to slew out in reasonable time,
+steps the clock.  Otherwise the offset is slewed out, and whatever of
+it the last slew wasn't already going to cover must have built up 
+from drift since the last sync, so the drift estimate moves a quarter
+of the way toward that.  A quarter keeps one noisy sample from 
+yanking the rate around.
+
+The poll interval then doubles if the clock held well and halves if
+it didn't.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+Sets TimeLib's time.
+
+======================================================================*/
+void TimeProxy::discipline( const Sample &sample )
+{
+    rebase();
+
+    int64_t offsetUs = sample.offsetUs;
+    int64_t offsetMagnitudeUs = ( offsetUs < 0 ) ? -offsetUs : offsetUs;
+
+    unsigned long now = millis();
+
+    if ( _synced == false || offsetMagnitudeUs > (int64_t) STEP_THRESHOLD_MS * 1000 )
+    {
+        Serial.printf( "NTP: stepping the clock %ld ms\n", (long) ( offsetUs / 1000 ) );
+
+        stepTo( clockUs( now ) + offsetUs );
+
+        _syncIntervalS = MIN_POLL_S;
+    }
+    else
+    {
+        unsigned long interval = now - _lastSyncMS;
+
+        // Over a short interval the network jitter swamps the drift
+        if ( interval >= MIN_POLL_S * 1000UL )
+        {
+            int64_t residualUs = offsetUs - _slewUs;
+
+            _driftPpb += (long) ( residualUs * 1000000 / (int64_t) interval ) / 4;
+
+            if ( _driftPpb > MAX_DRIFT_PPM * 1000 )
+            {
+                _driftPpb = MAX_DRIFT_PPM * 1000;
+            }
+            else if ( _driftPpb < -MAX_DRIFT_PPM * 1000 )
+            {
+                _driftPpb = -MAX_DRIFT_PPM * 1000;
+            }
+        }
+
+        _slewUs = offsetUs;
+
+        if ( offsetMagnitudeUs < (int64_t) GOOD_OFFSET_MS * 1000 && _syncIntervalS < MAX_POLL_S )
+        {
+            _syncIntervalS *= 2;
+        }
+        else if ( offsetMagnitudeUs > (int64_t) POOR_OFFSET_MS * 1000 && _syncIntervalS > MIN_POLL_S )
+        {
+            _syncIntervalS /= 2;
+        }
+    }
+
+    _lastSyncMS         = now;
+    _lastOffsetUs       = offsetUs;
+    _lastDelayUs        = sample.delayUs;
+    _lastRootDistanceUs = sample.rootDistanceUs;
+    _selectedServer     = sample.server;
+    _synced             = true;
+
+    setTime( GetCurrentTimeUTC() );
+
+    Serial.printf( "NTP: drift %ld ppm, next sync in %u s\n", GetDriftPPM(), _syncIntervalS );
+}
+
+/*======================================================================
+FUNCTION:
+finishSync()
+
+DESCRIPTION:
+Goes back to idle and schedules the next sync: the poll interval 
+after a success, RETRY_INTERVAL_MS after a failure.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void TimeProxy::finishSync( bool success )
+{
+    if ( true == success )
+    {
+        _nextSyncMS = millis() + _syncIntervalS * 1000UL;
+    }
+    else
+    {
+        _nextSyncMS = millis() + RETRY_INTERVAL_MS;
+    }
+
+    _state        = NTP_IDLE;
+    _stateStartMS = millis();
+}
+
+/*======================================================================
+FUNCTION:
+clockUs()
+
+DESCRIPTION:
+Reads the clock: the base, plus the time since then corrected for the
+drift, plus as much of the pending slew as has had time to run.
+
+RETURN VALUE:
+Microseconds since 1970 (UTC)
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+int64_t TimeProxy::clockUs( unsigned long ms ) const
+{
+    unsigned long elapsed = ms - _baseMS;
+
+    return _baseUs + 
+           (int64_t) elapsed * 1000 + 
+           (int64_t) elapsed * _driftPpb / 1000000 +
+           slewDoneUs( elapsed );
+}
+
+/*======================================================================
+FUNCTION:
+slewDoneUs()
+
+DESCRIPTION:
+The slew runs at SLEW_RATE_PPM until it is done, so the clock speeds
+up or slows down a little but never jumps or runs backwards.
+
+RETURN VALUE:
+Microseconds of the pending slew applied after elapsedMS
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+int64_t TimeProxy::slewDoneUs( unsigned long elapsedMS ) const
+{
+    int64_t maxUs = (int64_t) elapsedMS * SLEW_RATE_PPM / 1000;
+
+    if ( _slewUs > maxUs )
+    {
+        return maxUs;
+    }
+
+    if ( _slewUs < -maxUs )
+    {
+        return -maxUs;
+    }
+
+    return _slewUs;
+}
+
+/*======================================================================
+FUNCTION:
+rebase()
+
+DESCRIPTION:
+Moves the base up to now and takes the slew done so far off what is
+pending.  Done every REBASE_MS, which keeps millis() wrapping from
+mattering and the rounding in the drift correction negligible.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void TimeProxy::rebase()
+{
+    unsigned long now = millis();
+
+    int64_t nowUs  = clockUs( now );
+    int64_t doneUs = slewDoneUs( now - _baseMS );
+
+    _baseUs  = nowUs;
+    _baseMS  = now;
+    _slewUs -= doneUs;
+}
+
+/*======================================================================
+FUNCTION:
+stepTo()
+
+DESCRIPTION:
+Sets the clock outright, dropping any pending slew
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void TimeProxy::stepTo( int64_t utcUs )
+{
+    _baseUs = utcUs;
+    _baseMS = millis();
+    _slewUs = 0;
+}
+
+/*======================================================================
+FUNCTION:
+timeLibProvider()
+
+DESCRIPTION:
+TimeLib's sync provider.  Only reads our clock, so it is quick enough
+to be called from inside now().
+
+RETURN VALUE:
+The time, 0 (which TimeLib ignores) until we have synced.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+time_t TimeProxy::timeLibProvider()
+{
+    if ( _instance == nullptr || _instance->_synced == false )
+    {
+        return 0;
+    }
+
+    return _instance->GetCurrentTimeUTC();
+}
+
+/*======================================================================
+FUNCTION:
+putTimestamp()/getTimestamp()
+
+DESCRIPTION:
+Convert between our microseconds since 1970 and the NTP 32.32 fixed 
+point seconds since 1900.  An NTP seconds value with the top bit 
+clear is read as the era that starts in 2036.
+
+RETURN VALUE:
+getTimestamp() returns microseconds since 1970.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void TimeProxy::putTimestamp( uint8_t *field, int64_t utcUs )
+{
+    uint32_t seconds  = (uint32_t) ( utcUs / 1000000 + NTP_UNIX_EPOCH_S );
+    uint32_t fraction = (uint32_t) ( ( (uint64_t) ( utcUs % 1000000 ) << 32 ) / 1000000 );
+
+    putUint32( &field[0], seconds );
+    putUint32( &field[4], fraction );
+}
+
+int64_t TimeProxy::getTimestamp( const uint8_t *field )
+{
+    int64_t seconds  = getUint32( &field[0] );
+    uint64_t fraction = getUint32( &field[4] );
+
+    if ( seconds < 0x80000000LL )
+    {
+        seconds += 0x100000000LL;
+    }
+
+    return ( seconds - NTP_UNIX_EPOCH_S ) * 1000000 + (int64_t) ( ( fraction * 1000000 ) >> 32 );
+}
+
+/*======================================================================
+FUNCTION:
+GetTimeStringUTC()
+
+DESCRIPTION:
+Returns an ISO 8601 date/time string relative to UTC time.
+https://en.wikipedia.org/wiki/ISO_8601
+Example time string: 2017-11-10T01:28:49Z
+
+RETURN VALUE:
+ISO 8601 date/time string
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+String TimeProxy::GetTimeStringUTC()
+{
+    return GetTimeStringUTC( GetCurrentTimeUTC() );
+}
+
+/*======================================================================
+FUNCTION:
+GetTimeStringUTC( time_t )
+
+DESCRIPTION:
+Returns an ISO 8601 date/time string for the time (which must be 
+relative to UTC).
+Example time string: 2017-11-10T01:28:49Z
+
+RETURN VALUE:
+ISO 8601 date/time string
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+String TimeProxy::GetTimeStringUTC( time_t t )
+{
+    char buffer[TIME_STRING_SIZE];
+
+    formatTime( t, -1, buffer, sizeof( buffer ) );
+
+    // Note - a String object will implicitly be
+    // constructed and returned
+    return buffer;
+}
+
+/*======================================================================
+FUNCTION:
+FormatTimeUTC()
+
+DESCRIPTION:
+Writes the current time as an ISO 8601 string into the buffer, with
+or without milliseconds:
+
+    2017-11-10T01:28:49Z
+    2017-11-10T01:28:49.123Z
+
+
+RETURN VALUE:
+Length of the string, 0 if the buffer is too small.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+size_t TimeProxy::FormatTimeUTC( char *buffer, size_t size, bool withMillis ) const
+{
+    // One clock reading for both, so they can't straddle a second
+    int64_t us = clockUs( millis() );
+
+    int ms = -1;
+
+    if ( true == withMillis )
+    {
+        ms = ( us / 1000 ) % 1000;
+    }
+
+    return formatTime( us / 1000000, ms, buffer, size );
+}
+
+/*======================================================================
+FUNCTION:
+FormatTimeUTC( time_t )
+
+DESCRIPTION:
+Writes the time (which must be relative to UTC) as an ISO 8601 string
+into the buffer.
+Example time string: 2017-11-10T01:28:49Z
+
+RETURN VALUE:
+Length of the string, 0 if the buffer is too small.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+size_t TimeProxy::FormatTimeUTC( time_t t, char *buffer, size_t size )
+{
+    return formatTime( t, -1, buffer, size );
+}
+
+/*======================================================================
+FUNCTION:
+formatTime()
+
+DESCRIPTION:
+Keeps the last time formatted.  Asking for the same second again is a
+copy.  A new second on the same day only rewrites hh:mm:ss, worked out
+from the seconds into the day.  Only a new day goes through TimeLib's
+breakTime() for the date.  No printf either way.
+
+RETURN VALUE:
+Length of the string, 0 if the buffer is too small.
+
+SIDE EFFECTS:
+Updates the cached string.
+
+======================================================================*/
+size_t TimeProxy::formatTime( time_t t, int ms, char *buffer, size_t size )
+{
+    const size_t SECONDS_LENGTH = sizeof( _timeCache ) - 1;
+
+    size_t length = SECONDS_LENGTH + ( ( ms >= 0 ) ? 5 : 1 );
+
+    if ( size < length + 1 )
+    {
+        return 0;
+    }
+
+    if ( t != _timeCacheTime || _timeCacheDay < 0 )
+    {
+        // TODO - handle fixups in case we are not using a UTC 
+        // referenced timezone
+        long day = t / SECS_PER_DAY;
+
+        if ( day != _timeCacheDay )
+        {
+            tmElements_t tm;
+
+            breakTime( t, tm );
+
+            int year = tmYearToCalendar( tm.Year );
+
+            _timeCache[0]  = '0' + ( year / 1000 ) % 10;
+            _timeCache[1]  = '0' + ( year / 100 ) % 10;
+            _timeCache[2]  = '0' + ( year / 10 ) % 10;
+            _timeCache[3]  = '0' + year % 10;
+            _timeCache[4]  = '-';
+            _timeCache[5]  = '0' + tm.Month / 10;
+            _timeCache[6]  = '0' + tm.Month % 10;
+            _timeCache[7]  = '-';
+            _timeCache[8]  = '0' + tm.Day / 10;
+            _timeCache[9]  = '0' + tm.Day % 10;
+            _timeCache[10] = 'T';
+            _timeCache[13] = ':';
+            _timeCache[16] = ':';
+
+            _timeCacheDay = day;
+        }
+
+        long secondOfDay = t % SECS_PER_DAY;
+
+        int hours   = secondOfDay / SECS_PER_HOUR;
+        int minutes = ( secondOfDay / SECS_PER_MIN ) % 60;
+        int seconds = secondOfDay % 60;
+
+        _timeCache[11] = '0' + hours / 10;
+        _timeCache[12] = '0' + hours % 10;
+        _timeCache[14] = '0' + minutes / 10;
+        _timeCache[15] = '0' + minutes % 10;
+        _timeCache[17] = '0' + seconds / 10;
+        _timeCache[18] = '0' + seconds % 10;
+
+        _timeCacheTime = t;
+    }
+
+    memcpy( buffer, _timeCache, SECONDS_LENGTH );
+
+    char *p = &buffer[SECONDS_LENGTH];
+
+    if ( ms >= 0 )
+    {
+        *p++ = '.';
+        *p++ = '0' + ( ms / 100 ) % 10;
+        *p++ = '0' + ( ms / 10 ) % 10;
+        *p++ = '0' + ms % 10;
+    }
+
+    *p++ = 'Z';
+    *p   = 0;
+
+    return length;
+}
+
+/*======================================================================
+FUNCTION:
+putUint32()/getUint32()
+
+DESCRIPTION:
+Big endian (network order) 32 bit fields
+
+RETURN VALUE:
+getUint32() returns the value.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+static void putUint32( uint8_t *p, uint32_t value )
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+static uint32_t getUint32( const uint8_t *p )
+{
+    return ( (uint32_t) p[0] << 24 ) | 
+           ( (uint32_t) p[1] << 16 ) | 
+           ( (uint32_t) p[2] << 8 ) | 
+           p[3];
 }
 
 /*=====================================================================
@@ -9,9 +9,10 @@ CREATOR:
 Sean Foley
 
 DESCRIPTION:
-Uses Network Time Protocol (NTP) to seed the timing routines.  This code is 
-based on the TimeNTP_ESP8266WIFI example (there is no copyright/author info
-in the file to give credit to - thanks and you rock!)
+Uses Network Time Protocol (NTP) to discipline a millisecond clock and
+keep the timing routines in step with it.  This code started out from
+the TimeNTP_ESP8266WIFI example (there is no copyright/author info in
+the file to give credit to - thanks and you rock!)
 
 PUBLIC CLASSES AND FUNCTIONS:
 TimeProxy
@@ -49,8 +50,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //----------------------------------------------------------------------
 
 #include <WiFiUdp.h>
+
+#include <IPAddress.h>
+
+#include <stdint.h>
 #include "WString.h"
 
+#include "asyncdnslookup.h"
+
 //----------------------------------------------------------------------
 // Type Declarations
 //----------------------------------------------------------------------
@@ -96,13 +103,27 @@ CLASS:
 TimeProxy
 
 DESCRIPTION:
-Uses Network Time Protocol (NTP) to seed the timing routines and provides
-some helper methods to abstract the use of TimeLib calls.
+NTP client and the clock it disciplines.  Each sync asks every 
+configured server and keeps the answer with the lowest round trip
+delay, with the offset worked out from all four NTP timestamps so the
+network delay cancels out.
+
+The clock itself runs off millis(), corrected for the drift measured
+between syncs.  Small offsets are slewed out (the clock runs a little
+fast or slow until it catches up) so time never jumps or runs 
+backwards; only a big offset (the first sync, say) steps it.  The poll
+interval grows while the clock holds time well and shrinks when it 
+doesn't.
+
+TimeLib is kept in step with this clock, so now() and friends still
+work to the second.
 
 HOW TO USE:
-1. Construct with the ntp server to use. 
+1. Construct with the ntp server(s) to use, comma separated.
 2. Call Begin() to initialze and start everything
-3. Call the helper methods to get the time.
+3. Call Process() often (every few tens of ms).  It resyncs the clock
+   every GetSyncIntervalS() seconds, a small step per call.
+4. Call the helper methods to get the time.
 
 ======================================================================*/
 class TimeProxy
@@ -113,6 +134,57 @@ class TimeProxy
     // TYPE DECLARATIONS AND CONSTANTS    
     //=================================================================
 
+    // Where the NTP client is in a sync
+    enum NtpState
+    {
+        NTP_IDLE = 0,
+        NTP_RESOLVING,
+        NTP_WAITING
+    };
+
+    static const int MAX_SERVERS = 4;
+
+    // How long to wait for the DNS lookup and for the server reply
+    static const unsigned long DNS_TIMEOUT_MS   = 5000;
+    static const unsigned long REPLY_TIMEOUT_MS = 1500;
+
+    // After a failed sync, try again this soon instead of waiting
+    // out the full sync interval
+    static const unsigned long RETRY_INTERVAL_MS = 30000;
+
+    // Pool servers rotate, so look the name up again now and then
+    static const unsigned long ADDRESS_TTL_MS = 3600000;
+
+    // The poll interval moves between these
+    static const unsigned int MIN_POLL_S = 64;
+    static const unsigned int MAX_POLL_S = 1024;
+
+    // Offsets under this mean the clock is holding well (poll less),
+    // over the second one that it isn't (poll more)
+    static const unsigned long GOOD_OFFSET_MS = 20;
+    static const unsigned long POOR_OFFSET_MS = 100;
+
+    // Offsets bigger than this step the clock instead of slewing
+    static const unsigned long STEP_THRESHOLD_MS = 500;
+
+    // How fast a slew runs: 5 ms per second
+    static const long SLEW_RATE_PPM = 5000;
+
+    // No crystal is off by more than this.  A bigger estimate is 
+    // noise.
+    static const long MAX_DRIFT_PPM = 500;
+
+    // How far off we assume the drift estimate can be when working
+    // out the error bound
+    static const long DRIFT_ERROR_PPM = 15;
+
+    // How often the clock folds elapsed time into its base
+    static const unsigned long REBASE_MS = 60000;
+
+    // "2017-11-10T01:28:49.123Z" plus the NUL.  Big enough with or 
+    // without the milliseconds.
+    static const size_t TIME_STRING_SIZE = 25;
+
     // Some timezone preset offsets
     enum TimeZones
     {
@@ -127,15 +199,62 @@ class TimeProxy
     // CLIENT INTERFACE
     //=================================================================
 
-    TimeProxy( const String &ntpServer,
-               unsigned int syncIntervalS = 300 );
+    // ntpServers is one name, or several separated by commas
+    TimeProxy( const String &ntpServers,
+               unsigned int syncIntervalS = MIN_POLL_S );
 
     void Begin();
 
-    time_t GetCurrentTimeUTC();
+    // Steps the NTP client: resolve a server, send a request, check
+    // for the reply.  Never blocks.  Returns true when a sync 
+    // finishes and the clock has been corrected.
+    bool Process();
+
+    NtpState GetNtpState() const { return _state; }
+
+    // true once the clock has been set from NTP at least once
+    bool IsSynced() const { return _synced; }
+
+    // The current poll interval
+    unsigned int GetSyncIntervalS() const { return _syncIntervalS; }
+
+    time_t GetCurrentTimeUTC() const;
+
+    // Milliseconds since 1970
+    uint64_t GetCurrentTimeUTCMS() const;
+
+    // What the last sync measured.  The offset is how far the clock
+    // was off (positive means it was slow), before correcting it.
+    long GetOffsetMS() const { return _lastOffsetUs / 1000; }
+    unsigned long GetDelayMS() const { return _lastDelayUs / 1000; }
+
+    // The drift we correct for, in parts per million
+    long GetDriftPPM() const { return _driftPpb / 1000; }
+
+    // Sync quality: how far off the clock could be right now, in ms.
+    // Counts the server's own error, half our round trip, the slew 
+    // still to go and the drift error since the last sync.  
+    // ULONG_MAX until the first sync.
+    unsigned long GetErrorBoundMS() const;
+
+    int GetServerCount() const { return _serverCount; }
+    const String &GetServerName( int index ) const { return _servers[index].name; }
+
+    // The server the last sync used, -1 if none yet
+    int GetSelectedServer() const { return _selectedServer; }
 
     String GetTimeStringUTC();
 
+    // Same format for any time
+    static String GetTimeStringUTC( time_t t );
+
+    // Writes the current time as ISO 8601 into the buffer, optionally
+    // with milliseconds.  Returns the length, 0 if it doesn't fit.
+    size_t FormatTimeUTC( char *buffer, size_t size, bool withMillis = false ) const;
+
+    // Same, for any time (to the second)
+    static size_t FormatTimeUTC( time_t t, char *buffer, size_t size );
+
     protected:
 
     //=================================================================
@@ -146,10 +265,6 @@ class TimeProxy
 
     private:
 
-    static time_t getNtpTime();
-
-    static void sendNTPpacket( IPAddress &address );
-
     //=================================================================
     // CUSTOMIZATION INTERFACE    
     //=================================================================
@@ -160,17 +275,92 @@ class TimeProxy
     // IMPLEMENTATION INTERFACE    
     //=================================================================
 
+    struct Server
+    {
+        String        name;
+
+        // Cached address and when we looked it up
+        IPAddress     address;
+        bool          addressValid;
+        unsigned long addressMS;
+    };
+
+    // One answer from one server
+    struct Sample
+    {
+        bool    valid;
+        int     server;
+
+        int64_t offsetUs;
+        int64_t delayUs;
+
+        // The server's own distance from its reference clock
+        int64_t rootDistanceUs;
+    };
+
     // No copying. Leaving the implementation undefined to cause a link
     // error
     TimeProxy( const TimeProxy &rhs );
 
+    // Kicks off the next sync with the first server.  The query 
+    // functions return true if that finished a sync successfully.
+    bool startSync();
+
+    // Resolves (if needed) and queries _servers[_serverIndex], or
+    // finishes the sync if there are no servers left
+    bool queryServer();
+
+    bool nextServer();
+
+    void sendRequest();
+
+    // Reads a reply if one is waiting.  Returns true and fills in the
+    // sample if it is a good one.
+    bool readResponse( Sample &sample );
+
+    // Corrects the clock with the best sample and adapts the poll
+    // interval
+    void discipline( const Sample &sample );
+
+    // Ends this sync and picks when the next one starts
+    void finishSync( bool success );
+
+    // The clock, in microseconds since 1970, at a millis() reading
+    int64_t clockUs( unsigned long ms ) const;
+
+    // How much of the pending slew has been applied after elapsedMS
+    int64_t slewDoneUs( unsigned long elapsedMS ) const;
+
+    // Folds the time since the base into the base, so the drift and
+    // slew maths stays small and millis() can wrap
+    void rebase();
+
+    void stepTo( int64_t utcUs );
+
+    // Keeps TimeLib in step with our clock
+    static time_t timeLibProvider();
+
+    // Does the formatting.  ms < 0 leaves them off.
+    static size_t formatTime( time_t t, int ms, char *buffer, size_t size );
+
+    static void putTimestamp( uint8_t *field, int64_t utcUs );
+    static int64_t getTimestamp( const uint8_t *field );
+
     //=================================================================
     // DATA MEMBERS    
     //=================================================================
 
-    static int _timezone;
+    // The one that feeds TimeLib
+    static TimeProxy *_instance;
+
+    // The last time formatted ("2017-11-10T01:28:49").  Only the 
+    // fields that moved are written again.
+    static char   _timeCache[20];
+    static time_t _timeCacheTime;
+    static long   _timeCacheDay;
 
-    static String _ntpServer;
+    Server _servers[MAX_SERVERS];
+    int    _serverCount;
 
     // How often should we resync time (seconds) with our 
     // NTP time source?
@@ -178,6 +368,41 @@ class TimeProxy
 
     static WiFiUDP _udp;
     unsigned int _localport = 8888;
+
+    NtpState _state;
+
+    // millis() when the current state started
+    unsigned long _stateStartMS;
+
+    // millis() when the next sync is due
+    unsigned long _nextSyncMS;
+
+    bool _synced;
+
+    // The server being asked and the best answer so far this sync
+    int    _serverIndex;
+    Sample _best;
+
+    // The transmit timestamp we sent.  A genuine reply echoes it.
+    int64_t _requestUs;
+
+    // The clock is _baseUs at millis() == _baseMS, and runs from there
+    // at 1 + drift, plus the slew still to do
+    int64_t       _baseUs;
+    unsigned long _baseMS;
+    long          _driftPpb;
+    int64_t       _slewUs;
+
+    // millis() and the offset at the last sync, for the drift 
+    // estimate
+    unsigned long _lastSyncMS;
+    int64_t       _lastOffsetUs;
+    int64_t       _lastDelayUs;
+    int64_t       _lastRootDistanceUs;
+
+    int _selectedServer;
+
+    AsyncDnsLookup _dns;
         
 };
 
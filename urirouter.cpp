@@ -0,0 +1,483 @@
+/*======================================================================
+FILE:
+urirouter.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Routes requests by path template (/garage/door/status/{door}) instead
+of registering every concrete URI with the web server.
+
+PUBLIC CLASSES AND FUNCTIONS:
+UriRouter
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+Set the limits before adding the routes that use them.
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "urirouter.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// Parameters are door numbers and the like.  Anything longer is junk.
+static const int MAX_PARAM_DIGITS = 5;
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+UriRouter()
+
+DESCRIPTION:
+C-tor.  Sets up the root node.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+UriRouter::UriRouter()
+    : _nodeCount( 1 ), _routeCount( 0 ), _limitCount( 0 ), 
+      _matchedRoute( NONE )
+{
+    Node &root = _nodes[0];
+
+    root.text        = "";
+    root.length      = 0;
+    root.param       = false;
+    root.limit       = -1;
+    root.firstChild  = NONE;
+    root.nextSibling = NONE;
+    root.route       = NONE;
+
+    _matchedParams.count = 0;
+}
+
+/*======================================================================
+FUNCTION:
+SetLimit()
+
+DESCRIPTION:
+Bounds a parameter.  Applies to the routes added after this.
+
+RETURN VALUE:
+false if the limit table is full.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool UriRouter::SetLimit( const char *name, int limit )
+{
+    if ( _limitCount >= MAX_LIMITS )
+    {
+        return false;
+    }
+
+    _limits[_limitCount].name  = name;
+    _limits[_limitCount].limit = limit;
+    _limitCount++;
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+On()
+
+DESCRIPTION:
+Adds a route.  The template is split on '/', and each segment becomes
+(or reuses) a trie node under the one before.
+
+RETURN VALUE:
+false if the template is malformed, the route already exists or the 
+tables are full.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool UriRouter::On( const char *pathTemplate, HTTPMethod method, Handler handler )
+{
+    if ( _routeCount >= MAX_ROUTES || pathTemplate[0] != '/' )
+    {
+        return false;
+    }
+
+    int8_t node = 0;
+    const char *p = pathTemplate;
+
+    while ( *p == '/' && p[1] != 0 )
+    {
+        const char *segment = ++p;
+
+        while ( *p != '/' && *p != 0 )
+        {
+            p++;
+        }
+
+        uint8_t length = p - segment;
+        bool    param  = false;
+
+        if ( length >= 2 && segment[0] == '{' && segment[length - 1] == '}' )
+        {
+            segment++;
+            length -= 2;
+            param = true;
+        }
+
+        if ( length == 0 )
+        {
+            return false;
+        }
+
+        node = child( node, segment, length, param );
+
+        if ( node == NONE )
+        {
+            Serial.printf( "UriRouter: no room for %s\n", pathTemplate );
+            return false;
+        }
+    }
+
+    if ( _nodes[node].route != NONE )
+    {
+        return false;
+    }
+
+    _routes[_routeCount].method  = method;
+    _routes[_routeCount].handler = handler;
+
+    _nodes[node].route = _routeCount++;
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+canHandle()
+
+DESCRIPTION:
+Called by the web server for each request.  Matches the path and 
+keeps the result for handle().
+
+RETURN VALUE:
+true if a route matches.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool UriRouter::canHandle( HTTPMethod method, String uri )
+{
+    _matchedRoute = match( uri.c_str(), _matchedParams );
+
+    if ( _matchedRoute == NONE )
+    {
+        return false;
+    }
+
+    HTTPMethod routeMethod = _routes[_matchedRoute].method;
+
+    if ( routeMethod != HTTP_ANY && routeMethod != method )
+    {
+        _matchedRoute = NONE;
+    }
+
+    return _matchedRoute != NONE;
+}
+
+/*======================================================================
+FUNCTION:
+handle()
+
+DESCRIPTION:
+Runs the handler for the route canHandle() matched
+
+RETURN VALUE:
+true if it ran.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool UriRouter::handle( ESP8266WebServer &server, HTTPMethod requestMethod, String requestUri )
+{
+    if ( _matchedRoute == NONE && canHandle( requestMethod, requestUri ) == false )
+    {
+        return false;
+    }
+
+    int8_t route = _matchedRoute;
+
+    _matchedRoute = NONE;
+
+    _routes[route].handler( _matchedParams );
+
+    return true;
+}
+
+/*======================================================================
+FUNCTION:
+child()
+
+DESCRIPTION:
+Looks for the segment among parent's children, adding it if it isn't
+there.  Parameters match on their name too, so the same name reuses 
+the node.
+
+RETURN VALUE:
+The child node, NONE if the node table is full.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+int8_t UriRouter::child( int8_t parent, const char *text, uint8_t length, bool param )
+{
+    int8_t last = NONE;
+
+    for ( int8_t i = _nodes[parent].firstChild; i != NONE; i = _nodes[i].nextSibling )
+    {
+        const Node &node = _nodes[i];
+
+        if ( node.param == param && node.length == length && memcmp( node.text, text, length ) == 0 )
+        {
+            return i;
+        }
+
+        last = i;
+    }
+
+    if ( _nodeCount >= MAX_NODES )
+    {
+        return NONE;
+    }
+
+    int8_t index = _nodeCount++;
+    Node &node = _nodes[index];
+
+    node.text        = text;
+    node.length      = length;
+    node.param       = param;
+    node.limit       = ( true == param ) ? limitFor( text, length ) : -1;
+    node.firstChild  = NONE;
+    node.nextSibling = NONE;
+    node.route       = NONE;
+
+    if ( last == NONE )
+    {
+        _nodes[parent].firstChild = index;
+    }
+    else
+    {
+        _nodes[last].nextSibling = index;
+    }
+
+    return index;
+}
+
+/*======================================================================
+FUNCTION:
+match()
+
+DESCRIPTION:
+Walks the trie a segment at a time.  At each level a literal child 
+that matches the segment wins; otherwise a parameter child takes it if
+it is a number within the parameter's limit.  The query string (if 
+the server left one on) and a trailing slash are ignored.
+
+RETURN VALUE:
+The route, NONE if nothing matches.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+int8_t UriRouter::match( const char *path, Params &params ) const
+{
+    params.count = 0;
+
+    if ( path[0] != '/' )
+    {
+        return NONE;
+    }
+
+    int8_t node = 0;
+    const char *p = path;
+
+    while ( *p == '/' && p[1] != 0 && p[1] != '?' )
+    {
+        const char *segment = ++p;
+
+        while ( *p != '/' && *p != '?' && *p != 0 )
+        {
+            p++;
+        }
+
+        uint8_t length = p - segment;
+
+        int8_t next = NONE;
+        int8_t paramChild = NONE;
+
+        for ( int8_t i = _nodes[node].firstChild; i != NONE; i = _nodes[i].nextSibling )
+        {
+            const Node &candidate = _nodes[i];
+
+            if ( true == candidate.param )
+            {
+                paramChild = i;
+            }
+            else if ( candidate.length == length && memcmp( candidate.text, segment, length ) == 0 )
+            {
+                next = i;
+                break;
+            }
+        }
+
+        if ( next == NONE && paramChild != NONE )
+        {
+            if ( length == 0 || length > MAX_PARAM_DIGITS || params.count >= MAX_PARAMS )
+            {
+                return NONE;
+            }
+
+            int value = 0;
+
+            for ( uint8_t i = 0; i < length; i++ )
+            {
+                if ( segment[i] < '0' || segment[i] > '9' )
+                {
+                    return NONE;
+                }
+
+                value = value * 10 + ( segment[i] - '0' );
+            }
+
+            int limit = _nodes[paramChild].limit;
+
+            if ( limit >= 0 && value >= limit )
+            {
+                return NONE;
+            }
+
+            params.values[params.count++] = value;
+            next = paramChild;
+        }
+
+        if ( next == NONE )
+        {
+            return NONE;
+        }
+
+        node = next;
+    }
+
+    return _nodes[node].route;
+}
+
+/*======================================================================
+FUNCTION:
+limitFor()
+
+DESCRIPTION:
+Looks up the limit for a parameter name
+
+RETURN VALUE:
+The limit, -1 if the parameter has none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+int UriRouter::limitFor( const char *name, uint8_t length ) const
+{
+    for ( int i = 0; i < _limitCount; i++ )
+    {
+        if ( strlen( _limits[i].name ) == length && memcmp( _limits[i].name, name, length ) == 0 )
+        {
+            return _limits[i].limit;
+        }
+    }
+
+    return -1;
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
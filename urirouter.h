@@ -0,0 +1,262 @@
+#ifndef _GARAGEOMATIC_URIROUTER_H_
+#define _GARAGEOMATIC_URIROUTER_H_
+
+/*======================================================================
+FILE:
+urirouter.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Routes requests by path template (/garage/door/status/{door}) instead
+of registering every concrete URI with the web server.
+
+PUBLIC CLASSES AND FUNCTIONS:
+UriRouter
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <ESP8266WebServer.h>
+#include <detail/RequestHandler.h>
+
+#include <functional>
+
+#include <stdint.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// Templates are not copied.  Pass string literals (or anything else 
+// that outlives the router) to On().
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+UriRouter
+
+DESCRIPTION:
+A web server request handler that matches the path against a trie of
+path segments.  A segment is either literal text or an {name} 
+parameter, which matches a non-negative integer.  Literal segments 
+are tried before parameters at each level.
+
+Lookup walks one trie level per path segment, so its cost depends on
+how deep the path is, not how many doors or routes there are.  The 
+parameters are parsed in place, without allocating.
+
+A parameter can be given a limit (SetLimit()); a value at or past the
+limit doesn't match, so the request goes to the not found handler and
+the route's handler never sees it.
+
+HOW TO USE:
+1. SetLimit() any bounded parameters.
+2. On() each route.
+3. Hand the router to the web server with addHandler().
+
+======================================================================*/
+class UriRouter : public RequestHandler
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    static const int MAX_NODES  = 32;
+    static const int MAX_ROUTES = 16;
+    static const int MAX_PARAMS = 4;
+    static const int MAX_LIMITS = 4;
+
+    // The parameter values, in the order they appear in the path
+    struct Params
+    {
+        int     values[MAX_PARAMS];
+        uint8_t count;
+    };
+
+    typedef std::function<void( const Params &params )> Handler;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    UriRouter();
+
+    // Values of the named parameter must be below limit
+    bool SetLimit( const char *name, int limit );
+
+    // Adds a route.  false if the tables are full or the template is
+    // malformed.
+    bool On( const char *pathTemplate, HTTPMethod method, Handler handler );
+
+    bool On( const char *pathTemplate, Handler handler ) { return On( pathTemplate, HTTP_ANY, handler ); }
+
+    // RequestHandler
+    bool canHandle( HTTPMethod method, String uri ) override;
+    bool handle( ESP8266WebServer &server, HTTPMethod requestMethod, String requestUri ) override;
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    static const int8_t NONE = -1;
+
+    struct Node
+    {
+        // Points into the template, not NUL terminated.  A parameter
+        // is stored as its name, without the braces.
+        const char *text;
+        uint8_t     length;
+        bool        param;
+
+        // Parameter values must be below this, -1 for no limit
+        int         limit;
+
+        int8_t      firstChild;
+        int8_t      nextSibling;
+
+        // The route that ends here, or NONE
+        int8_t      route;
+    };
+
+    struct Route
+    {
+        HTTPMethod method;
+        Handler    handler;
+    };
+
+    struct Limit
+    {
+        const char *name;
+        int         limit;
+    };
+
+    // Finds (or adds) the child of parent for the segment
+    int8_t child( int8_t parent, const char *text, uint8_t length, bool param );
+
+    // Walks the trie for the path.  Returns the route or NONE, and 
+    // fills in params.
+    int8_t match( const char *path, Params &params ) const;
+
+    int limitFor( const char *name, uint8_t length ) const;
+
+    // No copying. Leaving the implementation undefined to cause a link
+    // error
+    UriRouter( const UriRouter &rhs );
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    Node   _nodes[MAX_NODES];
+    int8_t _nodeCount;
+
+    Route  _routes[MAX_ROUTES];
+    int8_t _routeCount;
+
+    Limit  _limits[MAX_LIMITS];
+    int8_t _limitCount;
+
+    // What canHandle() matched, for handle()
+    int8_t _matchedRoute;
+    Params _matchedParams;
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+// None.
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+Node 0 is the root (the empty path).  Children hang off firstChild and
+are chained by nextSibling, so a node costs a few bytes whatever its
+fan out.
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_URIROUTER_H_
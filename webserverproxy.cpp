@@ -49,6 +49,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "webserverproxy.h"
 
+#include "calibrationmanager.h"
+
+#include "jsonwriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
 // std::bind support
 #include <functional>
 
@@ -110,8 +117,11 @@ none
 WebserverProxy::WebserverProxy( 
     const Configuration &config,
     GarageDoor::GarageDoorCollection &garageDoors,
+    StatusDocumentCache &statusDocument,
     int port)
-    : _config(config), _garagedoors( garageDoors), _server( port )
+    : _config(config), _garagedoors( garageDoors), _server( port ),
+      _router( nullptr ), _statusDocument( statusDocument ),
+      _events( garageDoors, _response )
 {
     init();
 }
@@ -155,6 +165,9 @@ void WebserverProxy::Process()
     // Pump the server so it can do things
     _server.handleClient();
 
+    // And the connections waiting on door changes
+    _events.Process();
+
     // Just in case the caller is calling this in a tight loop
     yield();
 }
@@ -164,8 +177,10 @@ FUNCTION:
 init()
 
 DESCRIPTION:
-Sets up all the callback handlers for the webserver.  This is also where
-the REST endpoints are dynamically created for each door in the collection.
+Sets up all the callback handlers for the webserver.  The REST 
+endpoints are path templates on one router, so the door number is 
+parsed (and checked against the door collection) before a handler 
+ever runs.
 
 RETURN VALUE:
 none.
@@ -176,32 +191,41 @@ none
 ======================================================================*/
 void WebserverProxy::init()
 {
-    _server.on( "/", std::bind( &WebserverProxy::handleRoot, this ) );
-    _server.on( "/", std::bind( &WebserverProxy::handleNotFound, this ) );
+    _server.onNotFound( std::bind( &WebserverProxy::handleNotFound, this ) );
 
-    // Dynamically build our REST endpoints based on the 
-    // number of garage doors we are supporting
-    for ( int i = 0; i < _garagedoors.size(); i++ )
-    {
-        String urlStatus = "/garage/door/status/";
-        String urlOpen   = "/garage/door/command/open/";
-        String urlClose  = "/garage/door/command/close/";
-        String urlCalibrate = "/garage/door/calibrate/";
-        String urlCalibrateRun = "/garage/door/calibrate/test/";
-
-        urlStatus    += i;
-        urlOpen      += i;
-        urlClose     += i;
-        urlCalibrate += i;
-        urlCalibrateRun += i;
-
-        _server.on( urlStatus.c_str(),    std::bind( &WebserverProxy::handleDoorStatus, this ) );
-        _server.on( urlOpen.c_str(),      std::bind( &WebserverProxy::handleDoorOpen,   this ) );
-        _server.on( urlClose.c_str(),     std::bind( &WebserverProxy::handleDoorClose,  this ) );
-        _server.on( urlCalibrate.c_str(), std::bind( &WebserverProxy::handleCalibrate,  this ) );
-
-        _server.on( urlCalibrateRun.c_str(), std::bind( &WebserverProxy::handleCalibrateRunTest, this ) );
-    }
+    // The web server owns (and deletes) its handlers
+    _router = new UriRouter();
+
+    // Door numbers past the end never reach a handler
+    _router->SetLimit( "door", _garagedoors.size() );
+
+    _router->On( "/", [this]( const UriRouter::Params & ) { handleRoot(); } );
+
+    _router->On( "/garage/doors", HTTP_GET, [this]( const UriRouter::Params & ) { handleDoors(); } );
+
+    _router->On( "/garage/events", HTTP_GET, [this]( const UriRouter::Params & ) { handleEvents(); } );
+
+    _events.Begin( [this]( HttpResponse &response ) { buildStatusDocument( response ); } );
+
+    _router->On( "/garage/door/status/{door}",
+                 [this]( const UriRouter::Params &params ) { handleDoorStatus( params.values[0] ); } );
+
+    _router->On( "/garage/door/command/open/{door}",
+                 [this]( const UriRouter::Params &params ) { handleDoorOpen( params.values[0] ); } );
+
+    _router->On( "/garage/door/command/close/{door}",
+                 [this]( const UriRouter::Params &params ) { handleDoorClose( params.values[0] ); } );
+
+    _router->On( "/garage/door/calibrate/{door}",
+                 [this]( const UriRouter::Params &params ) { handleCalibrate( params.values[0] ); } );
+
+    _router->On( "/garage/door/calibrate/test/{door}",
+                 [this]( const UriRouter::Params &params ) { handleCalibrateRunTest( params.values[0] ); } );
+
+    _router->On( "/garage/door/calibrate/status/{door}",
+                 [this]( const UriRouter::Params &params ) { handleCalibrateStatus( params.values[0] ); } );
+
+    _server.addHandler( _router );
 }
 
 /*======================================================================
@@ -209,13 +233,15 @@ FUNCTION:
 handleCalibrateRunTest()
 
 DESCRIPTION:
-This method will time how long it takes for the garage door to close
-from the fully opened position.  Since there is only one sensor being
-used to detect if the door is open/closed, we don't really know if the door
-is partially open, etc.  The idea was that once we have a calibration 
-value, we should always expect the door to close within the calibration 
-timeframe (+/- some tolerance).  Therefore this calibration value
-can be later incorportated into door status monitoring, etc.
+This method starts a job that times how long it takes for the garage 
+door to close from the fully opened position.  Since there is only one
+sensor being used to detect if the door is open/closed, we don't really
+know if the door is partially open, etc.  Once we have a calibration 
+value, the door state machine uses it to tell when a moving door 
+should have finished.
+
+The job runs in the background, so this returns 202 right away with 
+the job id and points the caller at the status resource.
 
 RETURN VALUE:
 none.
@@ -224,82 +250,172 @@ SIDE EFFECTS:
 none
 
 ======================================================================*/
-void WebserverProxy::handleCalibrateRunTest()
+void WebserverProxy::handleCalibrateRunTest( int doornum )
 {
     if ( authenticate() == false )
     {
         return;
     }
 
-    int doornum = getDoorNumberFromUri( _server.uri() );
+    uint32_t jobId = 0;
 
-    GarageDoor door = _garagedoors[doornum];
+    char statusUrl[48];
+    snprintf( statusUrl, sizeof( statusUrl ), "/garage/door/calibrate/status/%d", doornum );
 
-    GarageDoor::DoorStatus status = door.Status();
+    switch ( CalibrationManager::Start( doornum, jobId ) )
+    {
+        case CalibrationManager::START_OK:
+        {
+            _response.Begin( 202, "application/json" );
+            _response.AddHeader( "Location", statusUrl );
+
+            JsonWriter writer( _response );
+
+            writer.BeginObject();
+            writer.Key( "jobId" );
+            writer.Value( jobId );
+            writer.Key( "door" );
+            writer.Value( doornum );
+            writer.Key( "status" );
+            writer.Value( statusUrl );
+            writer.EndObject();
+            writer.Flush();
+        }
+            break;
 
-    int httpcode = 0;
+        case CalibrationManager::START_ALREADY_RUNNING:
 
-    String message;
-    String redirectUrl;
+            _response.Begin( 409, "text/plain" );
+            _response.AddHeader( "Location", statusUrl );
+            _response.print( "calibration already running, see " );
+            _response.print( statusUrl );
+            break;
 
-    Serial.printf( "Running calibration test for garage door %d\n", doornum );
+        case CalibrationManager::START_NOT_OPEN:
+        {
+            char redirectUrl[48];
+            snprintf( redirectUrl, sizeof( redirectUrl ), "/garage/door/calibrate/%d", doornum );
 
-    switch ( status )
+            _response.Begin( 302, "text/plain" );
+            _response.AddHeader( "Location", redirectUrl );
+            _response.print( "garage door must be completely open to calibrate." );
+        }
+            break;
+
+        default:
+            _response.Begin( 500, "text/plain" );
+            _response.print( "cannot start calibration. check sensor(s)" );
+            break;
+    }
+
+    sendResponse();
+}
+
+/*======================================================================
+FUNCTION:
+handleCalibrateStatus()
+
+DESCRIPTION:
+Reports on the door's calibration job (progress while it runs, the 
+result once it is done) along with the stored history of runs.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void WebserverProxy::handleCalibrateStatus( int doornum )
+{
+    if ( authenticate() == false )
     {
-        case GarageDoor::DoorStatus::OPEN:
-            // Run the test
-        {
-            unsigned long start = millis();
+        return;
+    }
 
-            door.ToogleRelay();
+    const GarageDoor &door = _garagedoors[doornum];
 
-            while ( true )
-            {
-                ESP.wdtFeed();
+    const CalibrationManager::Job &job = CalibrationManager::GetJob( doornum );
 
-                if ( door.Status() == GarageDoor::CLOSED )
-                {
-                    unsigned long stop = millis();
+    _response.Begin( 200, "application/json" );
 
-                    unsigned long elapsed = stop - start;
+    // A full history is a little over 500 bytes, which fits in the
+    // response buffer.  If it ever doesn't, the response goes out as
+    // a 500.
+    JsonWriter writer( _response );
 
-                    message += "door takes ";
-                    message += elapsed;
-                    message += " ms to close.";
+    writer.BeginObject();
 
-                    Serial.printf( "Garage door %d takes %lu ms to close\n", doornum, elapsed );
+    writer.Key( "door" );
+    writer.Value( doornum );
 
-                    httpcode = 200;
-                    break;
-                }
+    writer.Key( "travelTimeMS" );
+    writer.Value( door.GetTravelTimeMS() );
 
-                yield();
+    writer.Key( "job" );
 
-            }    
+    if ( job.state == CalibrationManager::JOB_NONE )
+    {
+        writer.Null();
+    }
+    else
+    {
+        // Rough progress against the travel time we expect.  Never
+        // say 100 until it's actually done.
+        unsigned long progress = 100;
+
+        if ( job.state == CalibrationManager::JOB_PENDING )
+        {
+            progress = 0;
         }
+        else if ( job.state == CalibrationManager::JOB_RUNNING )
+        {
+            progress = ( job.elapsedMS * 100 ) / door.GetTravelTimeMS();
 
-            break;
+            if ( progress > 99 )
+            {
+                progress = 99;
+            }
+        }
 
-        case GarageDoor::DoorStatus::CLOSED:
+        writer.BeginObject();
+        writer.Key( "id" );
+        writer.Value( job.id );
+        writer.Key( "state" );
+        writer.Value( CalibrationManager::JobStateToString( job.state ) );
+        writer.Key( "elapsedMS" );
+        writer.Value( job.elapsedMS );
+        writer.Key( "progress" );
+        writer.Value( progress );
+        writer.EndObject();
+    }
 
-            message = "garage door must be completely open to calibrate.";
-            redirectUrl = "/garage/door/calibrate/";
-            redirectUrl += doornum;
-            _server.sendHeader( "Location", redirectUrl );
-            httpcode = 302;
-            break;
+    writer.Key( "history" );
+    writer.BeginArray();
 
-        default:
-            message = "cannot determine if door is closed or open. check sensor(s)";
+    int count = CalibrationManager::GetHistoryCount( doornum );
 
-            httpcode = 500;
-            break;
+    for ( int i = 0; i < count; i++ )
+    {
+        const CalibrationManager::Job &run = CalibrationManager::GetHistory( doornum, i );
+
+        writer.BeginObject();
+        writer.Key( "id" );
+        writer.Value( run.id );
+        writer.Key( "state" );
+        writer.Value( CalibrationManager::JobStateToString( run.state ) );
+        writer.Key( "elapsedMS" );
+        writer.Value( run.elapsedMS );
+        writer.Key( "startedUTC" );
+        writer.Value( (unsigned long) run.startedUTC );
+        writer.EndObject();
     }
 
-    setNoCacheHeaders();
+    writer.EndArray();
+    writer.EndObject();
+    writer.Flush();
 
-    _server.sendHeader( "Content-Length", String( message.length() ) );
-    _server.send( httpcode, "text/plain", message );
+    sendResponse();
 }
 
 /*======================================================================
@@ -317,68 +433,53 @@ SIDE EFFECTS:
 none
 
 ======================================================================*/
-void WebserverProxy::handleCalibrate()
+void WebserverProxy::handleCalibrate( int doornum )
 {
     if ( authenticate() == false )
     {
         return;
     }
 
-    int doornum = getDoorNumberFromUri( _server.uri() );
-
-    GarageDoor door = _garagedoors[doornum];
+    GarageDoor &door = _garagedoors[doornum];
 
     GarageDoor::DoorStatus status = door.Status();
 
-    String message, href;
+    const char *PAGE_HEAD =
+        "<html><head><title>Garage Door Calibration</title></head><body>"
+        "<p>Use the calibration to measure how long it takes the garage door to close from a "
+        "fully opended position.</p>";
 
-    message = "<html><head><title>Garage Door Calibration</title></head><body>";
-    message += "<p>Use the calibration to measure how long it takes the garage door to close from a ";
-    message += "fully opended position.</p>";
-
-    int httpcode = 0;
-   
     switch ( status )
     {
         case GarageDoor::DoorStatus::OPEN:
-            message +="<p>When you click on the CALIBRATE link below, the garage door will ";
-            message += "close. Please do not press any other wireless door remotes or the open/close ";
-            message += "garage door button while the test is in progress.</p>";
-            
-            href = "<a href=\"";
-            href += "/garage/door/calibrate/test/";
-            href += doornum;
-            href += "\">CALIBRATE</a>";
-            
-            message += href;
-            httpcode = 200;
-
+            _response.Begin( 200, "text/html" );
+            _response.print( PAGE_HEAD );
+            _response.print( "<p>When you click on the CALIBRATE link below, the garage door will "
+                             "close. Please do not press any other wireless door remotes or the open/close "
+                             "garage door button while the test is in progress. The test runs in the "
+                             "background and reports its progress at /garage/door/calibrate/status/" );
+            _response.print( doornum );
+            _response.print( ".</p><a href=\"/garage/door/calibrate/test/" );
+            _response.print( doornum );
+            _response.print( "\">CALIBRATE</a>" );
             break;
 
         case GarageDoor::DoorStatus::CLOSED:
-            
-            message += "<p>Cannot run test because the door is closed. Please fully open ";
-            message += "the garage door, then reload this page.</p>";
-
-            // Let's use the conflict code because the caller
-            // is requesting us to close an already closed door
-            httpcode = 200;
+            _response.Begin( 200, "text/html" );
+            _response.print( PAGE_HEAD );
+            _response.print( "<p>Cannot run test because the door is closed. Please fully open "
+                             "the garage door, then reload this page.</p>" );
             break;
 
         default:
-            message = "cannot determine if door is closed or open. check sensor(s)";
-
-            httpcode = 500;
+            _response.Begin( 500, "text/html" );
+            _response.print( "cannot determine if door is closed or open. check sensor(s)" );
             break;
     }
 
-    message += "</body></html>";
-
-    setNoCacheHeaders();
-
-    _server.sendHeader( "Content-Length", String( message.length() ) );
-    _server.send( httpcode, "text/html", message );
+    _response.print( "</body></html>" );
 
+    sendResponse();
 }
 
 /*======================================================================
@@ -387,8 +488,8 @@ handleDoorOpen()
 
 DESCRIPTION:
 Provides a REST endpoint to handle opening the garage door.  If the 
-door is closed, this will Toggle() the door, which will invoke the 
-garage door opener.
+door is closed, this will queue a press of the garage door opener and 
+return right away.
 
 RETURN VALUE:
 none.
@@ -397,41 +498,45 @@ SIDE EFFECTS:
 none
 
 ======================================================================*/
-void WebserverProxy::handleDoorOpen()
+void WebserverProxy::handleDoorOpen( int doornum )
 {
     if ( authenticate() == false )
     {
         return;
     }
 
-    int doornum = getDoorNumberFromUri( _server.uri() );
-
-    GarageDoor door = _garagedoors[doornum];
+    GarageDoor &door = _garagedoors[doornum];
 
-    GarageDoor::DoorStatus status = door.Status();
-    
-    String message;
+    const char *message = "";
     int httpcode = 0;
 
-    switch ( status )
+    switch ( door.Command( GarageDoor::COMMAND_OPEN ) )
     {
-        case GarageDoor::DoorStatus::OPEN:
-            message = "door already open";
-            httpcode = 409;
+        case GarageDoor::COMMAND_QUEUED:
+            message = "opening";
 
+            // Use a 200 ok for the REST result
+            httpcode = 200;
             break;
 
-        case GarageDoor::DoorStatus::CLOSED:
-            // The door is closed, so toggle the relay to open it
-            door.ToogleRelay();
-
-            message = "opening";
+        case GarageDoor::COMMAND_ALREADY_THERE:
+            message = "door already open";
 
             // Let's use the conflict code because the caller
-            // is requesting us to close an already closed door
+            // is requesting us to open an already open door
             httpcode = 409;
             break;
 
+        case GarageDoor::COMMAND_IN_PROGRESS:
+            message = "door already opening";
+            httpcode = 409;
+            break;
+
+        case GarageDoor::COMMAND_BUSY:
+            message = "too many commands queued, try again";
+            httpcode = 503;
+            break;
+
         default:
             message = "cannot determine if door is closed or open. check sensor(s)";
 
@@ -439,10 +544,10 @@ void WebserverProxy::handleDoorOpen()
             break;
     }
 
-    setNoCacheHeaders();
+    _response.Begin( httpcode, "text/plain" );
+    _response.print( message );
 
-    _server.sendHeader( "Content-Length", String( message.length() ) );
-    _server.send( httpcode, "text/plain", message );
+    sendResponse();
 }
 
 /*======================================================================
@@ -451,8 +556,8 @@ handleDoorClose()
 
 DESCRIPTION:
 Provides a REST endpoint to handle closing the garage door.  If the
-door is open, this will Toggle() the door, which will invoke the
-garage door opener.
+door is open, this will queue a press of the garage door opener and
+return right away.
 
 RETURN VALUE:
 none.
@@ -461,30 +566,22 @@ SIDE EFFECTS:
 none
 
 ======================================================================*/
-void WebserverProxy::handleDoorClose()
+void WebserverProxy::handleDoorClose( int doornum )
 {
     if ( authenticate() == false )
     {
         return;
     }
 
-    int doornum = getDoorNumberFromUri( _server.uri() );
-
-    GarageDoor door = _garagedoors[doornum];
+    GarageDoor &door = _garagedoors[doornum];
 
-    GarageDoor::DoorStatus status = door.Status();
-    
-    String message;
+    const char *message = "";
     int httpcode = 0;
 
-    switch ( status )
+    switch ( door.Command( GarageDoor::COMMAND_CLOSE ) )
     {
-        case GarageDoor::DoorStatus::OPEN:
-            // The door is open, so toggle the relay to close it
-            door.ToogleRelay();
-
-            // TODO: Should we wait for the door to close?
-
+        case GarageDoor::COMMAND_QUEUED:
+            // The state endpoint/payload says when it gets there
             message = "closing";
 
             // Use a 200 ok for the REST result
@@ -492,7 +589,7 @@ void WebserverProxy::handleDoorClose()
 
             break;
 
-        case GarageDoor::DoorStatus::CLOSED:
+        case GarageDoor::COMMAND_ALREADY_THERE:
             message = "door already closed";
 
             // Let's use the conflict code because the caller
@@ -500,6 +597,16 @@ void WebserverProxy::handleDoorClose()
             httpcode = 409;
             break;
 
+        case GarageDoor::COMMAND_IN_PROGRESS:
+            message = "door already closing";
+            httpcode = 409;
+            break;
+
+        case GarageDoor::COMMAND_BUSY:
+            message = "too many commands queued, try again";
+            httpcode = 503;
+            break;
+
         default:
             message = "cannot determine if door is closed or open. check sensor(s)";
 
@@ -507,11 +614,10 @@ void WebserverProxy::handleDoorClose()
             break;
     }
 
-    setNoCacheHeaders();
-
-    _server.sendHeader( "Content-Length", String( message.length() ) );
-    _server.send( httpcode, "text/plain", message );
+    _response.Begin( httpcode, "text/plain" );
+    _response.print( message );
 
+    sendResponse();
 }
 
 /*======================================================================
@@ -519,8 +625,10 @@ FUNCTION:
 handleDoorStatus()
 
 DESCRIPTION:
-Provides a REST endpoint to handle returning the garage door status
-(opened or closed).
+Provides a REST endpoint to handle returning the garage door state
+(open, closed, opening, closing, stopped or unknown).  The time the 
+door has been in that state and, for a moving door, the estimated time
+until it finishes go out as headers.
 
 RETURN VALUE:
 none.
@@ -529,38 +637,138 @@ SIDE EFFECTS:
 none
 
 ======================================================================*/
-void WebserverProxy::handleDoorStatus()
+void WebserverProxy::handleDoorStatus( int doornum )
 {
     if ( authenticate() == false )
     {
         return;
     }
 
-    int doornum = getDoorNumberFromUri( _server.uri() );
+    const GarageDoor &door = _garagedoors[doornum];
 
-    GarageDoor::DoorStatus status = _garagedoors[doornum].Status();
+    _response.Begin( 200, "text/plain" );
 
-    String message;
+    _response.AddHeader( "X-Door-State-Age-MS", door.GetTimeInStateMS() );
+    _response.AddHeader( "X-Door-ETA-MS", door.GetRemainingTravelMS() );
 
-    switch ( status )
+    _response.print( GarageDoor::StateToString( door.State() ) );
+
+    sendResponse();
+}
+
+/*======================================================================
+FUNCTION:
+handleDoors()
+
+DESCRIPTION:
+Returns every door in one JSON document, so a client checking all of
+them makes one (authenticated) round trip instead of one per door.  
+It is the status document MQTT publishes (see serializeJSONPayload()
+in the sketch), served from the cache.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void WebserverProxy::handleDoors()
+{
+    if ( authenticate() == false )
     {
-        case GarageDoor::DoorStatus::OPEN:
-            message = "open";
-            break;
+        return;
+    }
 
-        case GarageDoor::DoorStatus::CLOSED:
-            message = "closed";
-            break;
+    buildStatusDocument( _response );
 
-        default:
-            message = "unknown";
-            break;
+    sendResponse();
+}
+
+/*======================================================================
+FUNCTION:
+buildStatusDocument()
+
+DESCRIPTION:
+Puts the status document (the same one MQTT publishes) in the 
+response.  It comes from the cache, so a poll that finds nothing new
+is a copy of the bytes already there.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+Overwrites the response.
+
+======================================================================*/
+void WebserverProxy::buildStatusDocument( HttpResponse &response )
+{
+    size_t length = 0;
+
+    const char *document = _statusDocument.Get( length );
+
+    if ( document == nullptr )
+    {
+        response.Begin( 500, "text/plain" );
+        response.print( "cannot render the status document" );
+        return;
+    }
+
+    response.Begin( 200, "application/json" );
+    response.write( (const uint8_t *) document, length );
+}
+
+/*======================================================================
+FUNCTION:
+handleEvents()
+
+DESCRIPTION:
+Door changes as they happen.  Plain GET /garage/events opens a 
+Server-Sent Events stream.  With ?since=<version> it is a long poll
+instead: if the latest state version is already different the status
+document comes back right away, otherwise the request is held until
+it changes (200 with the document) or timeout=<s> runs out (304).
+
+Either way the connection is handed to the event stream so the web 
+server can get on with other clients.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void WebserverProxy::handleEvents()
+{
+    if ( authenticate() == false )
+    {
+        return;
+    }
+
+    if ( _server.hasArg( "since" ) == false )
+    {
+        _events.Subscribe( _server.DetachClient() );
+        return;
     }
 
-    setNoCacheHeaders();
-    
-    _server.sendHeader( "Content-Length", String( message.length() ) );
-    _server.send( 404, "text/plain", message );
+    uint32_t since = strtoul( _server.arg( "since" ).c_str(), nullptr, 10 );
+
+    unsigned long timeoutS = DoorEventStream::DEFAULT_WAIT_S;
+
+    if ( _server.hasArg( "timeout" ) == true )
+    {
+        timeoutS = strtoul( _server.arg( "timeout" ).c_str(), nullptr, 10 );
+    }
+
+    if ( GarageDoor::GetLatestStateVersion() != since || timeoutS == 0 )
+    {
+        buildStatusDocument( _response );
+        sendResponse();
+        return;
+    }
+
+    _events.Wait( _server.DetachClient(), since, timeoutS );
 }
 
 /*======================================================================
@@ -580,23 +788,29 @@ none
 ======================================================================*/
 void WebserverProxy::handleNotFound()
 {
-    String message = "File Not Found\n\n";
-    message += "URI: ";
-    message += _server.uri();
-    message += "\nMethod: ";
-    message += ( _server.method() == HTTP_GET ) ? "GET" : "POST";
-    message += "\nArguments: ";
-    message += _server.args();
-    message += "\n";
-
-    for ( uint8_t i = 0; i < _server.args(); i++ )
+    _response.Begin( 404, "text/plain" );
+
+    _response.print( "File Not Found\n\nURI: " );
+    _response.print( _server.uri() );
+    _response.print( "\nMethod: " );
+    _response.print( ( _server.method() == HTTP_GET ) ? "GET" : "POST" );
+    _response.print( "\nArguments: " );
+    _response.print( _server.args() );
+    _response.print( "\n" );
+
+    for ( int i = 0; i < _server.args(); i++ )
+    {
+        _response.printf( " %s: %s\n", _server.argName( i ).c_str(), _server.arg( i ).c_str() );
+    }
+
+    // A long query string can't fit, so send what we can
+    if ( _response.Overflowed() == true )
     {
-        message += " " + _server.argName( i ) + ": " + _server.arg( i ) + "\n";
+        _response.Begin( 404, "text/plain" );
+        _response.print( "File Not Found" );
     }
 
-    setNoCacheHeaders();
-    _server.sendHeader( "Content-Length", String( message.length() ) );
-    _server.send( 404, "text/plain", message );
+    sendResponse();
 }
 
 /*======================================================================
@@ -620,11 +834,10 @@ void WebserverProxy::handleRoot()
         return;
     }
 
-    String message = "Hi there from the Garage-o-Matic!";
+    _response.Begin( 200, "text/plain" );
+    _response.print( "Hi there from the Garage-o-Matic!" );
 
-    setNoCacheHeaders();
-    _server.sendHeader( "Content-Length", String( message.length() ) );
-    _server.send( 200, "text/plain", message );
+    sendResponse();
 }
 
 /*======================================================================
@@ -658,11 +871,12 @@ bool WebserverProxy::authenticate()
 
 /*======================================================================
 FUNCTION:
-setNoCacheHeaders()
+sendResponse()
 
 DESCRIPTION:
-Helper to set HTTP headers to direct the client to not cache
-the response.
+Sends the response the handler built in _response straight to the
+client, in one write.  It says keep-alive if the server is going to 
+leave the connection open.
 
 RETURN VALUE:
 none.
@@ -671,42 +885,14 @@ SIDE EFFECTS:
 none
 
 ======================================================================*/
-void WebserverProxy::setNoCacheHeaders()
+void WebserverProxy::sendResponse()
 {
-    _server.sendHeader( "Cache-Control", "no-cache, no-store, must-revalidate" );
-    _server.sendHeader( "Pragma", "no-cache" );
-    _server.sendHeader( "Expires", "-1" );
-}
-
-/*======================================================================
-FUNCTION:
-getDoorNumberFromUri()
-
-DESCRIPTION:
-Helper that extracts the integer value from the uri.  We will use
-this value later to offset into our door collection.
+    WiFiClient client = _server.client();
 
-RETURN VALUE:
-none.
-
-SIDE EFFECTS:
-none
-
-======================================================================*/
-int WebserverProxy::getDoorNumberFromUri( const String &uri ) const
-{
-    int lastslash = uri.lastIndexOf( '/' );
-
-    // Add 1 to offset from the last / character
-    String uridoor = uri.substring( lastslash + 1 );
-
-    // Note - we don't need to worry about trailing junk at 
-    // this point because we didn't map a correspoding url.  
-    // So if someone passes some extra characters, it will 
-    // result in the not found handler
-    int doornum = uridoor.toInt();
-
-    return doornum;
+    if ( _response.Send( client, _server.IsKeepAlive() ) == false )
+    {
+        Serial.println( "WebserverProxy: client didn't take the whole response" );
+    }
 }
 
 /*=====================================================================
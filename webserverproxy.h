@@ -49,6 +49,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //#include <ESP8266WebServer.h>
 #include "extendedwebserver.h"
 
+#include "urirouter.h"
+
+#include "httpresponse.h"
+
+#include "doorevents.h"
+
+#include "statusdocumentcache.h"
+
 #include "configuration.h"
 
 #include "garagedoor.h"
@@ -126,6 +134,7 @@ class WebserverProxy
     WebserverProxy( 
         const Configuration &config,
         GarageDoor::GarageDoorCollection &garageDoors, 
+        StatusDocumentCache &statusDocument,
         int port = 80 );
 
     void Begin();
@@ -142,23 +151,26 @@ class WebserverProxy
     
     void handleNotFound();
 
-    void handleDoorStatus();
+    void handleDoorStatus( int doornum );
 
-    void handleDoorOpen();
+    void handleDoors();
 
-    void handleDoorClose();
+    void handleEvents();
 
-    void handleCalibrate();
+    void handleDoorOpen( int doornum );
 
-    void handleCalibrateRunTest();
+    void handleDoorClose( int doornum );
 
-    bool authenticate();
+    void handleCalibrate( int doornum );
+
+    void handleCalibrateRunTest( int doornum );
 
-    // Sets the HTTP response headers to 
-    // tell the client to not cache the response
-    void setNoCacheHeaders();
+    void handleCalibrateStatus( int doornum );
 
-    int getDoorNumberFromUri( const String &uri ) const;
+    bool authenticate();
+
+    // Sends whatever the handler built in _response
+    void sendResponse();
 
     private:
 
@@ -174,6 +186,10 @@ class WebserverProxy
 
     void init();
 
+    // The cached status document as a 200, or a 500 if it can't be
+    // rendered
+    void buildStatusDocument( HttpResponse &response );
+
     //=================================================================
     // DATA MEMBERS    
     //=================================================================
@@ -181,7 +197,22 @@ class WebserverProxy
     //ESP8266WebServer _server;
     ExtendedWebServer _server;
 
-    GarageDoor::GarageDoorCollection _garagedoors;
+    // Owned by _server
+    UriRouter *_router;
+
+    // Every handler builds its response here, so there's one buffer
+    // for the life of the server instead of Strings per request
+    HttpResponse _response;
+
+    // The doors are owned by the sketch.  We hold a reference so the
+    // door state machines see the relay commands we send.
+    GarageDoor::GarageDoorCollection &_garagedoors;
+
+    // Owned by the sketch too, so MQTT and HTTP send the same bytes
+    StatusDocumentCache &_statusDocument;
+
+    // Event streams and long polls, which outlive their requests
+    DoorEventStream _events;
 
     const Configuration _config;
 };
@@ -0,0 +1,403 @@
+/*======================================================================
+FILE:
+wificonnectionmanager.cpp
+
+CREATOR:
+Sean Foley
+
+GENERAL DESCRIPTION:
+Keeps the device connected to the WLAN without ever blocking the main
+loop.  Connecting, waiting and retrying are states that advance one
+small step per loop pass, with exponential backoff (plus jitter)
+between attempts and a timeout on each one.
+
+PUBLIC CLASSES AND FUNCTIONS:
+WifiConnectionManager
+
+INITIALIZATION AND SEQUENCING REQUIREMENTS:
+Process() must be called from loop().
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND VARIABLE DEFINITIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include "wificonnectionmanager.h"
+
+#include "Arduino.h"
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Static Variable Definitions
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Function Prototypes
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Required Libraries
+//----------------------------------------------------------------------
+
+// None. (Where supported these should be in the form
+// of C++ pragmas).
+
+//======================================================================
+// FUNCTION IMPLEMENTATIONS
+//======================================================================
+
+/*======================================================================
+FUNCTION:
+WifiConnectionManager()
+
+DESCRIPTION:
+C-tor
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+WifiConnectionManager::WifiConnectionManager()
+    : _state( WIFI_IDLE ), _stateStartMS( 0 ),
+      _backoffMS( BACKOFF_MIN_MS ), _retryDelayMS( 0 ),
+      _connectCount( 0 ), _head( 0 ), _tail( 0 )
+{
+}
+
+/*======================================================================
+FUNCTION:
+Begin()
+
+DESCRIPTION:
+Hooks the SDK station events and starts the first connection attempt.
+The SDK's own auto reconnect is turned off so retries follow our
+backoff instead.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+Changes the WiFi mode to station.
+
+======================================================================*/
+void WifiConnectionManager::Begin( const String &ssid, const String &password )
+{
+    if ( _state != WIFI_IDLE )
+    {
+        return;
+    }
+
+    _ssid     = ssid;
+    _password = password;
+
+    _connectedHandler = WiFi.onStationModeConnected(
+        [this]( const WiFiEventStationModeConnected & ) { queueEvent( EVENT_CONNECTED ); } );
+
+    _gotIpHandler = WiFi.onStationModeGotIP(
+        [this]( const WiFiEventStationModeGotIP & ) { queueEvent( EVENT_GOT_IP ); } );
+
+    _disconnectedHandler = WiFi.onStationModeDisconnected(
+        [this]( const WiFiEventStationModeDisconnected &info ) { queueEvent( EVENT_DISCONNECTED, info.reason ); } );
+
+    WiFi.persistent( false );
+    WiFi.setAutoReconnect( false );
+    WiFi.mode( WIFI_STA );
+
+    Serial.printf( "Found configuration, attempting to connect to WLAN %s\n", _ssid.c_str() );
+
+    startAttempt();
+}
+
+/*======================================================================
+FUNCTION:
+Process()
+
+DESCRIPTION:
+Drains the queued SDK events, then checks the timers for the current
+state.  Each call does a handful of comparisons at most.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+May start a new connection attempt.
+
+======================================================================*/
+void WifiConnectionManager::Process()
+{
+    if ( _state == WIFI_IDLE )
+    {
+        return;
+    }
+
+    Event event;
+
+    while ( popEvent( event ) == true )
+    {
+        switch ( event.type )
+        {
+            case EVENT_CONNECTED:
+                Serial.println( "**Wifi connected" );
+                break;
+
+            case EVENT_GOT_IP:
+                if ( _state == WIFI_CONNECTING )
+                {
+                    connected();
+                }
+                break;
+
+            case EVENT_DISCONNECTED:
+                Serial.printf( "**WIFI disconnected, reason %d**\n", event.reason );
+
+                // While connecting, the SDK reports every failed 
+                // association (and begin() itself can trigger one), so
+                // the attempt is judged by WiFi.status() below instead
+                if ( _state == WIFI_CONNECTED )
+                {
+                    backoff( "link lost" );
+                }
+                break;
+        }
+    }
+
+    unsigned long elapsed = millis() - _stateStartMS;
+
+    switch ( _state )
+    {
+        case WIFI_CONNECTING:
+        {
+            wl_status_t status = WiFi.status();
+
+            if ( status == WL_CONNECTED )
+            {
+                // In case the event queue dropped the got-ip event
+                connected();
+            }
+            else if ( status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED )
+            {
+                backoff( "attempt failed" );
+            }
+            else if ( elapsed >= CONNECT_TIMEOUT_MS )
+            {
+                backoff( "attempt timed out" );
+            }
+        }
+            break;
+
+        case WIFI_BACKOFF:
+            if ( elapsed >= _retryDelayMS )
+            {
+                startAttempt();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*======================================================================
+FUNCTION:
+startAttempt()
+
+DESCRIPTION:
+Kicks off one connection attempt.  WiFi.begin() returns right away;
+the result shows up as an SDK event.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void WifiConnectionManager::startAttempt()
+{
+    WiFi.begin( _ssid.c_str(), _password.c_str() );
+
+    _state = WIFI_CONNECTING;
+    _stateStartMS = millis();
+}
+
+/*======================================================================
+FUNCTION:
+connected()
+
+DESCRIPTION:
+The attempt worked.  Resets the backoff for the next time the link
+drops.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void WifiConnectionManager::connected()
+{
+    _state = WIFI_CONNECTED;
+    _stateStartMS = millis();
+    _backoffMS = BACKOFF_MIN_MS;
+    _connectCount++;
+
+    Serial.printf( "Connected to SSID %s, ip address %s\n",
+                   _ssid.c_str(),
+                   WiFi.localIP().toString().c_str() );
+}
+
+/*======================================================================
+FUNCTION:
+backoff()
+
+DESCRIPTION:
+Waits out the current backoff (with jitter) before the next attempt,
+and doubles the backoff for the time after that.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void WifiConnectionManager::backoff( const char *why )
+{
+    long jitterRange = ( _backoffMS * BACKOFF_JITTER_PERCENT ) / 100;
+
+    // Hardware random number generator
+    long jitter = (long) ( RANDOM_REG32 % ( 2 * jitterRange + 1 ) ) - jitterRange;
+
+    _retryDelayMS = _backoffMS + jitter;
+
+    Serial.printf( "WiFi %s, retrying in %lu ms\n", why, _retryDelayMS );
+
+    _backoffMS *= 2;
+
+    if ( _backoffMS > BACKOFF_MAX_MS )
+    {
+        _backoffMS = BACKOFF_MAX_MS;
+    }
+
+    _state = WIFI_BACKOFF;
+    _stateStartMS = millis();
+}
+
+/*======================================================================
+FUNCTION:
+queueEvent()
+
+DESCRIPTION:
+Called from the SDK event handlers.  Just records the event; if the
+queue is full the event is dropped, which is fine since the connect
+timeout covers anything we miss.
+
+RETURN VALUE:
+none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+void WifiConnectionManager::queueEvent( EventType type, uint8_t reason )
+{
+    uint8_t next = ( _head + 1 ) & ( EVENT_QUEUE_SIZE - 1 );
+
+    if ( next == _tail )
+    {
+        return;
+    }
+
+    _events[_head].type   = type;
+    _events[_head].reason = reason;
+
+    _head = next;
+}
+
+/*======================================================================
+FUNCTION:
+popEvent()
+
+DESCRIPTION:
+Takes the oldest queued event
+
+RETURN VALUE:
+false if there are none.
+
+SIDE EFFECTS:
+none
+
+======================================================================*/
+bool WifiConnectionManager::popEvent( Event &event )
+{
+    if ( _tail == _head )
+    {
+        return false;
+    }
+
+    event = _events[_tail];
+
+    _tail = ( _tail + 1 ) & ( EVENT_QUEUE_SIZE - 1 );
+
+    return true;
+}
+
+/*=====================================================================
+// IMPLEMENTATION NOTES
+//=====================================================================
+
+None
+
+=====================================================================*/
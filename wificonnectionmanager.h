@@ -0,0 +1,262 @@
+#ifndef _GARAGEOMATIC_WIFICONNECTIONMANAGER_H_
+#define _GARAGEOMATIC_WIFICONNECTIONMANAGER_H_
+
+/*======================================================================
+FILE:
+wificonnectionmanager.h
+
+CREATOR:
+Sean Foley
+
+DESCRIPTION:
+Keeps the device connected to the WLAN without ever blocking the main
+loop.  Connecting, waiting and retrying are states that advance one
+small step per loop pass, with exponential backoff (plus jitter)
+between attempts and a timeout on each one.
+
+PUBLIC CLASSES AND FUNCTIONS:
+WifiConnectionManager
+
+Copyright (C) 2017 Sean Foley  All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted.  Enjoy.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+======================================================================*/
+
+//======================================================================
+// INCLUDES AND PUBLIC DATA DECLARATIONS
+//======================================================================
+
+//----------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Include Files
+//----------------------------------------------------------------------
+
+#include <ESP8266WiFi.h>
+
+#include <stdint.h>
+
+//----------------------------------------------------------------------
+// Type Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Constant Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//----------------------------------------------------------------------
+// Global Data Declarations
+//----------------------------------------------------------------------
+
+// None.
+
+//======================================================================
+// WARNINGS!!!
+//======================================================================
+
+// The SDK event handlers only queue events.  All state changes happen
+// in Process(), on the main loop.
+
+//======================================================================
+// FUNCTION DECLARATIONS
+//======================================================================
+
+// None.
+
+//=====================================================================
+// EXCEPTION CLASS DEFINITIONS
+//=====================================================================
+
+// None.
+
+//======================================================================
+// CLASS DEFINITIONS
+//======================================================================
+
+/*======================================================================
+CLASS:
+WifiConnectionManager
+
+DESCRIPTION:
+Station mode connection state machine:
+
+    IDLE -> CONNECTING -> CONNECTED
+               |   ^          |
+               v   |          v
+              BACKOFF <-------+
+
+An attempt that fails (no SSID, bad password) or times out waits out a
+backoff that doubles with each failure, up to a cap, with some random
+jitter so a room full of devices doesn't hammer a rebooted AP in
+lock step.  The backoff resets once we connect.
+
+HOW TO USE:
+1. Call Begin() with the WLAN credentials.
+2. Call Process() on every loop pass.
+3. IsConnected() says if the network is usable.
+
+======================================================================*/
+class WifiConnectionManager
+{
+    public:
+
+    //=================================================================
+    // TYPE DECLARATIONS AND CONSTANTS
+    //=================================================================
+
+    enum ConnectionState
+    {
+        WIFI_IDLE = 0,
+        WIFI_CONNECTING,
+        WIFI_CONNECTED,
+        WIFI_BACKOFF
+    };
+
+    // How long one attempt gets to associate and get an IP
+    static const unsigned long CONNECT_TIMEOUT_MS = 20000;
+
+    // Backoff after the first failure, doubled after each one after
+    // that up to the max
+    static const unsigned long BACKOFF_MIN_MS = 1000;
+    static const unsigned long BACKOFF_MAX_MS = 60000;
+
+    // +/- this percent of the backoff is random
+    static const int BACKOFF_JITTER_PERCENT = 25;
+
+    // Must be a power of 2 so the index wraps with a mask
+    static const uint8_t EVENT_QUEUE_SIZE = 8;
+
+    //=================================================================
+    // CLIENT INTERFACE
+    //=================================================================
+
+    WifiConnectionManager();
+
+    // Starts connecting.  Calling it again with the manager running
+    // does nothing.
+    void Begin( const String &ssid, const String &password );
+
+    // Drains the SDK events and advances the state machine one step
+    void Process();
+
+    bool IsConnected() const { return _state == WIFI_CONNECTED; }
+
+    ConnectionState GetState() const { return _state; }
+
+    // Number of times we have connected since boot
+    uint32_t GetConnectCount() const { return _connectCount; }
+
+    protected:
+
+    //=================================================================
+    // SUBCLASS INTERFACE
+    //=================================================================
+
+    // None.
+
+    private:
+
+    //=================================================================
+    // CUSTOMIZATION INTERFACE
+    //=================================================================
+
+    // None.
+
+    //=================================================================
+    // IMPLEMENTATION INTERFACE
+    //=================================================================
+
+    enum EventType
+    {
+        EVENT_CONNECTED = 0,
+        EVENT_GOT_IP,
+        EVENT_DISCONNECTED
+    };
+
+    struct Event
+    {
+        EventType type;
+        uint8_t   reason;
+    };
+
+    // Called from the SDK event handlers
+    void queueEvent( EventType type, uint8_t reason = 0 );
+
+    bool popEvent( Event &event );
+
+    void startAttempt();
+
+    void connected();
+
+    // Schedules the next attempt and moves to BACKOFF
+    void backoff( const char *why );
+
+    // No copying. Leaving the implementation undefined to cause a link
+    // error
+    WifiConnectionManager( const WifiConnectionManager &rhs );
+
+    //=================================================================
+    // DATA MEMBERS
+    //=================================================================
+
+    String _ssid;
+    String _password;
+
+    ConnectionState _state;
+
+    // millis() when the current state's wait started
+    unsigned long _stateStartMS;
+
+    unsigned long _backoffMS;
+    unsigned long _retryDelayMS;
+
+    uint32_t _connectCount;
+
+    // The SDK only calls a handler for as long as we hold on to it
+    WiFiEventHandler _connectedHandler;
+    WiFiEventHandler _gotIpHandler;
+    WiFiEventHandler _disconnectedHandler;
+
+    Event _events[EVENT_QUEUE_SIZE];
+
+    // _head is only written by the SDK handlers, _tail only by Process()
+    volatile uint8_t _head;
+    volatile uint8_t _tail;
+};
+
+//======================================================================
+// INLINE FUNCTION DEFINITIONS
+//======================================================================
+
+// None.
+
+/*======================================================================
+// DOCUMENTATION
+========================================================================
+
+None.
+
+======================================================================*/
+
+#endif	// #ifendif _GARAGEOMATIC_WIFICONNECTIONMANAGER_H_